@@ -0,0 +1,112 @@
+/* CPU backends of the frontend. */
+
+#include <string.h>
+
+#include "backend.h"
+#include "gigatron.h"
+
+/* The Verilated RTL model (see `tests/cpp/backend_vtop.cpp`). It is
+ * only defined in the programs linked with the model.
+ */
+extern const struct gigatron_backend_ops gigatron_backend_vtop
+    __attribute__((weak));
+
+static int reference_create(struct gigatron_backend *be,
+                            const char *rom_filename, uint32_t ram_size)
+{
+    return gigatron_create(&be->gs, rom_filename, ram_size);
+}
+
+static void reference_destroy(struct gigatron_backend *be)
+{
+    gigatron_destroy(&be->gs);
+}
+
+static void reference_reset(struct gigatron_backend *be, int zero_ram)
+{
+    gigatron_reset(&be->gs, zero_ram);
+}
+
+static void reference_step(struct gigatron_backend *be)
+{
+    gigatron_step(&be->gs);
+}
+
+/* The reference C core (`gigatron_step()`). */
+static const struct gigatron_backend_ops reference_ops = {
+    "reference", "the C core (gigatron_step())", BACKEND_LIVE_RAM,
+    &reference_create, &reference_destroy, &reference_reset,
+    &reference_step, NULL
+};
+
+const struct gigatron_backend_ops *gigatron_backend_get(uint32_t index)
+{
+    if (index == 0)
+        return &reference_ops;
+    if (index == 1 && &gigatron_backend_vtop != NULL)
+        return &gigatron_backend_vtop;
+    return NULL;
+}
+
+const struct gigatron_backend_ops *gigatron_backend_find(const char *name)
+{
+    const struct gigatron_backend_ops *ops;
+    uint32_t i;
+
+    for (i = 0; (ops = gigatron_backend_get(i)) != NULL; i++) {
+        if (strcmp(ops->name, name) == 0)
+            return ops;
+    }
+    return NULL;
+}
+
+int gigatron_backend_create(struct gigatron_backend *be,
+                            const struct gigatron_backend_ops *ops,
+                            const char *rom_filename, uint32_t ram_size)
+{
+    be->ops = ops;
+    be->priv = NULL;
+    return ops->create(be, rom_filename, ram_size);
+}
+
+void gigatron_backend_destroy(struct gigatron_backend *be)
+{
+    be->ops->destroy(be);
+}
+
+void gigatron_backend_reset(struct gigatron_backend *be, int zero_ram)
+{
+    be->ops->reset(be, zero_ram);
+}
+
+uint64_t gigatron_backend_run(struct gigatron_backend *be,
+                              uint64_t max_cycles, uint32_t events)
+{
+    struct gigatron_state *gs;
+    uint64_t n;
+    uint8_t rising;
+
+    gs = &be->gs;
+    for (n = 0; n < max_cycles; ) {
+        /* The reference core is called directly. */
+        if (be->ops == &reference_ops) {
+            gigatron_step(gs);
+        } else {
+            be->ops->step(be);
+        }
+        n++;
+
+        rising = gs->reg_out & ~gs->prev_out;
+        if (((events & BACKEND_EVENT_HSYNC) && (rising & 0x40))
+            || ((events & BACKEND_EVENT_VSYNC) && (rising & 0x80)))
+            break;
+    }
+    return n;
+}
+
+const uint8_t *gigatron_backend_ram(struct gigatron_backend *be)
+{
+    if (be->ops->sync_ram)
+        be->ops->sync_ram(be);
+    return be->gs.ram;
+}
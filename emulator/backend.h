@@ -0,0 +1,106 @@
+#ifndef __BACKEND_H
+#define __BACKEND_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "gigatron.h"
+
+/* Constants. */
+
+/* Events that stop `gigatron_backend_run()` (after the cycle on
+ * which they happen).
+ */
+#define BACKEND_EVENT_HSYNC 1 /* Rising edge of /HSYNC. */
+#define BACKEND_EVENT_VSYNC 2 /* Rising edge of /VSYNC. */
+
+/* Capabilities of the backends. */
+#define BACKEND_LIVE_RAM    1 /* `gs.ram` is updated at every cycle. */
+
+/* Data structures and type declarations. */
+
+struct gigatron_backend;
+
+/* The operations of a backend (the CPU core behind the frontend). */
+struct gigatron_backend_ops {
+    const char *name;
+    const char *description;
+    uint32_t flags;      /* Capabilities (`BACKEND_LIVE_RAM`). */
+
+    /* Creates the backend for the ROM in `rom_filename`, with a RAM
+     * of `ram_size` bytes. Returns TRUE on success.
+     */
+    int (*create)(struct gigatron_backend *be, const char *rom_filename,
+                  uint32_t ram_size);
+    void (*destroy)(struct gigatron_backend *be);
+
+    /* Resets the CPU (and clears the RAM if `zero_ram` is TRUE). */
+    void (*reset)(struct gigatron_backend *be, int zero_ram);
+
+    /* Executes one cycle, latching `gs.in` as the input, and updates
+     * the registers in `gs`.
+     */
+    void (*step)(struct gigatron_backend *be);
+
+    /* Copies the RAM of the CPU into `gs.ram` (NULL for the backends
+     * with `BACKEND_LIVE_RAM`).
+     */
+    void (*sync_ram)(struct gigatron_backend *be);
+};
+
+/* An instance of a backend.
+ * The frontend reads the registers from `gs` after each cycle, and
+ * writes the input in `gs.in`. The ROM (`gs.rom`) is always loaded,
+ * so that the tools of the emulator (disassembler, profilers) work
+ * with every backend. The RAM in `gs.ram` is only current after
+ * `gigatron_backend_ram()`, unless the backend has
+ * `BACKEND_LIVE_RAM`.
+ */
+struct gigatron_backend {
+    const struct gigatron_backend_ops *ops;
+    struct gigatron_state gs;
+    void *priv;          /* Private data of the backend. */
+};
+
+/* Exported functions. */
+
+/* Returns the backend `index` of the registry (the reference C core
+ * is the backend 0), or NULL if `index` is past the end. Backends
+ * that are not linked in (like the Verilated model, which is only
+ * built in `tests/cpp`) are not listed.
+ */
+const struct gigatron_backend_ops *gigatron_backend_get(uint32_t index);
+
+/* Returns the backend named `name`, or NULL if there is none. */
+const struct gigatron_backend_ops *gigatron_backend_find(const char *name);
+
+/* Creates the instance `be` of the backend `ops`.
+ * On success, this function returns TRUE.
+ */
+int gigatron_backend_create(struct gigatron_backend *be,
+                            const struct gigatron_backend_ops *ops,
+                            const char *rom_filename, uint32_t ram_size);
+
+/* Destroys the instance `be`. */
+void gigatron_backend_destroy(struct gigatron_backend *be);
+
+/* Resets the CPU of `be` (see `gigatron_reset()`). */
+void gigatron_backend_reset(struct gigatron_backend *be, int zero_ram);
+
+/* Executes at most `max_cycles` cycles, stopping after the first
+ * cycle with one of the events in `events`. Returns the number of
+ * cycles executed.
+ */
+uint64_t gigatron_backend_run(struct gigatron_backend *be,
+                              uint64_t max_cycles, uint32_t events);
+
+/* Returns the RAM of `be`, copied from the CPU if necessary. */
+const uint8_t *gigatron_backend_ram(struct gigatron_backend *be);
+
+/* Executes one cycle. */
+static inline void gigatron_backend_step(struct gigatron_backend *be)
+{
+    be->ops->step(be);
+}
+
+#endif /* __BACKEND_H */
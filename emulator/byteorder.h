@@ -0,0 +1,34 @@
+#ifndef __BYTEORDER_H
+#define __BYTEORDER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Exported functions. */
+
+/* Writes `v` as a little-endian integer of `size` bytes in `p`
+ * (the byte order of all the file formats and of the protocols).
+ */
+static inline void gigatron_put_le(uint8_t *p, uint64_t v, int size)
+{
+    int i;
+
+    for (i = 0; i < size; i++) {
+        p[i] = (uint8_t) v;
+        v >>= 8;
+    }
+}
+
+/* Reads a little-endian integer of `size` bytes from `p`. */
+static inline uint64_t gigatron_get_le(const uint8_t *p, int size)
+{
+    uint64_t v;
+    int i;
+
+    v = 0;
+    for (i = size - 1; i >= 0; i--)
+        v = (v << 8) | p[i];
+    return v;
+}
+
+#endif /* __BYTEORDER_H */
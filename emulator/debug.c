@@ -0,0 +1,312 @@
+/* Breakpoints and watchpoints. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug.h"
+
+void gigatron_debug_create(struct gigatron_debugger *dbg,
+                           const uint16_t *rom, uint16_t dispatch)
+{
+    memset(dbg->rom_flags, 0, sizeof(dbg->rom_flags));
+    memset(dbg->ram_flags, 0, sizeof(dbg->ram_flags));
+    gigatron_memprof_decode(dbg->access);
+
+    dbg->num_conditions = 0;
+    dbg->dispatch = (dispatch) ? dispatch
+        : gigatron_vprofile_find_dispatch(rom);
+    dbg->num_breaks = 0;
+    dbg->num_vbreaks = 0;
+    dbg->num_watches = 0;
+    dbg->single_step = FALSE;
+
+    dbg->reason = DEBUG_STOP_NONE;
+    dbg->stop_addr = 0;
+}
+
+void gigatron_debug_break(struct gigatron_debugger *dbg, uint16_t addr,
+                          int enable)
+{
+    uint8_t *flags;
+
+    flags = &dbg->rom_flags[addr];
+    if (enable && !(*flags & DEBUG_BREAK)) {
+        *flags |= DEBUG_BREAK;
+        dbg->num_breaks++;
+    } else if (!enable && (*flags & DEBUG_BREAK)) {
+        *flags &= ~DEBUG_BREAK;
+        dbg->num_breaks--;
+    }
+}
+
+int gigatron_debug_vbreak(struct gigatron_debugger *dbg, uint16_t addr,
+                          int enable)
+{
+    uint8_t *flags;
+
+    if (dbg->dispatch == 0) {
+        fprintf(stderr, "could not find the vCPU dispatch\n");
+        return FALSE;
+    }
+
+    flags = &dbg->ram_flags[addr];
+    if (enable && !(*flags & DEBUG_VBREAK)) {
+        *flags |= DEBUG_VBREAK;
+        dbg->num_vbreaks++;
+    } else if (!enable && (*flags & DEBUG_VBREAK)) {
+        *flags &= ~DEBUG_VBREAK;
+        dbg->num_vbreaks--;
+    }
+
+    /* The dispatch is only checked when there are vCPU breakpoints. */
+    if (dbg->num_vbreaks > 0) {
+        dbg->rom_flags[dbg->dispatch] |= DEBUG_DISPATCH;
+    } else {
+        dbg->rom_flags[dbg->dispatch] &= ~DEBUG_DISPATCH;
+    }
+    return TRUE;
+}
+
+void gigatron_debug_watch(struct gigatron_debugger *dbg, uint16_t addr,
+                          uint8_t flags, int enable)
+{
+    uint8_t *f;
+    int was_set;
+
+    flags &= DEBUG_WATCH_READ | DEBUG_WATCH_WRITE;
+    f = &dbg->ram_flags[addr];
+    was_set = (*f & (DEBUG_WATCH_READ | DEBUG_WATCH_WRITE)) != 0;
+
+    if (enable) {
+        *f |= flags;
+    } else {
+        *f &= ~flags;
+    }
+
+    if (!was_set && (*f & (DEBUG_WATCH_READ | DEBUG_WATCH_WRITE)))
+        dbg->num_watches++;
+    else if (was_set && !(*f & (DEBUG_WATCH_READ | DEBUG_WATCH_WRITE)))
+        dbg->num_watches--;
+}
+
+int gigatron_debug_add_condition(struct gigatron_debugger *dbg,
+                                 uint16_t pc, enum debug_register reg,
+                                 enum debug_comparison cmp, uint8_t value)
+{
+    struct debug_condition *cond;
+
+    if (dbg->num_conditions == DEBUG_MAX_CONDITIONS) {
+        fprintf(stderr, "too many conditional breakpoints\n");
+        return FALSE;
+    }
+
+    cond = &dbg->conditions[dbg->num_conditions++];
+    cond->pc = pc;
+    cond->reg = (uint8_t) reg;
+    cond->cmp = (uint8_t) cmp;
+    cond->value = value;
+    dbg->rom_flags[pc] |= DEBUG_CONDITION;
+    return TRUE;
+}
+
+int gigatron_debug_parse_condition(struct gigatron_debugger *dbg,
+                                   const char *spec)
+{
+    static const char *reg_names[DEBUG_NUM_REGISTERS] = {
+        "acc", "x", "y", "out", "in"
+    };
+    static const char *cmp_names[] = { "==", "!=", "<", ">" };
+    unsigned long pc, value;
+    char *p, *end;
+    size_t len;
+    int reg, cmp;
+
+    pc = strtoul(spec, &p, 0);
+    if (p == spec || *p != ':' || pc > 0xFFFF)
+        goto fail_parse;
+    p++;
+
+    for (reg = 0; reg < DEBUG_NUM_REGISTERS; reg++) {
+        len = strlen(reg_names[reg]);
+        if (strncmp(p, reg_names[reg], len) == 0
+            && (p[len] == '=' || p[len] == '!'
+                || p[len] == '<' || p[len] == '>'))
+            break;
+    }
+    if (reg == DEBUG_NUM_REGISTERS)
+        goto fail_parse;
+    p += strlen(reg_names[reg]);
+
+    for (cmp = 0; cmp < 4; cmp++) {
+        len = strlen(cmp_names[cmp]);
+        if (strncmp(p, cmp_names[cmp], len) == 0)
+            break;
+    }
+    if (cmp == 4)
+        goto fail_parse;
+    p += strlen(cmp_names[cmp]);
+
+    value = strtoul(p, &end, 0);
+    if (end == p || *end != '\0' || value > 0xFF)
+        goto fail_parse;
+
+    return gigatron_debug_add_condition(dbg, (uint16_t) pc,
+                                        (enum debug_register) reg,
+                                        (enum debug_comparison) cmp,
+                                        (uint8_t) value);
+
+fail_parse:
+    fprintf(stderr, "invalid condition `%s`\n", spec);
+    return FALSE;
+}
+
+int gigatron_debug_armed(const struct gigatron_debugger *dbg)
+{
+    return (dbg->num_breaks > 0 || dbg->num_vbreaks > 0
+            || dbg->num_watches > 0 || dbg->num_conditions > 0
+            || dbg->single_step);
+}
+
+void gigatron_debug_clear(struct gigatron_debugger *dbg)
+{
+    memset(dbg->rom_flags, 0, sizeof(dbg->rom_flags));
+    memset(dbg->ram_flags, 0, sizeof(dbg->ram_flags));
+    dbg->num_conditions = 0;
+    dbg->num_breaks = 0;
+    dbg->num_vbreaks = 0;
+    dbg->num_watches = 0;
+    dbg->single_step = FALSE;
+}
+
+/* Evaluates the conditional breakpoints at the ROM address `pc`. */
+static int check_conditions(const struct gigatron_debugger *dbg,
+                            const struct gigatron_state *gs, uint16_t pc)
+{
+    uint32_t i;
+
+    for (i = 0; i < dbg->num_conditions; i++) {
+        const struct debug_condition *cond;
+        uint8_t v;
+        int hit;
+
+        cond = &dbg->conditions[i];
+        if (cond->pc != pc) continue;
+
+        switch (cond->reg) {
+        case DEBUG_REG_ACC: v = gs->reg_acc; break;
+        case DEBUG_REG_X: v = gs->reg_x; break;
+        case DEBUG_REG_Y: v = gs->reg_y; break;
+        case DEBUG_REG_OUT: v = gs->reg_out; break;
+        default: v = gs->reg_in; break;
+        }
+
+        switch (cond->cmp) {
+        case DEBUG_EQ: hit = (v == cond->value); break;
+        case DEBUG_NE: hit = (v != cond->value); break;
+        case DEBUG_LT: hit = (v < cond->value); break;
+        default: hit = (v > cond->value); break;
+        }
+
+        if (hit) return TRUE;
+    }
+    return FALSE;
+}
+
+int gigatron_debug_check(struct gigatron_debugger *dbg,
+                         const struct gigatron_state *gs)
+{
+    uint16_t pc;
+    uint8_t flags, access;
+
+    pc = gs->prev_pc;
+    flags = dbg->rom_flags[pc];
+
+    if (flags & DEBUG_BREAK) {
+        dbg->reason = DEBUG_STOP_BREAK;
+        dbg->stop_addr = pc;
+        return TRUE;
+    }
+
+    if ((flags & DEBUG_CONDITION) && check_conditions(dbg, gs, pc)) {
+        dbg->reason = DEBUG_STOP_CONDITION;
+        dbg->stop_addr = pc;
+        return TRUE;
+    }
+
+    if (flags & DEBUG_DISPATCH) {
+        uint16_t vpc;
+
+        vpc = (uint16_t) (gs->ram[VPROFILE_VPC_ADDR]
+                          | (gs->ram[VPROFILE_VPC_ADDR + 1] << 8));
+        if (dbg->ram_flags[vpc] & DEBUG_VBREAK) {
+            dbg->reason = DEBUG_STOP_VBREAK;
+            dbg->stop_addr = vpc;
+            return TRUE;
+        }
+    }
+
+    access = dbg->access[gs->reg_ir];
+    if (access && dbg->num_watches > 0) {
+        uint32_t addr;
+
+        addr = gigatron_memprof_address(access, gs);
+        if ((access & MEMPROF_READ)
+            && (dbg->ram_flags[addr] & DEBUG_WATCH_READ)) {
+            dbg->reason = DEBUG_STOP_READ;
+            dbg->stop_addr = (uint16_t) addr;
+            return TRUE;
+        }
+
+        if ((access & MEMPROF_WRITE)
+            && (dbg->ram_flags[addr] & DEBUG_WATCH_WRITE)) {
+            dbg->reason = DEBUG_STOP_WRITE;
+            dbg->stop_addr = (uint16_t) addr;
+            return TRUE;
+        }
+    }
+
+    if (dbg->single_step) {
+        dbg->reason = DEBUG_STOP_SINGLE;
+        dbg->stop_addr = pc;
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+uint64_t gigatron_debug_run(struct gigatron_debugger *dbg,
+                            struct gigatron_state *gs,
+                            uint64_t num_cycles)
+{
+    uint64_t i;
+
+    dbg->reason = DEBUG_STOP_NONE;
+
+    /* Nothing armed: the plain loop. */
+    if (!gigatron_debug_armed(dbg)) {
+        for (i = 0; i < num_cycles; i++)
+            gigatron_step(gs);
+        return num_cycles;
+    }
+
+    for (i = 0; i < num_cycles; i++) {
+        gigatron_step(gs);
+        if (gigatron_debug_step(dbg, gs))
+            return i + 1;
+    }
+    return num_cycles;
+}
+
+const char *gigatron_debug_reason(enum debug_stop_reason reason)
+{
+    switch (reason) {
+    case DEBUG_STOP_BREAK: return "breakpoint";
+    case DEBUG_STOP_CONDITION: return "conditional breakpoint";
+    case DEBUG_STOP_VBREAK: return "vCPU breakpoint";
+    case DEBUG_STOP_READ: return "read watchpoint";
+    case DEBUG_STOP_WRITE: return "write watchpoint";
+    case DEBUG_STOP_SINGLE: return "single step";
+    default: return "none";
+    }
+}
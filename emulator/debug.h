@@ -0,0 +1,174 @@
+#ifndef __DEBUG_H
+#define __DEBUG_H
+
+#include <stdint.h>
+
+#include "gigatron.h"
+#include "memprof.h"
+#include "vprofile.h"
+
+/* Constants. */
+
+/* Flags of each ROM address in `gigatron_debugger.rom_flags`. */
+#define DEBUG_BREAK       0x01 /* Native breakpoint. */
+#define DEBUG_CONDITION   0x02 /* Conditional native breakpoint. */
+#define DEBUG_DISPATCH    0x04 /* vCPU dispatch (with vCPU breakpoints). */
+
+/* Flags of each RAM address in `gigatron_debugger.ram_flags`. */
+#define DEBUG_VBREAK      0x01 /* vCPU breakpoint. */
+#define DEBUG_WATCH_READ  0x02 /* RAM read watchpoint. */
+#define DEBUG_WATCH_WRITE 0x04 /* RAM write watchpoint. */
+
+/* Maximum number of conditional breakpoints. */
+#define DEBUG_MAX_CONDITIONS 64
+
+/* Registers tested by the conditional breakpoints. */
+enum debug_register {
+    DEBUG_REG_ACC = 0,
+    DEBUG_REG_X,
+    DEBUG_REG_Y,
+    DEBUG_REG_OUT,
+    DEBUG_REG_IN,
+    DEBUG_NUM_REGISTERS
+};
+
+/* Comparisons of the conditional breakpoints. */
+enum debug_comparison {
+    DEBUG_EQ = 0,
+    DEBUG_NE,
+    DEBUG_LT,
+    DEBUG_GT
+};
+
+/* Reasons to stop. */
+enum debug_stop_reason {
+    DEBUG_STOP_NONE = 0, /* Not stopped (the cycles ran out). */
+    DEBUG_STOP_BREAK,    /* Native breakpoint. */
+    DEBUG_STOP_CONDITION,/* Conditional breakpoint. */
+    DEBUG_STOP_VBREAK,   /* vCPU breakpoint. */
+    DEBUG_STOP_READ,     /* RAM read watchpoint. */
+    DEBUG_STOP_WRITE,    /* RAM write watchpoint. */
+    DEBUG_STOP_SINGLE    /* Single step. */
+};
+
+/* Data structures and type declarations. */
+
+/* A conditional breakpoint. */
+struct debug_condition {
+    uint16_t pc;         /* The ROM address. */
+    uint8_t reg;         /* The register (see `debug_register`). */
+    uint8_t cmp;         /* The comparison (see `debug_comparison`). */
+    uint8_t value;       /* The value compared with the register. */
+};
+
+/* The debugger.
+ * The breakpoints and watchpoints are kept in two tables of flags,
+ * indexed by ROM address and by RAM address (the vCPU breakpoints
+ * are RAM addresses). All of them stop the emulation right before
+ * the instruction that triggers them is executed.
+ */
+struct gigatron_debugger {
+    uint8_t rom_flags[65536];
+    uint8_t ram_flags[65536];
+    uint8_t access[256]; /* Access of each opcode (see `memprof.h`). */
+
+    struct debug_condition conditions[DEBUG_MAX_CONDITIONS];
+    uint32_t num_conditions;
+
+    uint16_t dispatch;   /* ROM address of the vCPU dispatch (or 0). */
+    uint32_t num_breaks; /* Number of native breakpoints. */
+    uint32_t num_vbreaks;/* Number of vCPU breakpoints. */
+    uint32_t num_watches;/* Number of watchpoints. */
+    int single_step;     /* Stop after every instruction. */
+
+    /* Why and where the emulation stopped. */
+    enum debug_stop_reason reason;
+    uint16_t stop_addr;  /* The address that triggered the stop. */
+};
+
+/* Exported functions. */
+
+/* Creates the debugger `dbg` for the ROM `rom`, with nothing armed.
+ * The vCPU dispatch is found as in `gigatron_vprofile_create()`,
+ * unless `dispatch` is not zero.
+ */
+void gigatron_debug_create(struct gigatron_debugger *dbg,
+                           const uint16_t *rom, uint16_t dispatch);
+
+/* Sets (if `enable` is TRUE) or clears a native breakpoint at the
+ * ROM address `addr`.
+ */
+void gigatron_debug_break(struct gigatron_debugger *dbg, uint16_t addr,
+                          int enable);
+
+/* Sets (if `enable` is TRUE) or clears a vCPU breakpoint at the
+ * vCPU address `addr`. Returns FALSE if the dispatch of the
+ * interpreter is unknown.
+ */
+int gigatron_debug_vbreak(struct gigatron_debugger *dbg, uint16_t addr,
+                          int enable);
+
+/* Sets (if `enable` is TRUE) or clears a watchpoint at the RAM
+ * address `addr`. The value `flags` selects the reads
+ * (`DEBUG_WATCH_READ`) and/or the writes (`DEBUG_WATCH_WRITE`).
+ */
+void gigatron_debug_watch(struct gigatron_debugger *dbg, uint16_t addr,
+                          uint8_t flags, int enable);
+
+/* Adds a conditional breakpoint at the ROM address `pc`, which
+ * stops when `reg` compares with `value` by `cmp`.
+ * On success, this function returns TRUE.
+ */
+int gigatron_debug_add_condition(struct gigatron_debugger *dbg,
+                                 uint16_t pc, enum debug_register reg,
+                                 enum debug_comparison cmp, uint8_t value);
+
+/* Adds a conditional breakpoint given as text, in the form
+ * "<address>:<register><comparison><value>" (for example,
+ * "0x0305:acc==0x10"), where the register is one of `acc`, `x`,
+ * `y`, `out` or `in`, and the comparison is one of `==`, `!=`, `<`
+ * or `>`. On success, this function returns TRUE.
+ */
+int gigatron_debug_parse_condition(struct gigatron_debugger *dbg,
+                                   const char *spec);
+
+/* Returns TRUE if any breakpoint or watchpoint is armed. */
+int gigatron_debug_armed(const struct gigatron_debugger *dbg);
+
+/* Removes all the breakpoints and watchpoints. */
+void gigatron_debug_clear(struct gigatron_debugger *dbg);
+
+/* Checks the breakpoints and watchpoints on the instruction fetched
+ * by the last `gigatron_step()`. Returns TRUE (and sets the reason)
+ * if the emulation must stop.
+ */
+int gigatron_debug_check(struct gigatron_debugger *dbg,
+                         const struct gigatron_state *gs);
+
+/* Executes at most `num_cycles` instructions, stopping at the
+ * breakpoints and watchpoints. When nothing is armed, this is the
+ * plain loop of `gigatron_step()`. Returns the number of
+ * instructions executed (the reason is in `dbg->reason`).
+ */
+uint64_t gigatron_debug_run(struct gigatron_debugger *dbg,
+                            struct gigatron_state *gs,
+                            uint64_t num_cycles);
+
+/* Returns a short description of the reason to stop. */
+const char *gigatron_debug_reason(enum debug_stop_reason reason);
+
+/* Checks the instruction fetched by the last `gigatron_step()`.
+ * The common case (no flags on the ROM address, and no RAM access
+ * or no watchpoints) is handled inline.
+ */
+static inline int gigatron_debug_step(struct gigatron_debugger *dbg,
+                                      const struct gigatron_state *gs)
+{
+    if (dbg->rom_flags[gs->prev_pc] == 0 && !dbg->single_step
+        && (dbg->num_watches == 0 || dbg->access[gs->reg_ir] == 0))
+        return FALSE;
+
+    return gigatron_debug_check(dbg, gs);
+}
+
+#endif /* __DEBUG_H */
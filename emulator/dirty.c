@@ -0,0 +1,49 @@
+/* Bitmaps of the written blocks of the RAM. */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "dirty.h"
+#include "gigatron.h"
+
+int gigatron_dirty_init(struct gigatron_dirty *dt, uint32_t ram_size,
+                        uint32_t shift)
+{
+    memset(dt, 0, sizeof(*dt));
+    if (ram_size == 0 || shift > 16
+        || ((ram_size - 1) >> shift) >= 64 * DIRTY_MAX_WORDS) {
+        fprintf(stderr, "invalid dirty bitmap (%u bytes in blocks of "
+                "2^%u)\n", ram_size, shift);
+        return FALSE;
+    }
+
+    dt->shift = shift;
+    dt->num_blocks = ((ram_size - 1) >> shift) + 1;
+    dt->num_words = (dt->num_blocks + 63) / 64;
+    gigatron_dirty_mark_all(dt);
+    return TRUE;
+}
+
+void gigatron_dirty_mark_all(struct gigatron_dirty *dt)
+{
+    uint32_t i, rest;
+
+    for (i = 0; i < dt->num_words; i++) {
+        rest = dt->num_blocks - 64 * i;
+        dt->bits[i] = (rest >= 64) ? ~((uint64_t) 0)
+            : (((uint64_t) 1) << rest) - 1;
+    }
+}
+
+uint32_t gigatron_dirty_fetch(struct gigatron_dirty *dt, uint64_t *bits)
+{
+    uint32_t i, count;
+
+    count = 0;
+    for (i = 0; i < dt->num_words; i++) {
+        bits[i] = dt->bits[i];
+        dt->bits[i] = 0;
+        count += (uint32_t) __builtin_popcountll(bits[i]);
+    }
+    return count;
+}
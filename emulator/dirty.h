@@ -0,0 +1,70 @@
+#ifndef __DIRTY_H
+#define __DIRTY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "gigatron.h"
+
+/* Constants. */
+
+/* Granularities of the bitmaps (log2 of the size of the blocks):
+ * the 256-byte pages of the Gigatron (addressed by `y`), or the
+ * 64-byte cache lines of the host.
+ */
+#define DIRTY_PAGE_SHIFT 8
+#define DIRTY_LINE_SHIFT 6
+
+/* Maximum number of 64-bit words in a bitmap (a 64 KiB RAM in
+ * cache lines).
+ */
+#define DIRTY_MAX_WORDS 16
+
+/* Data structures and type declarations. */
+
+/* A bitmap of the blocks of the RAM written since the last call to
+ * `gigatron_dirty_fetch()`. It is attached to an instance through
+ * `gs->dirty`, and updated by every engine after each write to the
+ * RAM, which costs the cores a single OR per write. The bitmap is
+ * not synchronized: it belongs to the thread running the engine,
+ * like the RAM it describes.
+ */
+struct gigatron_dirty {
+    uint64_t bits[DIRTY_MAX_WORDS];
+    uint32_t shift;      /* log2 of the size of the blocks. */
+    uint32_t num_blocks; /* Number of blocks in the RAM. */
+    uint32_t num_words;  /* Number of words of `bits` in use. */
+};
+
+/* Exported functions. */
+
+/* Initializes the bitmap `dt` for a RAM of `ram_size` bytes, in
+ * blocks of `1 << shift` bytes (see DIRTY_PAGE_SHIFT and
+ * DIRTY_LINE_SHIFT). All the blocks start dirty, so that the first
+ * fetch covers the whole RAM.
+ * On success, this function returns TRUE.
+ */
+int gigatron_dirty_init(struct gigatron_dirty *dt, uint32_t ram_size,
+                        uint32_t shift);
+
+/* Marks the block containing `addr` as written. */
+static inline void gigatron_dirty_mark(struct gigatron_dirty *dt,
+                                       uint32_t addr)
+{
+    uint32_t block;
+
+    block = addr >> dt->shift;
+    dt->bits[block >> 6] |= ((uint64_t) 1) << (block & 63);
+}
+
+/* Marks the whole RAM as written. */
+void gigatron_dirty_mark_all(struct gigatron_dirty *dt);
+
+/* Copies the bitmap to `bits` (`dt->num_words` words) and clears
+ * it. This must be called from the thread running the engine, or
+ * while it is stopped: a concurrent write could otherwise be lost.
+ * Returns the number of dirty blocks.
+ */
+uint32_t gigatron_dirty_fetch(struct gigatron_dirty *dt, uint64_t *bits);
+
+#endif /* __DIRTY_H */
@@ -0,0 +1,214 @@
+/* Bulk table-driven disassembler.
+ * The operand-independent text of each opcode is precomputed
+ * from `disassemble_gigatron()`, so that the output of both
+ * functions is always the same.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "disasm.h"
+
+/* Length of the prefix "PPPP: OO DD    " of every line. */
+#define PREFIX_LEN 15
+
+/* Maximum number of times the immediate appears in a line. */
+#define MAX_MARKS 2
+
+/* The precomputed text of one opcode. */
+struct opcode_text {
+    char text[32];       /* Text after the prefix. */
+    uint8_t len;         /* Length of the text. */
+    uint8_t num_marks;   /* Number of places of the immediate. */
+    uint8_t marks[MAX_MARKS];
+                         /* Position of each place (two hex digits). */
+};
+
+/* Table with the text of each opcode. */
+static struct opcode_text opcode_table[256];
+static pthread_once_t opcode_table_once = PTHREAD_ONCE_INIT;
+
+/* Hexadecimal digits. */
+static const char hex_digits[] = "0123456789ABCDEF";
+
+/* Builds the opcode table. The positions of the immediate are
+ * found by disassembling each opcode with two different
+ * immediates, and looking at the characters that changed.
+ */
+static void build_opcode_table(void)
+{
+    char line0[DISASM_MAX_LINE], line1[DISASM_MAX_LINE];
+    uint32_t opc;
+
+    for (opc = 0; opc < 256; opc++) {
+        struct opcode_text *ot;
+        int len, i;
+
+        ot = &opcode_table[opc];
+        len = disassemble_gigatron(0, (uint8_t) opc, 0x00,
+                                   line0, sizeof(line0));
+        disassemble_gigatron(0, (uint8_t) opc, 0xFF,
+                             line1, sizeof(line1));
+
+        len -= PREFIX_LEN;
+        memset(ot, 0, sizeof(*ot));
+        memcpy(ot->text, &line0[PREFIX_LEN], len);
+        ot->len = (uint8_t) len;
+
+        for (i = 0; i < len; i++) {
+            if (line0[PREFIX_LEN + i] == line1[PREFIX_LEN + i])
+                continue;
+
+            /* Both hexadecimal digits changed. */
+            ot->marks[ot->num_marks++] = (uint8_t) i;
+            i++;
+        }
+    }
+}
+
+/* Writes the hexadecimal representation of `v` in `p`. */
+static inline void put_hex8(char *p, uint8_t v)
+{
+    p[0] = hex_digits[v >> 4];
+    p[1] = hex_digits[v & 0x0F];
+}
+
+/* Renders one line, assuming the table is built. */
+static inline size_t render_line(uint16_t pc, uint8_t opc, uint8_t imm,
+                                 char *outbuf)
+{
+    const struct opcode_text *ot;
+    char *p;
+    int i;
+
+    ot = &opcode_table[opc];
+
+    put_hex8(outbuf, (uint8_t) (pc >> 8));
+    put_hex8(&outbuf[2], (uint8_t) pc);
+    outbuf[4] = ':';
+    outbuf[5] = ' ';
+    put_hex8(&outbuf[6], opc);
+    outbuf[8] = ' ';
+    put_hex8(&outbuf[9], imm);
+    memcpy(&outbuf[11], "    ", 4);
+
+    p = &outbuf[PREFIX_LEN];
+    memcpy(p, ot->text, sizeof(ot->text));
+    for (i = 0; i < ot->num_marks; i++)
+        put_hex8(&p[ot->marks[i]], imm);
+
+    return PREFIX_LEN + ot->len;
+}
+
+size_t gigatron_disasm_line(uint16_t pc, uint8_t opc, uint8_t imm,
+                            char *outbuf)
+{
+    pthread_once(&opcode_table_once, build_opcode_table);
+    return render_line(pc, opc, imm, outbuf);
+}
+
+size_t gigatron_disasm_rom(const uint16_t *rom, uint16_t addr,
+                           uint32_t count, char *outbuf, size_t size,
+                           uint32_t *num_lines)
+{
+    size_t len;
+    uint32_t i;
+
+    pthread_once(&opcode_table_once, build_opcode_table);
+
+    len = 0;
+    for (i = 0; i < count; i++) {
+        uint16_t word;
+
+        /* The line is rendered in place, so there must be room
+         * for the longest line.
+         */
+        if (len + DISASM_MAX_LINE > size) break;
+
+        word = rom[addr];
+        len += render_line(addr, (uint8_t) (word & 0xFF),
+                           (uint8_t) (word >> 8), &outbuf[len]);
+        outbuf[len++] = '\n';
+        addr++;
+    }
+
+    if (size > 0) outbuf[len] = '\0';
+    if (num_lines) *num_lines = i;
+    return len;
+}
+
+size_t gigatron_disasm_trace(const struct gigatron_trace_record *records,
+                             uint32_t count, char *outbuf, size_t size,
+                             uint32_t *num_lines)
+{
+    size_t len;
+    uint32_t i;
+
+    pthread_once(&opcode_table_once, build_opcode_table);
+
+    len = 0;
+    for (i = 0; i < count; i++) {
+        const struct gigatron_trace_record *r;
+
+        if (len + DISASM_MAX_LINE > size) break;
+
+        r = &records[i];
+        len += render_line(r->pc, r->ir, r->d, &outbuf[len]);
+        outbuf[len++] = '\n';
+    }
+
+    if (size > 0) outbuf[len] = '\0';
+    if (num_lines) *num_lines = i;
+    return len;
+}
+
+/* Deallocates a listing (used by the ROM cache). */
+static void destroy_listing(void *data)
+{
+    struct gigatron_listing *listing;
+
+    listing = (struct gigatron_listing *) data;
+    free(listing->text);
+    free(listing);
+}
+
+const struct gigatron_listing *gigatron_rom_listing(struct gigatron_rom *rom)
+{
+    struct gigatron_listing *listing;
+    size_t size, len;
+    uint32_t addr;
+
+    listing = gigatron_rom_cache_get(rom, ROM_CACHE_LISTING);
+    if (listing) return listing;
+
+    listing = malloc(sizeof(*listing));
+    size = ((size_t) GIGATRON_ROM_WORDS) * DISASM_MAX_LINE;
+    if (listing) listing->text = malloc(size);
+
+    if (!listing || !listing->text) {
+        fprintf(stderr, "memory exhausted\n");
+        if (listing) free(listing);
+        return NULL;
+    }
+
+    pthread_once(&opcode_table_once, build_opcode_table);
+
+    len = 0;
+    for (addr = 0; addr < GIGATRON_ROM_WORDS; addr++) {
+        uint16_t word;
+
+        listing->offset[addr] = (uint32_t) len;
+        word = rom->data[addr];
+        len += render_line((uint16_t) addr, (uint8_t) (word & 0xFF),
+                           (uint8_t) (word >> 8), &listing->text[len]);
+        listing->text[len++] = '\n';
+    }
+    listing->offset[GIGATRON_ROM_WORDS] = (uint32_t) len;
+    listing->text[len] = '\0';
+    listing->size = len;
+
+    return gigatron_rom_cache_set(rom, ROM_CACHE_LISTING,
+                                  listing, destroy_listing);
+}
@@ -0,0 +1,65 @@
+#ifndef __DISASM_H
+#define __DISASM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "gigatron.h"
+#include "rom.h"
+#include "trace.h"
+
+/* Constants. */
+
+/* Maximum length of a disassembled line (including the newline
+ * and the null byte at the end).
+ */
+#define DISASM_MAX_LINE 48
+
+/* Data structures and type declarations. */
+
+/* The disassembly listing of a whole ROM. */
+struct gigatron_listing {
+    char *text;          /* The listing (one line per address). */
+    size_t size;         /* Length of the listing. */
+    uint32_t offset[GIGATRON_ROM_WORDS + 1];
+                         /* Offset of each line in `text`. */
+};
+
+/* Exported functions. */
+
+/* Table-driven version of `disassemble_gigatron()`. The line
+ * is written in `outbuf`, which must have room for at least
+ * DISASM_MAX_LINE bytes, without the newline and without the
+ * null byte at the end. Returns the length of the line.
+ * The output is exactly the same as `disassemble_gigatron()`.
+ */
+size_t gigatron_disasm_line(uint16_t pc, uint8_t opc, uint8_t imm,
+                            char *outbuf);
+
+/* Disassembles `count` consecutive words of the ROM `rom`,
+ * starting at the address `addr` (wrapping around at the end).
+ * Each line is terminated by a newline. At most `size` bytes are
+ * written into `outbuf`, and only whole lines are written. The
+ * output is always null terminated (if `size > 0`). The number
+ * of lines written is returned in `*num_lines` (if not NULL).
+ * Returns the number of characters written (excluding the null
+ * byte at the end).
+ */
+size_t gigatron_disasm_rom(const uint16_t *rom, uint16_t addr,
+                           uint32_t count, char *outbuf, size_t size,
+                           uint32_t *num_lines);
+
+/* Same as `gigatron_disasm_rom()`, but for the `count` records
+ * of a trace in `records`.
+ */
+size_t gigatron_disasm_trace(const struct gigatron_trace_record *records,
+                             uint32_t count, char *outbuf, size_t size,
+                             uint32_t *num_lines);
+
+/* Obtains the disassembly listing of the whole ROM `rom`.
+ * The listing is built on the first call, and it is cached in
+ * the ROM image for all other callers. Returns NULL on failure.
+ */
+const struct gigatron_listing *gigatron_rom_listing(struct gigatron_rom *rom);
+
+#endif /* __DISASM_H */
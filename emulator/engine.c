@@ -0,0 +1,83 @@
+/* Registry of the execution engines. */
+
+#include <string.h>
+
+#include "engine.h"
+#include "gigatron.h"
+#include "idle.h"
+#include "lockstep.h"
+
+/* The reference engine: `gigatron_step()` on one instance at a time. */
+static void run_reference(struct gigatron_state **gs, uint32_t count,
+                          uint64_t num_cycles)
+{
+    uint64_t n;
+    uint32_t i;
+
+    for (i = 0; i < count; i++) {
+        for (n = 0; n < num_cycles; n++)
+            gigatron_step(gs[i]);
+    }
+}
+
+/* The lockstep engine, in groups of `LOCKSTEP_MAX_LANES` instances. */
+static void run_lockstep(struct gigatron_state **gs, uint32_t count,
+                         uint64_t num_cycles)
+{
+    struct gigatron_lockstep ls;
+    uint32_t first, lane, n;
+
+    for (first = 0; first < count; first += n) {
+        n = count - first;
+        if (n > LOCKSTEP_MAX_LANES) n = LOCKSTEP_MAX_LANES;
+
+        gigatron_lockstep_init(&ls, gs[first]->rom, gs[first]->ram_size);
+        for (lane = 0; lane < n; lane++)
+            gigatron_lockstep_load(&ls, lane, gs[first + lane]);
+
+        gigatron_lockstep_run(&ls, num_cycles);
+
+        for (lane = 0; lane < n; lane++)
+            gigatron_lockstep_store(&ls, lane, gs[first + lane]);
+    }
+}
+
+/* The reference engine, skipping the passes over idle loops. */
+static void run_idle(struct gigatron_state **gs, uint32_t count,
+                     uint64_t num_cycles)
+{
+    struct gigatron_idle idle;
+    uint32_t i;
+
+    gigatron_idle_init(&idle, FALSE);
+    for (i = 0; i < count; i++)
+        gigatron_idle_run(&idle, gs[i], num_cycles);
+}
+
+/* The registry. New engines are added at the end. */
+static const struct gigatron_engine engines[] = {
+    { "reference", "gigatron_step(), one instance at a time",
+      &run_reference },
+    { "lockstep", "vectorized lockstep engine (see lockstep.h)",
+      &run_lockstep },
+    { "idle", "gigatron_step(), fast-forwarding idle loops (see idle.h)",
+      &run_idle },
+};
+
+const struct gigatron_engine *gigatron_engine_get(uint32_t index)
+{
+    if (index >= sizeof(engines) / sizeof(engines[0]))
+        return NULL;
+    return &engines[index];
+}
+
+const struct gigatron_engine *gigatron_engine_find(const char *name)
+{
+    uint32_t i;
+
+    for (i = 0; i < sizeof(engines) / sizeof(engines[0]); i++) {
+        if (strcmp(engines[i].name, name) == 0)
+            return &engines[i];
+    }
+    return NULL;
+}
@@ -0,0 +1,40 @@
+#ifndef __ENGINE_H
+#define __ENGINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "gigatron.h"
+
+/* Data structures and type declarations. */
+
+/* An execution engine.
+ * Every engine must give exactly the same results as a loop of
+ * `gigatron_step()` (the "reference" engine): the same registers,
+ * the same RAM, and the same number of cycles. Engines run batches
+ * of instances sharing the same ROM and RAM size, so that engines
+ * working on many instances at once (like the lockstep engine) fit
+ * the same interface.
+ */
+struct gigatron_engine {
+    const char *name;
+    const char *description;
+
+    /* Executes `num_cycles` instructions in each of the `count`
+     * instances `gs[0]`, ..., `gs[count - 1]`.
+     */
+    void (*run)(struct gigatron_state **gs, uint32_t count,
+                uint64_t num_cycles);
+};
+
+/* Exported functions. */
+
+/* Returns the engine `index` of the registry (the reference engine
+ * is the engine 0), or NULL if `index` is past the end.
+ */
+const struct gigatron_engine *gigatron_engine_get(uint32_t index);
+
+/* Returns the engine named `name`, or NULL if there is none. */
+const struct gigatron_engine *gigatron_engine_find(const char *name);
+
+#endif /* __ENGINE_H */
@@ -6,7 +6,10 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "dirty.h"
 #include "gigatron.h"
+#include "rom.h"
+#include "snapshot.h"
 
 /* Auxiliary function for disassemble_gigatron().
  * This prints the memory address referenced by the opcode.
@@ -205,46 +208,56 @@ int gigatron_create(struct gigatron_state *gs,
                     const char *rom_filename,
                     uint32_t ram_size)
 {
-    FILE *fp;
-    size_t size;
+    struct gigatron_rom *rom;
+    int ret;
+
+    gs->rom = NULL;
+    gs->rom_image = NULL;
+    gs->ram = NULL;
+    gs->snapshot = NULL;
+    gs->dirty = NULL;
+
+    if (!gigatron_rom_load(&rom, rom_filename))
+        return FALSE;
 
+    ret = gigatron_create_shared(gs, rom, ram_size);
+    gigatron_rom_release(rom);
+    return ret;
+}
+
+int gigatron_create_shared(struct gigatron_state *gs,
+                           struct gigatron_rom *rom,
+                           uint32_t ram_size)
+{
     gs->rom = NULL;
+    gs->rom_image = NULL;
     gs->ram = NULL;
+    gs->snapshot = NULL;
+    gs->dirty = NULL;
 
     gs->ram_size = ram_size;
-    gs->rom = malloc(65536 * sizeof(uint16_t));
     gs->ram = malloc(ram_size * sizeof(uint8_t));
-
-    if (!gs->rom || !gs->ram) {
+    if (!gs->ram) {
         fprintf(stderr, "memory exhausted\n");
-        goto fail_create;
-    }
-
-    fp = fopen(rom_filename, "r");
-    if (!fp) {
-        fprintf(stderr, "could not open file `%s` for reading\n",
-                rom_filename);
-        goto fail_create;
+        return FALSE;
     }
 
-    size = fread(gs->rom, sizeof(uint16_t), 65536, fp);
-    fclose(fp);
-
-    if (size != 65536)
-        fprintf(stderr, "invalid rom size");
-
+    gs->rom_image = gigatron_rom_acquire(rom);
+    gs->rom = rom->data;
     return TRUE;
-
-fail_create:
-    gigatron_destroy(gs);
-    return FALSE;
 }
 
 void gigatron_destroy(struct gigatron_state *gs)
 {
-    if (gs->rom) free(gs->rom);
+    if (gs->snapshot) {
+        gigatron_fork_discard(gs);
+        return;
+    }
+
+    if (gs->rom_image) gigatron_rom_release(gs->rom_image);
     if (gs->ram) free(gs->ram);
     gs->rom = NULL;
+    gs->rom_image = NULL;
     gs->ram = NULL;
 }
 
@@ -265,8 +278,10 @@ void gigatron_reset(struct gigatron_state *gs, int zero_ram)
     gs->prev_pc = 0;
     gs->prev_out = 0;
 
-    if (zero_ram)
+    if (zero_ram) {
         memset(gs->ram, 0, gs->ram_size);
+        if (gs->dirty) gigatron_dirty_mark_all(gs->dirty);
+    }
 
     gs->num_cycles = 0;
 }
@@ -407,6 +422,7 @@ void gigatron_step(struct gigatron_state *gs)
     if (is_write) {
         if (((size_t) addr) < gs->ram_size) {
             gs->ram[addr] = b;
+            if (gs->dirty) gigatron_dirty_mark(gs->dirty, addr);
         }
     }
 
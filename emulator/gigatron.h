@@ -15,6 +15,11 @@
 
 /* Data structures and type declarations. */
 
+/* Forward declarations (see `rom.h`, `snapshot.h` and `dirty.h`). */
+struct gigatron_rom;
+struct gigatron_snapshot;
+struct gigatron_dirty;
+
 /* The state of the computer. */
 struct gigatron_state {
     uint16_t pc;         /* Program counter. */
@@ -29,9 +34,17 @@ struct gigatron_state {
     uint8_t  reg_in;     /* Input register. */
     uint8_t  in;         /* Input value. */
 
-    uint16_t *rom;       /* Pointer to the beginning of the ROM. */
+    const uint16_t *rom; /* Pointer to the beginning of the ROM. */
+    struct gigatron_rom *rom_image;
+                         /* The ROM image (shared with other instances). */
     uint8_t *ram;        /* Pointer to the beginninf of the RAM. */
     uint32_t ram_size;   /* The size of the RAM (in bytes). */
+    struct gigatron_snapshot *snapshot;
+                         /* The snapshot from which the RAM was forked
+                          * (NULL if the RAM is private). */
+    struct gigatron_dirty *dirty;
+                         /* The blocks of the RAM written (NULL if they
+                          * are not tracked). */
 
     uint16_t prev_pc;    /* Previous program counter. */
     uint8_t  prev_out;   /* Previous output. */
@@ -65,7 +78,20 @@ int gigatron_create(struct gigatron_state *gs,
                     const char *rom_filename,
                     uint32_t ram_size);
 
-/* Deallocates the memory allocated by `gigatron_create()`. */
+/* Creates a new instance of a CPU (populated in `gs`) attached
+ * to the already loaded ROM image `rom` (see `rom.h`). The instance
+ * acquires its own reference to `rom`. The size of the RAM is
+ * dictated by `ram_size`.
+ * On success, this function returns TRUE.
+ */
+int gigatron_create_shared(struct gigatron_state *gs,
+                           struct gigatron_rom *rom,
+                           uint32_t ram_size);
+
+/* Deallocates the memory allocated by `gigatron_create()` or
+ * `gigatron_create_shared()`, and releases the ROM image.
+ * This also works for instances created by `gigatron_fork()`.
+ */
 void gigatron_destroy(struct gigatron_state *gs);
 
 /* Resets the processor.
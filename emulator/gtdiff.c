@@ -0,0 +1,512 @@
+/* Differential validation of the execution engines against the
+ * reference engine (`gigatron_step()`).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "engine.h"
+#include "gigatron.h"
+#include "input.h"
+#include "rom.h"
+#include "stats.h"
+
+/* Default parameters. */
+#define DEFAULT_RAM_SIZE 65536
+#define DEFAULT_INSTANCES 64
+#define DEFAULT_BATCH 32
+#define DEFAULT_CYCLES 10000000
+#define DEFAULT_INTERVAL 100000
+
+/* Maximum number of RAM differences printed. */
+#define MAX_RAM_DIFFS 16
+
+/* Maximum number of threads. */
+#define MAX_JOBS 256
+
+/* Command line options. */
+struct options {
+    const char *rom_filename;
+    const char *engine_name;
+    uint32_t ram_size;
+    uint32_t num_instances;
+    uint32_t batch_size;
+    uint64_t num_cycles;
+    uint64_t interval;
+    uint64_t seed;
+    uint32_t num_jobs;
+};
+
+/* The state shared by the worker threads. */
+struct campaign {
+    const struct options *opts;
+    const struct gigatron_engine *reference;
+    const struct gigatron_engine *engine;
+    struct gigatron_rom *rom;
+
+    pthread_mutex_t lock;
+    uint32_t next_batch; /* Next batch to run. */
+    uint32_t failures;   /* Instances that diverged. */
+    int error;           /* Some batch could not run. */
+    uint64_t cycles;     /* Cycles compared in total. */
+};
+
+/* A batch of instances, run together by one worker. Each instance
+ * exists twice: once for the reference engine, and once for the
+ * engine under test.
+ */
+struct batch {
+    uint32_t first;      /* Index of the first instance. */
+    uint32_t count;      /* Number of instances. */
+
+    struct gigatron_state *ref, *test;
+    struct gigatron_state **ref_ptrs, **test_ptrs;
+    struct gigatron_state *saved;
+    uint8_t *saved_ram;  /* State at the last matching comparison. */
+    uint64_t *inputs;    /* Generators of the input of each instance. */
+    uint64_t saved_cycle;
+};
+
+/* Copies the registers (not the memories) of `src` into `dst`. */
+static void copy_registers(struct gigatron_state *dst,
+                           const struct gigatron_state *src)
+{
+    dst->pc = src->pc;
+    dst->reg_ir = src->reg_ir;
+    dst->reg_d = src->reg_d;
+    dst->reg_acc = src->reg_acc;
+    dst->reg_x = src->reg_x;
+    dst->reg_y = src->reg_y;
+    dst->reg_out = src->reg_out;
+    dst->reg_xout = src->reg_xout;
+    dst->reg_in = src->reg_in;
+    dst->in = src->in;
+    dst->prev_pc = src->prev_pc;
+    dst->prev_out = src->prev_out;
+    dst->num_cycles = src->num_cycles;
+}
+
+/* Returns TRUE if the registers of `a` and `b` are the same. */
+static int same_registers(const struct gigatron_state *a,
+                          const struct gigatron_state *b)
+{
+    return a->pc == b->pc
+        && a->reg_ir == b->reg_ir
+        && a->reg_d == b->reg_d
+        && a->reg_acc == b->reg_acc
+        && a->reg_x == b->reg_x
+        && a->reg_y == b->reg_y
+        && a->reg_out == b->reg_out
+        && a->reg_xout == b->reg_xout
+        && a->reg_in == b->reg_in
+        && a->in == b->in
+        && a->prev_pc == b->prev_pc
+        && a->prev_out == b->prev_out
+        && a->num_cycles == b->num_cycles;
+}
+
+/* Returns TRUE if the whole states of `a` and `b` are the same. */
+static int same_state(const struct gigatron_state *a,
+                      const struct gigatron_state *b)
+{
+    return same_registers(a, b)
+        && memcmp(a->ram, b->ram, a->ram_size) == 0;
+}
+
+/* Prints the differences between the states `ref` and `test`. */
+static void print_diff(const struct gigatron_state *ref,
+                       const struct gigatron_state *test,
+                       const char *name)
+{
+    uint32_t addr, num_diffs;
+
+    printf("  %-10s %12s %12s\n", "", "reference", name);
+#define PRINT_REG(label, field, fmt)                                   \
+    if (ref->field != test->field) {                                   \
+        printf("  %-10s %12" fmt " %12" fmt "\n", label,               \
+               ref->field, test->field);                               \
+    }
+    PRINT_REG("pc", pc, ".4X")
+    PRINT_REG("prev_pc", prev_pc, ".4X")
+    PRINT_REG("ir", reg_ir, ".2X")
+    PRINT_REG("d", reg_d, ".2X")
+    PRINT_REG("acc", reg_acc, ".2X")
+    PRINT_REG("x", reg_x, ".2X")
+    PRINT_REG("y", reg_y, ".2X")
+    PRINT_REG("out", reg_out, ".2X")
+    PRINT_REG("prev_out", prev_out, ".2X")
+    PRINT_REG("xout", reg_xout, ".2X")
+    PRINT_REG("reg_in", reg_in, ".2X")
+    PRINT_REG("in", in, ".2X")
+#undef PRINT_REG
+    if (ref->num_cycles != test->num_cycles) {
+        printf("  %-10s %12llu %12llu\n", "cycles",
+               (unsigned long long) ref->num_cycles,
+               (unsigned long long) test->num_cycles);
+    }
+
+    num_diffs = 0;
+    for (addr = 0; addr < ref->ram_size; addr++) {
+        if (ref->ram[addr] == test->ram[addr]) continue;
+        if (num_diffs++ < MAX_RAM_DIFFS) {
+            printf("  ram[%04X] %12.2X %12.2X\n", addr,
+                   ref->ram[addr], test->ram[addr]);
+        }
+    }
+    if (num_diffs > MAX_RAM_DIFFS)
+        printf("  (%u more RAM differences)\n", num_diffs - MAX_RAM_DIFFS);
+}
+
+/* Saves the (matching) states of the batch `b`. */
+static void save_batch(struct batch *b, uint32_t ram_size)
+{
+    uint32_t i;
+
+    for (i = 0; i < b->count; i++) {
+        copy_registers(&b->saved[i], &b->ref[i]);
+        memcpy(&b->saved_ram[((size_t) i) * ram_size], b->ref[i].ram,
+               ram_size);
+    }
+    b->saved_cycle = b->ref[0].num_cycles;
+}
+
+/* Restores both sides of the batch `b` to the saved states. */
+static void restore_batch(struct batch *b, uint32_t ram_size)
+{
+    const uint8_t *ram;
+    uint32_t i;
+
+    for (i = 0; i < b->count; i++) {
+        ram = &b->saved_ram[((size_t) i) * ram_size];
+        copy_registers(&b->ref[i], &b->saved[i]);
+        memcpy(b->ref[i].ram, ram, ram_size);
+        copy_registers(&b->test[i], &b->saved[i]);
+        memcpy(b->test[i].ram, ram, ram_size);
+    }
+}
+
+/* Replays the batch `b` one cycle at a time from the last matching
+ * comparison, until the instance `index` diverges, and prints a
+ * minimal reproduction. The whole batch is replayed, because an
+ * engine may depend on the other instances of its batch.
+ */
+static void locate_divergence(struct campaign *c, struct batch *b,
+                              uint32_t index)
+{
+    const struct options *opts;
+    struct gigatron_state *ref, *test;
+    char line[64];
+    uint64_t cycle, end;
+
+    opts = c->opts;
+    restore_batch(b, opts->ram_size);
+    ref = &b->ref[index];
+    test = &b->test[index];
+
+    end = b->saved_cycle + opts->interval;
+    for (cycle = b->saved_cycle; cycle < end; cycle++) {
+        gigatron_disasm(ref, line, sizeof(line));
+        c->reference->run(&b->ref_ptrs[index], 1, 1);
+        c->engine->run(b->test_ptrs, b->count, 1);
+        if (!same_state(ref, test)) break;
+    }
+
+    pthread_mutex_lock(&c->lock);
+    printf("instance %u (seed %llu): engine `%s` diverges ",
+           b->first + index,
+           (unsigned long long) (opts->seed + b->first + index),
+           c->engine->name);
+    if (cycle == end) {
+        /* The engine depends on more than the state of the batch. */
+        printf("between cycles %llu and %llu, but not when replayed\n",
+               (unsigned long long) b->saved_cycle,
+               (unsigned long long) end);
+    } else {
+        printf("at cycle %llu\n", (unsigned long long) cycle);
+        printf("  executing %s (input $%02X)\n", line, ref->in);
+        print_diff(ref, test, c->engine->name);
+    }
+    printf("  reproduce with: gtdiff --engine %s --ram %u --seed %llu "
+           "--instances %u --batch %u --cycles %llu --interval %llu %s\n",
+           c->engine->name, opts->ram_size,
+           (unsigned long long) (opts->seed + b->first), b->count,
+           b->count, (unsigned long long) end,
+           (unsigned long long) opts->interval, opts->rom_filename);
+    fflush(stdout);
+    pthread_mutex_unlock(&c->lock);
+}
+
+/* Frees the memory of the batch `b`. */
+static void free_batch(struct batch *b)
+{
+    uint32_t i;
+
+    for (i = 0; i < b->count; i++) {
+        if (b->ref) gigatron_destroy(&b->ref[i]);
+        if (b->test) gigatron_destroy(&b->test[i]);
+    }
+    free(b->ref);
+    free(b->test);
+    free(b->ref_ptrs);
+    free(b->test_ptrs);
+    free(b->saved);
+    free(b->saved_ram);
+    free(b->inputs);
+}
+
+/* Creates the instances of the batch `b`. */
+static int create_batch(struct campaign *c, struct batch *b)
+{
+    const struct options *opts;
+    uint32_t i;
+
+    opts = c->opts;
+    b->ref = calloc(b->count, sizeof(struct gigatron_state));
+    b->test = calloc(b->count, sizeof(struct gigatron_state));
+    b->ref_ptrs = calloc(b->count, sizeof(struct gigatron_state *));
+    b->test_ptrs = calloc(b->count, sizeof(struct gigatron_state *));
+    b->saved = calloc(b->count, sizeof(struct gigatron_state));
+    b->saved_ram = malloc(((size_t) b->count) * opts->ram_size);
+    b->inputs = calloc(b->count, sizeof(uint64_t));
+    if (!b->ref || !b->test || !b->ref_ptrs || !b->test_ptrs
+        || !b->saved || !b->saved_ram || !b->inputs) {
+        fprintf(stderr, "memory exhausted\n");
+        return FALSE;
+    }
+
+    for (i = 0; i < b->count; i++) {
+        if (!gigatron_create_shared(&b->ref[i], c->rom, opts->ram_size)
+            || !gigatron_create_shared(&b->test[i], c->rom,
+                                       opts->ram_size))
+            return FALSE;
+
+        gigatron_reset(&b->ref[i], TRUE);
+        gigatron_reset(&b->test[i], TRUE);
+        b->ref[i].in = b->test[i].in = INPUT_IDLE;
+        b->ref_ptrs[i] = &b->ref[i];
+        b->test_ptrs[i] = &b->test[i];
+        b->inputs[i] = gigatron_input_init(opts->seed + b->first + i);
+    }
+    return TRUE;
+}
+
+/* Runs the batch `b` on both engines, comparing the states every
+ * `interval` cycles. The input of each instance changes at each
+ * comparison. Returns the number of instances that diverged.
+ */
+static uint32_t run_batch(struct campaign *c, struct batch *b)
+{
+    const struct options *opts;
+    uint64_t cycle, n;
+    uint32_t i, failures;
+    uint8_t in;
+
+    opts = c->opts;
+    failures = 0;
+    for (cycle = 0; cycle < opts->num_cycles; cycle += n) {
+        n = opts->num_cycles - cycle;
+        if (n > opts->interval) n = opts->interval;
+
+        for (i = 0; i < b->count; i++) {
+            in = gigatron_input_next(&b->inputs[i], b->ref[i].in);
+            b->ref[i].in = b->test[i].in = in;
+        }
+        save_batch(b, opts->ram_size);
+
+        c->reference->run(b->ref_ptrs, b->count, n);
+        c->engine->run(b->test_ptrs, b->count, n);
+
+        for (i = 0; i < b->count; i++) {
+            if (same_state(&b->ref[i], &b->test[i])) continue;
+            failures++;
+            locate_divergence(c, b, i);
+            /* The states of the batch are no longer meaningful. */
+            break;
+        }
+        if (failures) break;
+    }
+
+    pthread_mutex_lock(&c->lock);
+    c->cycles += ((uint64_t) b->count) * cycle;
+    pthread_mutex_unlock(&c->lock);
+    return failures;
+}
+
+/* The worker threads: they run batches until there are none left. */
+static void *worker_thread(void *arg)
+{
+    struct campaign *c;
+    struct batch b;
+    uint32_t index, failures;
+
+    c = (struct campaign *) arg;
+    for (;;) {
+        pthread_mutex_lock(&c->lock);
+        index = c->next_batch++;
+        pthread_mutex_unlock(&c->lock);
+
+        memset(&b, 0, sizeof(b));
+        b.first = index * c->opts->batch_size;
+        if (b.first >= c->opts->num_instances) break;
+        b.count = c->opts->num_instances - b.first;
+        if (b.count > c->opts->batch_size)
+            b.count = c->opts->batch_size;
+
+        if (!create_batch(c, &b)) {
+            free_batch(&b);
+            pthread_mutex_lock(&c->lock);
+            c->error = TRUE;
+            pthread_mutex_unlock(&c->lock);
+            break;
+        }
+
+        failures = run_batch(c, &b);
+        free_batch(&b);
+
+        pthread_mutex_lock(&c->lock);
+        c->failures += failures;
+        pthread_mutex_unlock(&c->lock);
+    }
+    return NULL;
+}
+
+static void print_help(const char *prog_name)
+{
+    const struct gigatron_engine *engine;
+    uint32_t i;
+
+    printf("usage:\n");
+    printf("%s [-h | --help] [options] <rom_filename>\n", prog_name);
+    printf("\n");
+    printf("Runs the reference engine and an engine under test on the\n"
+           "same ROM and input, and compares their states (registers\n"
+           "and RAM) every `interval` cycles.\n");
+    printf("\n");
+    printf("options:\n");
+    printf("  --engine <name>       engine under test (default: lockstep)\n");
+    printf("  --instances <n>       number of instances (default: %u)\n",
+           DEFAULT_INSTANCES);
+    printf("  --batch <n>           instances run together (default: %u)\n",
+           DEFAULT_BATCH);
+    printf("  --cycles <n>          cycles per instance (default: %u)\n",
+           DEFAULT_CYCLES);
+    printf("  --interval <n>        cycles between comparisons, and between\n"
+           "                        changes of the input (default: %u)\n",
+           DEFAULT_INTERVAL);
+    printf("  --seed <n>            seed of the instance 0 (default: 1)\n");
+    printf("  --ram <n>             size of the RAM (default: %u)\n",
+           DEFAULT_RAM_SIZE);
+    printf("  --jobs <n>            number of threads (default: all cores)\n");
+    printf("\n");
+    printf("engines:\n");
+    for (i = 0; (engine = gigatron_engine_get(i)) != NULL; i++)
+        printf("  %-21s %s\n", engine->name, engine->description);
+}
+
+int main(int argc, char **argv)
+{
+    struct options opts;
+    struct campaign c;
+    pthread_t threads[MAX_JOBS];
+    uint64_t start, elapsed;
+    uint32_t j, num_threads;
+    long ncpus;
+    int i, ret;
+
+    ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    opts.rom_filename = NULL;
+    opts.engine_name = "lockstep";
+    opts.ram_size = DEFAULT_RAM_SIZE;
+    opts.num_instances = DEFAULT_INSTANCES;
+    opts.batch_size = DEFAULT_BATCH;
+    opts.num_cycles = DEFAULT_CYCLES;
+    opts.interval = DEFAULT_INTERVAL;
+    opts.seed = 1;
+    opts.num_jobs = (ncpus > 0) ? (uint32_t) ncpus : 1;
+
+    for (i = 1; i < argc; i++) {
+        if ((strcmp("--help", argv[i]) == 0)
+            || (strcmp("-h", argv[i]) == 0)) {
+            print_help(argv[0]);
+            return 0;
+        } else if (strcmp("--engine", argv[i]) == 0 && i + 1 < argc) {
+            opts.engine_name = argv[++i];
+        } else if (strcmp("--instances", argv[i]) == 0
+                   && i + 1 < argc) {
+            opts.num_instances = (uint32_t) strtoul(argv[++i], NULL, 0);
+        } else if (strcmp("--batch", argv[i]) == 0 && i + 1 < argc) {
+            opts.batch_size = (uint32_t) strtoul(argv[++i], NULL, 0);
+        } else if (strcmp("--cycles", argv[i]) == 0 && i + 1 < argc) {
+            opts.num_cycles = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp("--interval", argv[i]) == 0
+                   && i + 1 < argc) {
+            opts.interval = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp("--seed", argv[i]) == 0 && i + 1 < argc) {
+            opts.seed = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp("--ram", argv[i]) == 0 && i + 1 < argc) {
+            opts.ram_size = (uint32_t) strtoul(argv[++i], NULL, 0);
+        } else if (strcmp("--jobs", argv[i]) == 0 && i + 1 < argc) {
+            opts.num_jobs = (uint32_t) strtoul(argv[++i], NULL, 0);
+        } else {
+            opts.rom_filename = argv[i];
+        }
+    }
+
+    if (!opts.rom_filename) {
+        print_help(argv[0]);
+        return 1;
+    }
+
+    if (opts.num_instances == 0 || opts.batch_size == 0
+        || opts.interval == 0 || opts.ram_size == 0) {
+        fprintf(stderr, "invalid parameters\n");
+        return 1;
+    }
+    if (opts.num_jobs == 0) opts.num_jobs = 1;
+    if (opts.num_jobs > MAX_JOBS) opts.num_jobs = MAX_JOBS;
+
+    memset(&c, 0, sizeof(c));
+    c.opts = &opts;
+    c.reference = gigatron_engine_get(0);
+    c.engine = gigatron_engine_find(opts.engine_name);
+    if (!c.engine) {
+        fprintf(stderr, "unknown engine `%s`\n", opts.engine_name);
+        return 1;
+    }
+
+    if (!gigatron_rom_load(&c.rom, opts.rom_filename))
+        return 1;
+
+    pthread_mutex_init(&c.lock, NULL);
+    start = gigatron_stats_now();
+
+    num_threads = 0;
+    for (j = 0; j < opts.num_jobs; j++) {
+        if (pthread_create(&threads[j], NULL, &worker_thread, &c) != 0)
+            break;
+        num_threads++;
+    }
+    if (num_threads == 0) {
+        fprintf(stderr, "could not start the worker threads\n");
+        c.error = TRUE;
+    }
+    for (j = 0; j < num_threads; j++)
+        pthread_join(threads[j], NULL);
+
+    elapsed = gigatron_stats_now() - start;
+    pthread_mutex_destroy(&c.lock);
+    gigatron_rom_release(c.rom);
+
+    printf("engine `%s`: %u instances, %llu cycles compared in %.3f s "
+           "(%.1f Mcycles/s per engine), %u diverged\n",
+           c.engine->name, opts.num_instances,
+           (unsigned long long) c.cycles, elapsed * 1e-9,
+           (elapsed > 0) ? (c.cycles * 1e3) / elapsed : 0.0,
+           c.failures);
+
+    ret = (c.error || c.failures > 0) ? 1 : 0;
+    return ret;
+}
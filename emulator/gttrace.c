@@ -0,0 +1,200 @@
+/* Decoder for the binary traces written by the trace recorder. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "byteorder.h"
+#include "disasm.h"
+#include "gigatron.h"
+#include "trace.h"
+
+/* Size of the output buffer. */
+#define OUTBUF_SIZE (1 << 20)
+
+/* Length of the longest formatted record (see `format_record()`). */
+#define MAX_RECORD_LINE 128
+
+/* Hexadecimal digits. */
+static const char hex_digits[] = "0123456789ABCDEF";
+
+/* Formats the record `r` at cycle `cycle` into `outbuf` (as
+ * "%12llu  %-32s acc=$%02X x=$%02X y=$%02X out=$%02X\n", but
+ * without going through printf()). Returns the length of the line.
+ */
+static size_t format_record(const struct gigatron_trace_record *r,
+                            uint64_t cycle, char *outbuf)
+{
+    static const char regs[] = " acc=$.. x=$.. y=$.. out=$..\n";
+    char digits[24];
+    size_t len, n;
+    int i;
+
+    /* The cycle, right aligned in 12 columns. */
+    n = 0;
+    do {
+        digits[n++] = (char) ('0' + (cycle % 10));
+        cycle /= 10;
+    } while (cycle != 0);
+
+    len = 0;
+    while (len + n < 12) outbuf[len++] = ' ';
+    while (n > 0) outbuf[len++] = digits[--n];
+    outbuf[len++] = ' ';
+    outbuf[len++] = ' ';
+
+    /* The disassembly, left aligned in 32 columns. */
+    n = gigatron_disasm_line(r->pc, r->ir, r->d, &outbuf[len]);
+    len += n;
+    while (n++ < 32) outbuf[len++] = ' ';
+
+    memcpy(&outbuf[len], regs, sizeof(regs) - 1);
+    i = (int) len;
+    outbuf[i + 6] = hex_digits[r->acc >> 4];
+    outbuf[i + 7] = hex_digits[r->acc & 0x0F];
+    outbuf[i + 12] = hex_digits[r->x >> 4];
+    outbuf[i + 13] = hex_digits[r->x & 0x0F];
+    outbuf[i + 18] = hex_digits[r->y >> 4];
+    outbuf[i + 19] = hex_digits[r->y & 0x0F];
+    outbuf[i + 26] = hex_digits[r->out >> 4];
+    outbuf[i + 27] = hex_digits[r->out & 0x0F];
+    return len + sizeof(regs) - 1;
+}
+
+/* Prints the records of the trace file `filename`, skipping
+ * the first `skip` records, and printing at most `count` records.
+ */
+static int decode_trace(const char *filename, uint64_t skip,
+                        uint64_t count)
+{
+    struct gigatron_trace_record *records;
+    uint64_t *cycles;
+    uint8_t header[16];
+    uint8_t *inbuf;
+    char *outbuf;
+    size_t outlen;
+    uint64_t pos;
+    FILE *fp;
+    int ret;
+
+    fp = fopen(filename, "rb");
+    if (!fp) {
+        fprintf(stderr, "could not open file `%s` for reading\n",
+                filename);
+        return FALSE;
+    }
+
+    records = malloc(TRACE_BLOCK_SIZE * sizeof(*records));
+    cycles = malloc(TRACE_BLOCK_SIZE * sizeof(uint64_t));
+    inbuf = malloc(TRACE_BLOCK_SIZE * TRACE_MAX_RECORD_SIZE);
+    outbuf = malloc(OUTBUF_SIZE);
+    outlen = 0;
+    ret = FALSE;
+
+    if (!records || !cycles || !inbuf || !outbuf) {
+        fprintf(stderr, "memory exhausted\n");
+        goto exit_decode;
+    }
+
+    if (fread(header, sizeof(header), 1, fp) != 1
+        || gigatron_get_le(header, 4) != TRACE_MAGIC
+        || gigatron_get_le(&header[4], 4) != TRACE_VERSION) {
+        fprintf(stderr, "invalid trace file `%s`\n", filename);
+        goto exit_decode;
+    }
+
+    pos = 0;
+    while (count > 0 && fread(header, sizeof(header), 1, fp) == 1) {
+        uint64_t first_cycle;
+        uint32_t n, size, i;
+        int64_t num;
+
+        n = (uint32_t) gigatron_get_le(header, 4);
+        size = (uint32_t) gigatron_get_le(&header[4], 4);
+        first_cycle = gigatron_get_le(&header[8], 8);
+
+        if (n > TRACE_BLOCK_SIZE
+            || size > TRACE_BLOCK_SIZE * TRACE_MAX_RECORD_SIZE
+            || fread(inbuf, 1, size, fp) != size) {
+            fprintf(stderr, "truncated trace file `%s`\n", filename);
+            goto exit_decode;
+        }
+
+        if (pos + n <= skip) {
+            pos += n;
+            continue;
+        }
+
+        num = gigatron_trace_decode(inbuf, size, first_cycle, n,
+                                    records, cycles);
+        if (num != (int64_t) n) {
+            fprintf(stderr, "corrupted trace file `%s`\n", filename);
+            goto exit_decode;
+        }
+
+        for (i = 0; i < n && count > 0; i++, pos++) {
+            if (pos < skip) continue;
+
+            if (outlen + MAX_RECORD_LINE > OUTBUF_SIZE) {
+                fwrite(outbuf, 1, outlen, stdout);
+                outlen = 0;
+            }
+
+            outlen += format_record(&records[i], cycles[i],
+                                    &outbuf[outlen]);
+            count--;
+        }
+    }
+
+    ret = TRUE;
+
+exit_decode:
+    if (outbuf) {
+        fwrite(outbuf, 1, outlen, stdout);
+        free(outbuf);
+    }
+    if (records) free(records);
+    if (cycles) free(cycles);
+    if (inbuf) free(inbuf);
+    fclose(fp);
+    return ret;
+}
+
+static void print_help(const char *prog_name)
+{
+    printf("usage:\n");
+    printf("%s [-h | --help] [-s skip] [-n count] <trace_filename>\n",
+           prog_name);
+}
+
+int main(int argc, char **argv)
+{
+    const char *filename = NULL;
+    uint64_t skip = 0;
+    uint64_t count = (uint64_t) -1;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if ((strcmp("--help", argv[i]) == 0)
+            || (strcmp("-h", argv[i]) == 0)) {
+            print_help(argv[0]);
+            return 0;
+        } else if (strcmp("-s", argv[i]) == 0 && i + 1 < argc) {
+            skip = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp("-n", argv[i]) == 0 && i + 1 < argc) {
+            count = strtoull(argv[++i], NULL, 0);
+        } else {
+            filename = argv[i];
+        }
+    }
+
+    if (!filename) {
+        print_help(argv[0]);
+        return 1;
+    }
+
+    if (!decode_trace(filename, skip, count))
+        return 1;
+
+    return 0;
+}
@@ -0,0 +1,259 @@
+/* Per-frame hash streams. */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "byteorder.h"
+#include "hash.h"
+
+/* The primes of XXH64. */
+#define PRIME1 0x9E3779B185EBCA87ULL
+#define PRIME2 0xC2B2AE3D27D4EB4FULL
+#define PRIME3 0x165667B19E3779F9ULL
+#define PRIME4 0x85EBCA77C2B2AE63ULL
+#define PRIME5 0x27D4EB2F165667C5ULL
+
+/* Size of the header of the streams. */
+#define HASH_HEADER_SIZE 16
+
+static inline uint64_t rotl64(uint64_t v, int r)
+{
+    return (v << r) | (v >> (64 - r));
+}
+
+static inline uint64_t read64(const uint8_t *p)
+{
+    uint64_t v;
+
+    memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+static inline uint32_t read32(const uint8_t *p)
+{
+    uint32_t v;
+
+    memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap32(v);
+#endif
+    return v;
+}
+
+static inline uint64_t round64(uint64_t acc, uint64_t input)
+{
+    acc += input * PRIME2;
+    acc = rotl64(acc, 31);
+    return acc * PRIME1;
+}
+
+static inline uint64_t merge64(uint64_t acc, uint64_t v)
+{
+    acc ^= round64(0, v);
+    return acc * PRIME1 + PRIME4;
+}
+
+uint64_t gigatron_hash64(const void *data, size_t len, uint64_t seed)
+{
+    const uint8_t *p, *end;
+    uint64_t h;
+
+    p = (const uint8_t *) data;
+    end = p + len;
+
+    if (len >= 32) {
+        uint64_t v1, v2, v3, v4;
+        const uint8_t *limit;
+
+        v1 = seed + PRIME1 + PRIME2;
+        v2 = seed + PRIME2;
+        v3 = seed;
+        v4 = seed - PRIME1;
+
+        limit = end - 32;
+        do {
+            v1 = round64(v1, read64(p));
+            v2 = round64(v2, read64(p + 8));
+            v3 = round64(v3, read64(p + 16));
+            v4 = round64(v4, read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+
+        h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12)
+            + rotl64(v4, 18);
+        h = merge64(h, v1);
+        h = merge64(h, v2);
+        h = merge64(h, v3);
+        h = merge64(h, v4);
+    } else {
+        h = seed + PRIME5;
+    }
+
+    h += (uint64_t) len;
+
+    while (p + 8 <= end) {
+        h ^= round64(0, read64(p));
+        h = rotl64(h, 27) * PRIME1 + PRIME4;
+        p += 8;
+    }
+
+    if (p + 4 <= end) {
+        h ^= (uint64_t) read32(p) * PRIME1;
+        h = rotl64(h, 23) * PRIME2 + PRIME3;
+        p += 4;
+    }
+
+    while (p < end) {
+        h ^= (*p++) * PRIME5;
+        h = rotl64(h, 11) * PRIME1;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME2;
+    h ^= h >> 29;
+    h *= PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+
+int gigatron_hash_open(struct gigatron_hash_stream *hs,
+                       const char *out_filename,
+                       const char *golden_filename, uint32_t flags)
+{
+    uint8_t header[HASH_HEADER_SIZE];
+
+    hs->out = NULL;
+    hs->golden = NULL;
+    hs->flags = flags & (HASH_FRAME | HASH_RAM);
+    hs->frame = 0;
+    hs->golden_done = FALSE;
+
+    if (hs->flags == 0) {
+        fprintf(stderr, "nothing to hash\n");
+        return FALSE;
+    }
+
+    if (golden_filename) {
+        hs->golden = fopen(golden_filename, "rb");
+        if (!hs->golden) {
+            fprintf(stderr, "could not open file `%s`\n",
+                    golden_filename);
+            return FALSE;
+        }
+
+        if (fread(header, sizeof(header), 1, hs->golden) != 1
+            || gigatron_get_le(header, 4) != HASH_MAGIC
+            || gigatron_get_le(&header[4], 4) != HASH_VERSION) {
+            fprintf(stderr, "invalid hash stream `%s`\n",
+                    golden_filename);
+            goto fail_open;
+        }
+
+        if (gigatron_get_le(&header[8], 4) != hs->flags) {
+            fprintf(stderr, "the hash stream `%s` does not hash the "
+                    "same contents\n", golden_filename);
+            goto fail_open;
+        }
+    }
+
+    if (out_filename) {
+        hs->out = fopen(out_filename, "wb");
+        if (!hs->out) {
+            fprintf(stderr, "could not open file `%s` for writing\n",
+                    out_filename);
+            goto fail_open;
+        }
+
+        memset(header, 0, sizeof(header));
+        gigatron_put_le(header, HASH_MAGIC, 4);
+        gigatron_put_le(&header[4], HASH_VERSION, 4);
+        gigatron_put_le(&header[8], hs->flags, 4);
+        if (fwrite(header, sizeof(header), 1, hs->out) != 1) {
+            fprintf(stderr, "could not write file `%s`\n", out_filename);
+            goto fail_open;
+        }
+    }
+    return TRUE;
+
+fail_open:
+    gigatron_hash_close(hs);
+    return FALSE;
+}
+
+int gigatron_hash_close(struct gigatron_hash_stream *hs)
+{
+    int ret;
+
+    ret = TRUE;
+    if (hs->out) {
+        ret = (fclose(hs->out) == 0);
+        hs->out = NULL;
+    }
+
+    if (hs->golden) {
+        fclose(hs->golden);
+        hs->golden = NULL;
+    }
+    return ret;
+}
+
+int gigatron_hash_frame(struct gigatron_hash_stream *hs,
+                        const uint32_t *pixels, size_t num_pixels,
+                        const struct gigatron_state *gs)
+{
+    const char *names[2];
+    uint64_t hashes[2];
+    uint8_t record[16], expected[16];
+    size_t size;
+    int i, n;
+
+    n = 0;
+    if (hs->flags & HASH_FRAME) {
+        names[n] = "frame buffer";
+        hashes[n++] = gigatron_hash64(pixels,
+                                      num_pixels * sizeof(uint32_t), 0);
+    }
+    if (hs->flags & HASH_RAM) {
+        names[n] = "RAM";
+        hashes[n++] = gigatron_hash64(gs->ram, gs->ram_size, 0);
+    }
+
+    for (i = 0; i < n; i++)
+        gigatron_put_le(&record[8 * i], hashes[i], 8);
+    size = 8 * n;
+
+    hs->frame++;
+    if (hs->out) {
+        if (fwrite(record, 1, size, hs->out) != size) {
+            fprintf(stderr, "could not write the hash stream\n");
+            return FALSE;
+        }
+    }
+
+    if (!hs->golden || hs->golden_done)
+        return TRUE;
+
+    if (fread(expected, 1, size, hs->golden) != size) {
+        hs->golden_done = TRUE;
+        return TRUE;
+    }
+
+    if (memcmp(record, expected, size) == 0)
+        return TRUE;
+
+    for (i = 0; i < n; i++) {
+        uint64_t e;
+
+        e = gigatron_get_le(&expected[8 * i], 8);
+        if (e == hashes[i]) continue;
+
+        fprintf(stderr, "frame %u: %s hash mismatch "
+                "(%016llX, expected %016llX)\n", hs->frame,
+                names[i],
+                (unsigned long long) hashes[i], (unsigned long long) e);
+    }
+    return FALSE;
+}
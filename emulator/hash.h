@@ -0,0 +1,70 @@
+#ifndef __HASH_H
+#define __HASH_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "gigatron.h"
+
+/* Constants. */
+
+/* Magic number and version of the hash streams. */
+#define HASH_MAGIC   0x48465447 /* "GTFH" */
+#define HASH_VERSION 1
+
+/* Contents of the records of a hash stream. */
+#define HASH_FRAME 0x01      /* The hash of the frame buffer. */
+#define HASH_RAM   0x02      /* The hash of the RAM. */
+
+/* Data structures and type declarations. */
+
+/* A stream of per-frame hashes.
+ * The stream starts with a header of 16 bytes (magic, version, flags
+ * and 4 reserved bytes), followed by one record per frame with the
+ * 64-bit hashes selected by the flags (frame buffer first), all in
+ * little endian. The hashes can be written to a file, compared with
+ * a golden stream, or both. Nothing is allocated per frame.
+ */
+struct gigatron_hash_stream {
+    FILE *out;           /* The output stream (or NULL). */
+    FILE *golden;        /* The golden stream (or NULL). */
+    uint32_t flags;      /* What is hashed (HASH_FRAME, HASH_RAM). */
+    uint32_t frame;      /* Number of frames hashed. */
+    int golden_done;     /* The golden stream has no more frames. */
+};
+
+/* Exported functions. */
+
+/* Computes the XXH64 hash of the `len` bytes at `data`, with the
+ * seed `seed`.
+ */
+uint64_t gigatron_hash64(const void *data, size_t len, uint64_t seed);
+
+/* Opens the hash stream `hs`, writing the hashes selected by
+ * `flags` to `out_filename`, and comparing them with the golden
+ * stream `golden_filename`. Either of the names can be NULL. The
+ * flags of the golden stream must match `flags`.
+ * On success, this function returns TRUE.
+ */
+int gigatron_hash_open(struct gigatron_hash_stream *hs,
+                       const char *out_filename,
+                       const char *golden_filename, uint32_t flags);
+
+/* Closes the hash stream.
+ * Returns FALSE if the output could not be written.
+ */
+int gigatron_hash_close(struct gigatron_hash_stream *hs);
+
+/* Hashes a frame: the frame buffer `pixels` (of `num_pixels`
+ * ARGB8888 pixels) and the RAM of `gs`. The hashes are written, and
+ * compared with the golden stream. Returns FALSE at the first
+ * mismatch (which is reported on stderr), or if the output could
+ * not be written. When the golden stream ends, `hs->golden_done` is
+ * set and the comparison stops.
+ */
+int gigatron_hash_frame(struct gigatron_hash_stream *hs,
+                        const uint32_t *pixels, size_t num_pixels,
+                        const struct gigatron_state *gs);
+
+#endif /* __HASH_H */
@@ -0,0 +1,133 @@
+/* Detection and fast-forward of idle loops. */
+
+#include <string.h>
+
+#include "gigatron.h"
+#include "idle.h"
+
+/* Copies the registers of `gs` to `regs`. */
+static void save_regs(struct idle_regs *regs,
+                      const struct gigatron_state *gs)
+{
+    regs->pc = gs->pc;
+    regs->prev_pc = gs->prev_pc;
+    regs->ir = gs->reg_ir;
+    regs->d = gs->reg_d;
+    regs->acc = gs->reg_acc;
+    regs->x = gs->reg_x;
+    regs->y = gs->reg_y;
+    regs->out = gs->reg_out;
+    regs->xout = gs->reg_xout;
+    regs->reg_in = gs->reg_in;
+    regs->prev_out = gs->prev_out;
+}
+
+/* Returns TRUE if the registers of `gs` are the ones in `regs`. */
+static int same_regs(const struct idle_regs *regs,
+                     const struct gigatron_state *gs)
+{
+    return regs->pc == gs->pc && regs->prev_pc == gs->prev_pc
+        && regs->ir == gs->reg_ir && regs->d == gs->reg_d
+        && regs->acc == gs->reg_acc && regs->x == gs->reg_x
+        && regs->y == gs->reg_y && regs->out == gs->reg_out
+        && regs->xout == gs->reg_xout && regs->reg_in == gs->reg_in
+        && regs->prev_out == gs->prev_out;
+}
+
+/* Returns the RAM address written by the instruction about to be
+ * executed in `gs`, or -1 if it does not write to the RAM (the
+ * addressing modes are the ones of `gigatron_step()`).
+ */
+static int32_t store_address(const struct gigatron_state *gs)
+{
+    uint32_t low, high;
+
+    if ((gs->reg_ir >> 5) != 6)
+        return -1;
+
+    low = gs->reg_d;
+    high = 0;
+    switch ((gs->reg_ir >> 2) & 0x07) {
+    case 1:
+        low = gs->reg_x;
+        break;
+    case 2:
+        high = gs->reg_y;
+        break;
+    case 3:
+    case 7:
+        low = gs->reg_x;
+        high = gs->reg_y;
+        break;
+    }
+
+    if (((high << 8) | low) >= gs->ram_size)
+        return -1;
+    return (int32_t) ((high << 8) | low);
+}
+
+void gigatron_idle_init(struct gigatron_idle *idle, int watch_output)
+{
+    memset(idle, 0, sizeof(*idle));
+    idle->watch_output = watch_output;
+}
+
+uint64_t gigatron_idle_step(struct gigatron_idle *idle,
+                            struct gigatron_state *gs, uint64_t stop)
+{
+    uint64_t period, n;
+    int32_t addr;
+    uint8_t old;
+
+    addr = store_address(gs);
+    old = (addr >= 0) ? gs->ram[addr] : 0;
+
+    gigatron_step(gs);
+
+    if (addr >= 0 && gs->ram[addr] != old)
+        idle->clean = FALSE;
+    if (gs->reg_out != gs->prev_out)
+        idle->still = FALSE;
+
+    /* Only the backward branches end the passes (a wrap of the
+     * program counter looks like one, which does no harm).
+     */
+    if (gs->pc > gs->prev_pc)
+        return 0;
+
+    n = 0;
+    if (idle->armed && idle->clean
+        && (idle->still || !idle->watch_output) && gs->pc == idle->head
+        && same_regs(&idle->regs, gs)) {
+        /* The state is back to the one at `start`: the passes
+         * left are all the same, and leave it unchanged.
+         */
+        period = gs->num_cycles - idle->start;
+        n = (stop > gs->num_cycles) ? (stop - gs->num_cycles) / period : 0;
+        if (n > 0) {
+            n *= period;
+            gs->num_cycles += n;
+            idle->skips++;
+            idle->skipped += n;
+        }
+    }
+
+    idle->head = gs->pc;
+    idle->armed = TRUE;
+    idle->clean = TRUE;
+    idle->still = TRUE;
+    idle->start = gs->num_cycles;
+    save_regs(&idle->regs, gs);
+    return n;
+}
+
+void gigatron_idle_run(struct gigatron_idle *idle,
+                       struct gigatron_state *gs, uint64_t num_cycles)
+{
+    uint64_t stop;
+
+    stop = gs->num_cycles + num_cycles;
+    idle->armed = FALSE;
+    while (gs->num_cycles < stop)
+        gigatron_idle_step(idle, gs, stop);
+}
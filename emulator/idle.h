@@ -0,0 +1,72 @@
+#ifndef __IDLE_H
+#define __IDLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "gigatron.h"
+
+/* Data structures and type declarations. */
+
+/* The registers compared between two passes over a loop. */
+struct idle_regs {
+    uint16_t pc;
+    uint16_t prev_pc;
+    uint8_t ir, d, acc, x, y, out, xout, reg_in, prev_out;
+};
+
+/* Detector of idle loops.
+ * While the input does not change, the next state of the computer
+ * only depends on its registers and RAM. So if a loop comes back to
+ * its head with the same registers, without having changed the RAM,
+ * it will repeat itself forever, and whole passes over it can be
+ * skipped by advancing `num_cycles` alone. The candidate loop is
+ * the target of the last backward branch taken: a pass over it ends
+ * when the next backward branch lands there again.
+ * With `watch_output`, the passes that change the output port are
+ * not skipped either. Nothing is then visible outside of the
+ * computer during the skipped passes (no sync pulse, pixel or
+ * sound), and since the input is only latched on the edges of
+ * /HSYNC, they do not depend on the input.
+ */
+struct gigatron_idle {
+    int watch_output;    /* Only skip the passes with a still output. */
+    uint16_t head;       /* Head of the candidate loop. */
+    int armed;           /* `regs` holds the state at `head`. */
+    int clean;           /* The RAM did not change since `start`. */
+    int still;           /* The output did not change since `start`. */
+    uint64_t start;      /* Cycle of the last pass at `head`. */
+    struct idle_regs regs;
+
+    uint64_t skips;      /* Number of fast-forwards. */
+    uint64_t skipped;    /* Cycles skipped. */
+};
+
+/* Exported functions. */
+
+/* Initializes the detector `idle` (see `watch_output` above). This
+ * must also be called when the state of the instance is changed from
+ * outside between two calls to `gigatron_idle_step()` (reset, RAM
+ * written, snapshot restored, or input changed without
+ * `watch_output`).
+ */
+void gigatron_idle_init(struct gigatron_idle *idle, int watch_output);
+
+/* Executes one instruction in `gs`, like `gigatron_step()`. If it
+ * ends an idle pass, the passes that would follow it and end before
+ * the cycle `stop` are skipped as well. Returns the number of cycles
+ * skipped (0 most of the time). The state of `gs` is always the one
+ * that as many calls to `gigatron_step()` would give.
+ */
+uint64_t gigatron_idle_step(struct gigatron_idle *idle,
+                            struct gigatron_state *gs, uint64_t stop);
+
+/* Executes `num_cycles` instructions in `gs`, with the same result
+ * as as many calls to `gigatron_step()`, but skipping the passes
+ * over idle loops. The detection starts afresh at each call, so the
+ * state can change between the calls.
+ */
+void gigatron_idle_run(struct gigatron_idle *idle,
+                       struct gigatron_state *gs, uint64_t num_cycles);
+
+#endif /* __IDLE_H */
@@ -0,0 +1,58 @@
+#ifndef __INPUT_H
+#define __INPUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "gigatron.h"
+
+/* Constants. */
+
+/* Value of the input port when nothing is pressed. */
+#define INPUT_IDLE 0xFF
+
+/* Exported functions. */
+
+/* Generator of random input, shared by the validation tools (in C
+ * and C++) so that they present the same sequences for the same
+ * seeds.
+ */
+
+/* Returns the initial state of the input generator of `seed`
+ * (splitmix64, so that close seeds give unrelated sequences).
+ */
+static inline uint64_t gigatron_input_init(uint64_t seed)
+{
+    uint64_t z;
+
+    z = seed + 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return (z ^ (z >> 31)) | 1;
+}
+
+/* Returns the next input after `prev`: the same (half of the time),
+ * nothing pressed, or a random byte (buttons or serial data).
+ */
+static inline uint8_t gigatron_input_next(uint64_t *state, uint8_t prev)
+{
+    uint64_t x;
+
+    x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+
+    switch (x & 3) {
+    case 0:
+    case 1:
+        return prev;
+    case 2:
+        return INPUT_IDLE;
+    default:
+        return (uint8_t) (x >> 8);
+    }
+}
+
+#endif /* __INPUT_H */
@@ -0,0 +1,574 @@
+/* Lockstep engine running many Gigatron instances at once.
+ * The lanes that are about to execute the same instruction at
+ * the same address are executed together with vector
+ * instructions (SSE2 or AVX2, depending on the target flags).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "dirty.h"
+#include "lockstep.h"
+
+/* Vector types holding one field of all lanes. */
+typedef uint8_t  v8u  __attribute__((vector_size(LOCKSTEP_MAX_LANES)));
+typedef int8_t   v8s  __attribute__((vector_size(LOCKSTEP_MAX_LANES)));
+typedef uint16_t v16u __attribute__((vector_size(2 * LOCKSTEP_MAX_LANES)));
+typedef int16_t  v16s __attribute__((vector_size(2 * LOCKSTEP_MAX_LANES)));
+
+/* Auxiliary macros to load and store the vectors. They are
+ * macros (and not functions) because passing vectors by value
+ * triggers warnings about the vector ABI.
+ */
+#define LOAD(v, p)  memcpy(&(v), (p), sizeof(v))
+#define STORE(p, v) memcpy((p), &(v), sizeof(v))
+
+/* Selects `a` in the lanes where the mask `m` is set, and `b`
+ * in the remaining lanes.
+ */
+#define SELECT8(m, a, b) \
+    (((a) & ((v8u) (m))) | ((b) & ~((v8u) (m))))
+
+#define SELECT16(m, a, b) \
+    (((a) & ((v16u) __builtin_convertvector((m), v16s))) \
+     | ((b) & ~((v16u) __builtin_convertvector((m), v16s))))
+
+/* Converts the mask `m` to a bitmask (one bit per lane). */
+static inline uint32_t mask_bits(const v8s *m)
+{
+#if defined(__AVX2__)
+    __m256i v;
+    memcpy(&v, m, sizeof(v));
+    return (uint32_t) _mm256_movemask_epi8(v);
+#elif defined(__SSE2__)
+    __m128i lo, hi;
+    memcpy(&lo, m, sizeof(lo));
+    memcpy(&hi, ((const char *) m) + sizeof(lo), sizeof(hi));
+    return ((uint32_t) _mm_movemask_epi8(lo))
+        | (((uint32_t) _mm_movemask_epi8(hi)) << 16);
+#else
+    uint32_t bits;
+    int i;
+
+    bits = 0;
+    for (i = 0; i < LOCKSTEP_MAX_LANES; i++) {
+        if ((*m)[i]) bits |= ((uint32_t) 1) << i;
+    }
+    return bits;
+#endif
+}
+
+void gigatron_lockstep_init(struct gigatron_lockstep *ls,
+                            const uint16_t *rom, uint32_t ram_size)
+{
+    memset(ls, 0, sizeof(*ls));
+    ls->rom = rom;
+    ls->ram_size = ram_size;
+    ls->num_lanes = 0;
+}
+
+int gigatron_lockstep_load(struct gigatron_lockstep *ls, uint32_t lane,
+                           const struct gigatron_state *gs)
+{
+    if (lane >= LOCKSTEP_MAX_LANES) {
+        fprintf(stderr, "invalid lane %u\n", lane);
+        return FALSE;
+    }
+
+    if (gs->rom != ls->rom || gs->ram_size != ls->ram_size) {
+        fprintf(stderr, "lane %u: rom or ram size mismatch\n", lane);
+        return FALSE;
+    }
+
+    ls->pc[lane] = gs->pc;
+    ls->prev_pc[lane] = gs->prev_pc;
+    ls->reg_ir[lane] = gs->reg_ir;
+    ls->reg_d[lane] = gs->reg_d;
+    ls->reg_acc[lane] = gs->reg_acc;
+    ls->reg_x[lane] = gs->reg_x;
+    ls->reg_y[lane] = gs->reg_y;
+    ls->reg_out[lane] = gs->reg_out;
+    ls->reg_xout[lane] = gs->reg_xout;
+    ls->reg_in[lane] = gs->reg_in;
+    ls->in[lane] = gs->in;
+    ls->prev_out[lane] = gs->prev_out;
+    ls->num_cycles[lane] = gs->num_cycles;
+    ls->ram[lane] = gs->ram;
+    ls->dirty[lane] = gs->dirty;
+
+    if (ls->num_lanes <= lane)
+        ls->num_lanes = lane + 1;
+
+    return TRUE;
+}
+
+void gigatron_lockstep_store(const struct gigatron_lockstep *ls,
+                             uint32_t lane, struct gigatron_state *gs)
+{
+    gs->pc = ls->pc[lane];
+    gs->prev_pc = ls->prev_pc[lane];
+    gs->reg_ir = ls->reg_ir[lane];
+    gs->reg_d = ls->reg_d[lane];
+    gs->reg_acc = ls->reg_acc[lane];
+    gs->reg_x = ls->reg_x[lane];
+    gs->reg_y = ls->reg_y[lane];
+    gs->reg_out = ls->reg_out[lane];
+    gs->reg_xout = ls->reg_xout[lane];
+    gs->reg_in = ls->reg_in[lane];
+    gs->in = ls->in[lane];
+    gs->prev_out = ls->prev_out[lane];
+    gs->num_cycles = ls->num_cycles[lane];
+}
+
+/* Executes one instruction in a single lane using the reference
+ * implementation in `gigatron_step()`.
+ */
+static void step_lane(struct gigatron_lockstep *ls, uint32_t lane)
+{
+    struct gigatron_state gs;
+
+    gigatron_lockstep_store(ls, lane, &gs);
+    gs.rom = ls->rom;
+    gs.ram = ls->ram[lane];
+    gs.ram_size = ls->ram_size;
+    gs.dirty = ls->dirty[lane];
+    gigatron_step(&gs);
+
+    ls->pc[lane] = gs.pc;
+    ls->prev_pc[lane] = gs.prev_pc;
+    ls->reg_ir[lane] = gs.reg_ir;
+    ls->reg_d[lane] = gs.reg_d;
+    ls->reg_acc[lane] = gs.reg_acc;
+    ls->reg_x[lane] = gs.reg_x;
+    ls->reg_y[lane] = gs.reg_y;
+    ls->reg_out[lane] = gs.reg_out;
+    ls->reg_xout[lane] = gs.reg_xout;
+    ls->reg_in[lane] = gs.reg_in;
+    ls->prev_out[lane] = gs.prev_out;
+}
+
+/* The registers of all lanes that the instructions update, held
+ * in vectors (the program counters and the instruction registers
+ * are handled by the callers).
+ */
+struct lane_regs {
+    v8u acc, x, y, out, xout, reg_in, prev_out;
+};
+
+/* Executes the instruction `(ir, d)` at the addresses `*vpc` for
+ * the lanes in the mask `*mp` (`bits` as a bitmask), from the
+ * registers `*r`, with the input `*in`. The registers are updated in
+ * `*r`, and the next program counters are written to `*next_pc`.
+ * If `masked` is FALSE, the registers of the lanes outside the mask
+ * are not preserved. This follows `gigatron_step()` closely, except
+ * that the decoding is done only once for all lanes. It is always
+ * inlined with a constant `masked`, so that the callers keep the
+ * registers in vector registers.
+ */
+static inline __attribute__((always_inline))
+void execute(struct gigatron_lockstep *ls, const v8s *mp, uint32_t bits,
+             const int masked, const v16u *vpc, uint8_t ir, uint8_t d,
+             const v8u *in, struct lane_regs *r, v16u *next_pc)
+{
+    uint32_t ins;
+    uint32_t mod;
+    uint32_t bus;
+    uint32_t lane, rest;
+    int is_write;
+    int is_jump;
+    v8u low, high, b, alu, zero;
+    v8s m, edge;
+
+    m = *mp;
+    ins = (((uint32_t) ir) >> 5) & 0x07;
+    mod = (((uint32_t) ir) >> 2) & 0x07;
+    bus = ((uint32_t) ir) & 0x03;
+    is_write = (ins == 6);
+    is_jump = (ins == 7);
+
+    zero = (v8u) {};
+    low = zero + d;
+    high = zero;
+
+    if (!is_jump) {
+        /* Resolve the memory address. */
+        switch (mod) {
+        case 1:
+            low = r->x;
+            break;
+        case 2:
+            high = r->y;
+            break;
+        case 3:
+        case 7:
+            low = r->x;
+            high = r->y;
+            break;
+        }
+    }
+
+    b = zero;
+    switch(bus) {
+    case 0:
+        b = zero + d;
+        break;
+    case 1:
+        if (!is_write) {
+            /* The loads are done one lane at a time. */
+            for (rest = bits; rest; rest &= rest - 1) {
+                uint32_t addr;
+
+                lane = __builtin_ctz(rest);
+                addr = (((uint32_t) high[lane]) << 8) | low[lane];
+                if (((size_t) addr) < ls->ram_size)
+                    b[lane] = ls->ram[lane][addr];
+            }
+        }
+        break;
+    case 2:
+        b = r->acc;
+        break;
+    case 3:
+        b = r->reg_in;
+        break;
+    }
+
+    switch(ins) {
+    case 0: /* ld */
+        alu = b;
+        break;
+    case 1: /* anda */
+        alu = r->acc & b;
+        break;
+    case 2: /* ora */
+        alu = r->acc | b;
+        break;
+    case 3: /* xora */
+        alu = r->acc ^ b;
+        break;
+    case 4: /* adda */
+        alu = r->acc + b;
+        break;
+    case 5: /* suba */
+        alu = r->acc - b;
+        break;
+    case 6: /* st */
+        alu = r->acc;
+        break;
+    default: /* branch */
+        alu = -r->acc;
+        break;
+    }
+
+    /* Compute the next program counters. */
+    if (is_jump) {
+        v16u b16;
+
+        b16 = __builtin_convertvector(b, v16u);
+        if (mod != 0) {
+            v8u cond;
+            v8s taken;
+
+            cond = (r->acc >> 7) + (((v8u) (r->acc == zero)) & 2);
+            taken = (((zero + 1) << cond) & ((uint8_t) mod)) != zero;
+            *next_pc = SELECT16(taken, (*vpc & 0xFF00) | b16, *vpc + 1);
+        } else {
+            /* Far jump */
+            *next_pc = (__builtin_convertvector(r->y, v16u) << 8) | b16;
+        }
+    } else {
+        *next_pc = *vpc + 1;
+    }
+
+    /* Write back to memory. */
+    if (is_write) {
+        for (rest = bits; rest; rest &= rest - 1) {
+            uint32_t addr;
+
+            lane = __builtin_ctz(rest);
+            addr = (((uint32_t) high[lane]) << 8) | low[lane];
+            if (((size_t) addr) < ls->ram_size) {
+                ls->ram[lane][addr] = b[lane];
+                if (ls->dirty[lane])
+                    gigatron_dirty_mark(ls->dirty[lane], addr);
+            }
+        }
+    }
+
+    /* On /HSYNC rising edge, update extended output register
+     * and input register.
+     */
+    edge = ((r->out & ~r->prev_out) & 0x40) != zero;
+    if (masked) edge &= m;
+    r->xout = SELECT8(edge, r->acc, r->xout);
+    r->reg_in = SELECT8(edge, *in, r->reg_in);
+
+    /* Update the registers. */
+    if (!masked) m = (v8s) (zero - 1);
+    r->prev_out = SELECT8(m, r->out, r->prev_out);
+    if (!is_jump) {
+        switch (mod) {
+        case 0: case 1: case 2: case 3:
+            if (!is_write) r->acc = SELECT8(m, alu, r->acc);
+            break;
+        case 4:
+            r->x = SELECT8(m, alu, r->x);
+            break;
+        case 5:
+            r->y = SELECT8(m, alu, r->y);
+            break;
+        case 6:
+        case 7:
+            if (!is_write) r->out = SELECT8(m, alu, r->out);
+            break;
+        }
+        if (mod == 7) r->x = SELECT8(m, r->x + 1, r->x);
+    }
+}
+
+/* Loads the registers of all lanes from `ls`. */
+static inline void load_regs(const struct gigatron_lockstep *ls,
+                             struct lane_regs *r)
+{
+    LOAD(r->acc, ls->reg_acc);
+    LOAD(r->x, ls->reg_x);
+    LOAD(r->y, ls->reg_y);
+    LOAD(r->out, ls->reg_out);
+    LOAD(r->xout, ls->reg_xout);
+    LOAD(r->reg_in, ls->reg_in);
+    LOAD(r->prev_out, ls->prev_out);
+}
+
+/* Stores the registers of all lanes to `ls`. */
+static inline void store_regs(struct gigatron_lockstep *ls,
+                              const struct lane_regs *r)
+{
+    STORE(ls->reg_acc, r->acc);
+    STORE(ls->reg_x, r->x);
+    STORE(ls->reg_y, r->y);
+    STORE(ls->reg_out, r->out);
+    STORE(ls->reg_xout, r->xout);
+    STORE(ls->reg_in, r->reg_in);
+    STORE(ls->prev_out, r->prev_out);
+}
+
+/* Executes the instruction `(ir, d)` at address `pc` for all
+ * lanes in the mask `*mp`.
+ */
+static void step_group(struct gigatron_lockstep *ls, const v8s *mp,
+                       uint32_t bits, uint16_t pc,
+                       uint8_t ir, uint8_t d)
+{
+    struct lane_regs r;
+    uint16_t word;
+    v8u in, ir_v, d_v, zero;
+    v16u vpc, prev_pc, next_pc;
+    v8s m;
+
+    m = *mp;
+    zero = (v8u) {};
+    load_regs(ls, &r);
+    LOAD(in, ls->in);
+    LOAD(vpc, ls->pc);
+
+    execute(ls, &m, bits, TRUE, &vpc, ir, d, &in, &r, &next_pc);
+    store_regs(ls, &r);
+
+    /* Fetch new instruction (the same for all lanes). */
+    word = ls->rom[pc];
+    LOAD(ir_v, ls->reg_ir);
+    LOAD(d_v, ls->reg_d);
+    LOAD(prev_pc, ls->prev_pc);
+    ir_v = SELECT8(m, zero + (uint8_t) (word & 0xFF), ir_v);
+    d_v = SELECT8(m, zero + (uint8_t) ((word >> 8) & 0xFF), d_v);
+    prev_pc = SELECT16(m, vpc, prev_pc);
+    vpc = SELECT16(m, next_pc, vpc);
+    STORE(ls->reg_ir, ir_v);
+    STORE(ls->reg_d, d_v);
+    STORE(ls->prev_pc, prev_pc);
+    STORE(ls->pc, vpc);
+}
+
+/* Returns the mask of the lanes in use (one bit per lane). */
+static inline uint32_t lanes_in_use(const struct gigatron_lockstep *ls)
+{
+    return (ls->num_lanes >= 32) ? ~((uint32_t) 0)
+        : (((uint32_t) 1) << ls->num_lanes) - 1;
+}
+
+/* Executes one instruction in every lane, without counting the
+ * cycles.
+ */
+static void step_lanes(struct gigatron_lockstep *ls)
+{
+    v8u ir, d;
+    v16u pc;
+    v8s remaining;
+    uint32_t bits, lane;
+
+    LOAD(ir, ls->reg_ir);
+    LOAD(d, ls->reg_d);
+    LOAD(pc, ls->pc);
+
+    remaining = (v8s) {};
+    for (lane = 0; lane < ls->num_lanes; lane++)
+        remaining[lane] = -1;
+
+    bits = mask_bits(&remaining);
+    while (bits) {
+        v8s m;
+        uint32_t group, count;
+
+        /* Find the lanes executing the same instruction as the
+         * first remaining lane.
+         */
+        lane = __builtin_ctz(bits);
+        m = remaining
+            & (ir == ir[lane])
+            & (d == d[lane])
+            & __builtin_convertvector(pc == pc[lane], v8s);
+        group = mask_bits(&m);
+        count = __builtin_popcount(group);
+
+        if (count >= LOCKSTEP_MIN_GROUP) {
+            step_group(ls, &m, group, pc[lane], ir[lane], d[lane]);
+            ls->num_vector += count;
+        } else {
+            step_lane(ls, lane);
+            ls->num_scalar++;
+            group = ((uint32_t) 1) << lane;
+            m = (v8s) {};
+            m[lane] = -1;
+        }
+
+        remaining &= ~m;
+        bits &= ~group;
+    }
+}
+
+/* Returns TRUE if all the lanes in use are about to execute the
+ * same instruction at the same address.
+ */
+static int converged(const struct gigatron_lockstep *ls)
+{
+    v8u ir, d;
+    v16u pc;
+    v8s m;
+    uint32_t used;
+
+    used = lanes_in_use(ls);
+    if (ls->num_lanes < LOCKSTEP_MIN_GROUP)
+        return FALSE;
+
+    LOAD(ir, ls->reg_ir);
+    LOAD(d, ls->reg_d);
+    LOAD(pc, ls->pc);
+    m = (ir == ir[0]) & (d == d[0])
+        & __builtin_convertvector(pc == pc[0], v8s);
+    return (mask_bits(&m) & used) == used;
+}
+
+/* Executes at most `num_cycles` instructions in all the lanes, while
+ * they are converged (see `converged()`). The program counter and the
+ * instruction are then scalars, and the registers stay in vectors
+ * from one cycle to the next.
+ * `num_cycles` must not be 0. Returns the number of cycles executed.
+ */
+static uint64_t run_converged(struct gigatron_lockstep *ls,
+                              uint64_t num_cycles)
+{
+    struct lane_regs r;
+    uint64_t n;
+    uint32_t used;
+    int diverged;
+    uint16_t pc, prev_pc, word;
+    uint8_t ir, d, cur_ir;
+    v8u in, ir_v, d_v, zero;
+    v16u vpc, next_pc;
+    v8s all, same;
+
+    used = lanes_in_use(ls);
+    zero = (v8u) {};
+    all = (v8s) (zero - 1);
+    load_regs(ls, &r);
+    LOAD(in, ls->in);
+    pc = ls->pc[0];
+    ir = ls->reg_ir[0];
+    d = ls->reg_d[0];
+    prev_pc = ls->prev_pc[0];
+
+    diverged = FALSE;
+    for (n = 0; n < num_cycles; ) {
+        vpc = ((v16u) {}) + pc;
+        cur_ir = ir;
+        execute(ls, &all, used, FALSE, &vpc, ir, d, &in, &r, &next_pc);
+        n++;
+
+        /* Fetch new instruction (the same for all lanes). */
+        word = ls->rom[pc];
+        ir = (uint8_t) (word & 0xFF);
+        d = (uint8_t) ((word >> 8) & 0xFF);
+        prev_pc = pc;
+
+        /* Only the branches can send the lanes to different
+         * addresses.
+         */
+        if ((cur_ir >> 5) != 7) {
+            pc++;
+            continue;
+        }
+        same = __builtin_convertvector(next_pc == next_pc[0], v8s);
+        if ((mask_bits(&same) & used) != used) {
+            diverged = TRUE;
+            break;
+        }
+        pc = next_pc[0];
+    }
+
+    if (!diverged)
+        next_pc = ((v16u) {}) + pc;
+    store_regs(ls, &r);
+    vpc = ((v16u) {}) + prev_pc;
+    STORE(ls->prev_pc, vpc);
+    STORE(ls->pc, next_pc);
+    ir_v = zero + ir;
+    STORE(ls->reg_ir, ir_v);
+    d_v = zero + d;
+    STORE(ls->reg_d, d_v);
+
+    ls->num_vector += n * ls->num_lanes;
+    return n;
+}
+
+void gigatron_lockstep_step(struct gigatron_lockstep *ls)
+{
+    gigatron_lockstep_run(ls, 1);
+}
+
+void gigatron_lockstep_run(struct gigatron_lockstep *ls,
+                           uint64_t num_cycles)
+{
+    uint64_t done;
+    uint32_t lane;
+
+    /* The lanes all run the same number of cycles, so they are
+     * counted once at the end.
+     */
+    done = 0;
+    while (done < num_cycles) {
+        if (converged(ls)) {
+            done += run_converged(ls, num_cycles - done);
+        } else {
+            step_lanes(ls);
+            done++;
+        }
+    }
+
+    for (lane = 0; lane < ls->num_lanes; lane++)
+        ls->num_cycles[lane] += num_cycles;
+}
@@ -0,0 +1,89 @@
+#ifndef __LOCKSTEP_H
+#define __LOCKSTEP_H
+
+#include <stdint.h>
+
+#include "gigatron.h"
+
+/* Constants. */
+
+/* Maximum number of lanes (instances) in a lockstep engine.
+ * This is the number of bytes in an AVX2 register, so that
+ * each 8-bit register of all lanes fits in a single vector.
+ */
+#define LOCKSTEP_MAX_LANES 32
+
+/* Minimum number of lanes executing the same instruction for
+ * the vectorized path to be used. Smaller groups are stepped
+ * one lane at a time with `gigatron_step()`.
+ */
+#define LOCKSTEP_MIN_GROUP 2
+
+/* Data structures and type declarations. */
+
+/* The state of many Gigatron instances running the same ROM,
+ * stored in a structure-of-arrays layout. Lane `i` of each
+ * array holds the corresponding field of the `i`-th instance.
+ */
+struct gigatron_lockstep {
+    uint16_t pc[LOCKSTEP_MAX_LANES]       __attribute__((aligned(64)));
+    uint16_t prev_pc[LOCKSTEP_MAX_LANES]  __attribute__((aligned(64)));
+
+    uint8_t  reg_ir[LOCKSTEP_MAX_LANES]   __attribute__((aligned(32)));
+    uint8_t  reg_d[LOCKSTEP_MAX_LANES]    __attribute__((aligned(32)));
+    uint8_t  reg_acc[LOCKSTEP_MAX_LANES]  __attribute__((aligned(32)));
+    uint8_t  reg_x[LOCKSTEP_MAX_LANES]    __attribute__((aligned(32)));
+    uint8_t  reg_y[LOCKSTEP_MAX_LANES]    __attribute__((aligned(32)));
+    uint8_t  reg_out[LOCKSTEP_MAX_LANES]  __attribute__((aligned(32)));
+    uint8_t  reg_xout[LOCKSTEP_MAX_LANES] __attribute__((aligned(32)));
+    uint8_t  reg_in[LOCKSTEP_MAX_LANES]   __attribute__((aligned(32)));
+    uint8_t  in[LOCKSTEP_MAX_LANES]       __attribute__((aligned(32)));
+    uint8_t  prev_out[LOCKSTEP_MAX_LANES] __attribute__((aligned(32)));
+
+    uint64_t num_cycles[LOCKSTEP_MAX_LANES];
+    uint8_t *ram[LOCKSTEP_MAX_LANES]; /* The RAM of each lane. */
+    struct gigatron_dirty *dirty[LOCKSTEP_MAX_LANES];
+                            /* The dirty bitmap of each lane (or NULL). */
+
+    const uint16_t *rom;    /* The ROM shared by all lanes. */
+    uint32_t ram_size;      /* The size of the RAM of every lane. */
+    uint32_t num_lanes;     /* Number of lanes in use. */
+
+    uint64_t num_vector;    /* Lane-cycles run in the vector path. */
+    uint64_t num_scalar;    /* Lane-cycles run in the scalar path. */
+};
+
+/* Exported functions. */
+
+/* Initializes the lockstep engine `ls` with no lanes in use.
+ * All lanes share the ROM `rom` and have RAMs of size `ram_size`.
+ */
+void gigatron_lockstep_init(struct gigatron_lockstep *ls,
+                            const uint16_t *rom, uint32_t ram_size);
+
+/* Copies the state `gs` into the lane `lane` of `ls`.
+ * The lane uses the RAM and the dirty bitmap of `gs` directly (they
+ * are not copied), so they must stay valid while the lane is in use.
+ * The number of lanes in use grows to include `lane` if necessary.
+ * Returns FALSE if `lane` is out of range or if the ROM or the
+ * RAM size of `gs` do not match the ones of `ls`.
+ */
+int gigatron_lockstep_load(struct gigatron_lockstep *ls, uint32_t lane,
+                           const struct gigatron_state *gs);
+
+/* Copies the registers of lane `lane` back into `gs`. */
+void gigatron_lockstep_store(const struct gigatron_lockstep *ls,
+                             uint32_t lane, struct gigatron_state *gs);
+
+/* Executes one instruction in every lane.
+ * Lanes that share the same program counter and instruction
+ * are executed together with vector instructions, and the
+ * remaining lanes are executed one by one.
+ */
+void gigatron_lockstep_step(struct gigatron_lockstep *ls);
+
+/* Executes `num_cycles` instructions in every lane. */
+void gigatron_lockstep_run(struct gigatron_lockstep *ls,
+                           uint64_t num_cycles);
+
+#endif /* __LOCKSTEP_H */
@@ -3,28 +3,62 @@
 
 #include <SDL2/SDL.h>
 
+#include "backend.h"
+#include "debug.h"
+#include "dirty.h"
+#include "disasm.h"
 #include "gigatron.h"
+#include "hash.h"
+#include "idle.h"
+#include "memprof.h"
+#include "movie.h"
+#include "profile.h"
+#include "record.h"
+#include "screen.h"
+#include "server.h"
+#include "shm.h"
+#include "stats.h"
+#include "trace.h"
+#include "vprofile.h"
 
 /* For the SDL window */
 #define WIDTH  640
 #define HEIGHT 480
 #define BORDER 60
 
+/* Number of frames kept in the per-frame profile. */
+#define PROFILE_HISTORY_FRAMES 36000
+
+/* Number of frames kept in the per-frame memory heatmap. */
+#define MEMPROF_HISTORY_FRAMES 3600
+
+/* Length of the windows of statistics for the overlay (in ms). */
+#define STATS_DEFAULT_INTERVAL 1000
+
+/* Number of frames queued for the recorder. */
+#define RECORD_QUEUE_FRAMES 16
+
+/* Maximum number of breakpoints and watchpoints in the command line. */
+#define MAX_DEBUG_ARGS 64
+
 /* Rudimentary FIFO implementation for the audio callback. */
 struct audio_fifo {
     uint8_t *data;
     int start, end, _end;
     int size;
+    uint32_t underruns;  /* Callbacks that ran out of samples. */
+    uint32_t dropped;    /* Samples dropped because it was full. */
 };
 
 /* Callback function to play audio. */
 static void audio_callback(void *userdata, uint8_t *stream, int len)
 {
     struct audio_fifo *afifo;
-    int i, start;
+    int i, start, starved;
 
     afifo = (struct audio_fifo *) userdata;
     start = afifo->start;
+    starved = FALSE;
 
     /*
     fifo_len = afifo->end - afifo->start;
@@ -39,19 +73,96 @@ static void audio_callback(void *userdata, uint8_t *stream, int len)
                 start = 0;
         } else {
             stream[i] = 0;
+            starved = TRUE;
         }
     }
 
     afifo->start = start;
+    if (starved)
+        afifo->underruns++;
 }
 
+/* Command line options of the emulator. */
+struct options {
+    const char *rom_filename;
+    const char *backend_name;            /* CPU backend. */
+    const char *trace_filename;
+    const char *profile_filename;        /* Folded stacks. */
+    const char *profile_frames_filename; /* Per-frame breakdown. */
+    const char *symbols_filename;
+    const char *vprofile_filename;       /* vCPU folded stacks. */
+    const char *gt1_filename;            /* GT1 program profiled. */
+    uint16_t vcpu_dispatch;              /* 0 to find it. */
+    const char *memprof_filename;        /* RAM heatmap. */
+    const char *shm_name;                /* Shared-memory segment. */
+    int overlay;                         /* Show the statistics. */
+    uint32_t stats_interval;             /* Log the statistics (ms). */
+    const char *record_video_filename;   /* Y4M, raw RGB or "|command". */
+    const char *record_audio_filename;   /* WAV. */
+    int headless;                        /* No window and no sound. */
+    int unthrottled;                     /* Do not pace to real time. */
+    int fast_forward;                    /* Skip the idle loops. */
+    uint32_t max_frames;                 /* Stop after (0 for never). */
+    const char *hash_filename;           /* Per-frame hash stream. */
+    const char *golden_filename;         /* Golden hash stream. */
+    int hash_ram;                        /* Hash the RAM as well. */
+    const char *record_movie_filename;   /* Input history. */
+    const char *replay_movie_filename;
+    const char *socket_path;             /* Automation server. */
+
+    /* Breakpoints and watchpoints (the option and its argument). */
+    const char *debug_args[MAX_DEBUG_ARGS][2];
+    int num_debug_args;
+};
+
 /* Structure containing the emulator state and SDL related
  * objects.
  */
 struct emulator {
-    /* State of the Gigatron TTL computer. */
-    struct gigatron_state gs;
+    /* The CPU, and the state of the Gigatron TTL computer (`be.gs`). */
+    struct gigatron_backend be;
+    int native;          /* The backend is the reference C core. */
     int is_running;
+    int headless;        /* No window and no sound. */
+    int unthrottled;     /* Run as fast as possible. */
+    int fast_forward;    /* Skip the idle loops (see idle.h). */
+    struct gigatron_idle idle;
+    uint32_t max_frames; /* Stop after this many frames (or 0). */
+    int failed;          /* The run failed (a golden hash mismatched). */
+
+    /* Instrumentation. */
+    int instrumented;    /* Some instrumentation is enabled. */
+    struct gigatron_trace *trace;
+    struct gigatron_profile *profile;
+    struct gigatron_vprofile *vprofile;
+    struct gigatron_memprof *memprof;
+    struct gigatron_debugger *debugger;
+
+    /* Shared-memory export (NULL if disabled). */
+    struct gigatron_shm *shm;
+
+    /* Audio/video recording (NULL if disabled). */
+    struct gigatron_recorder *recorder;
+    uint8_t rec_samples[RECORD_MAX_SAMPLES]; /* Samples of the frame. */
+    uint32_t num_rec_samples;
+
+    /* Per-frame hashes (NULL if disabled). */
+    struct gigatron_hash_stream *hashes;
+
+    /* Input movie being recorded or replayed (NULL if disabled). */
+    struct gigatron_movie *movie;
+    uint64_t stop_cycle; /* Return from run_frame() at this cycle. */
+
+    /* Automation server (NULL if disabled). */
+    struct gigatron_server *server;
+
+    /* Performance and health statistics (NULL if disabled). */
+    struct gigatron_stats *stats;
+    int overlay;         /* Show them on the screen. */
+    int stats_log;       /* Log them at every window. */
+    uint32_t stats_interval; /* Length of the windows (in ms). */
+    uint64_t input_ns;   /* Time of the last input event. */
+    int input_pending;   /* The input was not latched yet. */
 
     SDL_Window *win;
 
@@ -76,16 +187,14 @@ static void update_pixels(struct emulator *emu)
     struct gigatron_state *gs;
     uint8_t diff_out;
 
-    gs = &emu->gs;
+    gs = &emu->be.gs;
 
     /* Update pixels. */
     if ((emu->vga_x < WIDTH) && (emu->vga_x >= 0)
         && (emu->vga_y >= 0) && (emu->vga_y < HEIGHT)) {
         uint32_t color;
         uint32_t pos;
-        color = ((gs->reg_out & 0x03) << 6) << 16
-            | ((gs->reg_out & 0x0C) << 4) << 8
-            | ((gs->reg_out & 0x30) << 2);
+        color = gigatron_screen_color(gs->reg_out);
 
         pos = emu->vga_y * WIDTH + emu->vga_x;
         emu->pixels[pos] = color;
@@ -112,6 +221,18 @@ static void update_pixels(struct emulator *emu)
     }
 }
 
+/* Updates the pixels for `num_cycles` cycles skipped by the
+ * fast-forward. The output did not change during them, so the beam
+ * only moves along the line, and nothing is drawn past its end.
+ */
+static void skip_pixels(struct emulator *emu, uint64_t num_cycles)
+{
+    while (num_cycles > 0 && emu->vga_x < WIDTH) {
+        update_pixels(emu);
+        num_cycles--;
+    }
+}
+
 /* Adds audio data to the audio FIFO. */
 static void update_audio(struct emulator *emu)
 {
@@ -119,7 +240,7 @@ static void update_audio(struct emulator *emu)
     struct audio_fifo *afifo;
     uint8_t diff_out;
 
-    gs = &emu->gs;
+    gs = &emu->be.gs;
     afifo = &emu->afifo;
 
     diff_out = gs->reg_out ^ gs->prev_out;
@@ -129,6 +250,15 @@ static void update_audio(struct emulator *emu)
         int next_end;
 
 
+        if (emu->recorder
+            && emu->num_rec_samples < RECORD_MAX_SAMPLES) {
+            emu->rec_samples[emu->num_rec_samples++] =
+                (gs->reg_xout & 0xF0);
+        }
+
+        /* Nobody plays the audio FIFO when headless. */
+        if (emu->headless) return;
+
         /* TODO: Implement Low pass and High pass filters. */
         next_end = afifo->_end + 1;
         if (next_end == afifo->size)
@@ -137,14 +267,27 @@ static void update_audio(struct emulator *emu)
         if (next_end != afifo->start) {
             afifo->data[afifo->_end] = (gs->reg_xout & 0xF0);
             afifo->_end = next_end;
+        } else {
+            afifo->dropped++;
         }
 
     }
 
     /* /VSYNC raised. */
-    if ((diff_out & 0x80) && (gs->reg_out & 0x80)) {
+    if ((diff_out & 0x80) && (gs->reg_out & 0x80) && !emu->headless) {
         SDL_LockAudioDevice(emu->audio_dev_id);
         afifo->end = afifo->_end;
+        if (emu->stats) {
+            int fill;
+
+            fill = afifo->end - afifo->start;
+            if (fill < 0) fill += afifo->size;
+            gigatron_stats_audio(emu->stats, (uint32_t) fill);
+            emu->stats->underruns += afifo->underruns;
+            emu->stats->dropped += afifo->dropped;
+            afifo->underruns = 0;
+            afifo->dropped = 0;
+        }
         SDL_UnlockAudioDevice(emu->audio_dev_id);
     }
 }
@@ -156,7 +299,9 @@ static void process_input_events(struct emulator *emu)
     const uint8_t *keyboard_state;
     SDL_Event event;
 
-    gs = &emu->gs;
+    if (emu->headless) return;
+
+    gs = &emu->be.gs;
     while (SDL_PollEvent(&event)) {
         switch(event.type) {
         case SDL_QUIT:
@@ -164,9 +309,13 @@ static void process_input_events(struct emulator *emu)
             break;
         case SDL_TEXTINPUT:
             gs->in = event.text.text[0];
+            emu->input_ns = gigatron_stats_now();
+            emu->input_pending = TRUE;
             break;
         case SDL_KEYDOWN:
         case SDL_KEYUP:
+            emu->input_ns = gigatron_stats_now();
+            emu->input_pending = TRUE;
             if (event.key.keysym.sym == SDLK_ESCAPE) {
                 emu->is_running = FALSE;
             } else {
@@ -294,69 +443,184 @@ void draw_cicle(SDL_Renderer *renderer,
     }
 }
 
+/* Draws the statistics of the last window over the frame buffer. */
+static void draw_overlay(struct emulator *emu)
+{
+    const struct gigatron_stats_window *w;
+    char lines[3][64];
+    int i, x, y;
+
+    w = &emu->stats->last;
+    snprintf(lines[0], sizeof(lines[0]), "%.2f MHZ %.1f FPS",
+             w->mhz, w->fps);
+    snprintf(lines[1], sizeof(lines[1]),
+             "EMU %.1f OUT %.1f REN %.1f PRE %.1f MS",
+             w->emulate_ms, w->output_ms, w->render_ms, w->present_ms);
+    snprintf(lines[2], sizeof(lines[2]), "AUD %u UND %u DROP %u LAT %.0f",
+             w->audio_fill, w->underruns, w->dropped, w->latency_ms);
+
+    /* Dark background, so that the text is always readable. */
+    for (y = 0; y < 3 * 2 * STATS_CHAR_HEIGHT + 4; y++) {
+        for (x = 0; x < 2 * STATS_CHAR_WIDTH * 40 + 4; x++)
+            emu->pixels[y * WIDTH + x] = 0;
+    }
+
+    for (i = 0; i < 3; i++) {
+        gigatron_stats_draw(emu->pixels, WIDTH, HEIGHT,
+                            2, 2 + i * 2 * STATS_CHAR_HEIGHT, lines[i],
+                            0x00FFFF00, 2);
+    }
+}
+
+/* Renders the frame buffer and the LEDs in the window. */
+static void render_screen(struct emulator *emu)
+{
+    struct gigatron_state *gs;
+    SDL_Rect src, dst;
+    int bit;
+
+    gs = &emu->be.gs;
+
+    src.x = 0;
+    src.y = 0;
+    src.w = WIDTH;
+    src.h = HEIGHT;
+
+    dst.x = BORDER / 2;
+    dst.y = BORDER / 2;
+    dst.w = WIDTH;
+    dst.h = HEIGHT;
+    SDL_UpdateTexture(emu->texture, NULL, emu->pixels,
+                      WIDTH * sizeof(uint32_t));
+
+    SDL_SetRenderDrawColor(emu->renderer, 0, 0, 0, 0);
+    SDL_RenderClear(emu->renderer);
+    SDL_RenderCopy(emu->renderer, emu->texture, &src, &dst);
+
+    /* Draw the LEDs. */
+    for (bit = 0; bit < 4; bit++) {
+        int fill;
+
+        fill = (gs->reg_xout & (1 << bit)) != 0;
+
+        SDL_SetRenderDrawColor(emu->renderer, 127, 0, 0, 0);
+        draw_cicle(emu->renderer,
+                   (BORDER / 2) + 10 + 30 * bit,
+                   (BORDER / 2) + HEIGHT + 12, 10, TRUE);
+
+        if (fill) {
+            SDL_SetRenderDrawColor(emu->renderer, 255, 0, 0, 0);
+        } else {
+            SDL_SetRenderDrawColor(emu->renderer, 0, 0, 0, 0);
+        }
+
+        draw_cicle(emu->renderer,
+                   (BORDER / 2) + 10 + 30 * bit,
+                   (BORDER / 2) + HEIGHT + 12, 7, TRUE);
+    }
+}
+
 /* Updates the emulator screen.
  * This function returns TRUE if a VSYNC has occurred.
  */
 static int update_screen(struct emulator *emu)
 {
     struct gigatron_state *gs;
-    SDL_Rect src, dst;
     uint8_t diff_out;
 
-    gs = &emu->gs;
+    gs = &emu->be.gs;
 
     diff_out = gs->reg_out ^ gs->prev_out;
 
     /* VSYNC raised. */
     if ((diff_out & 0x80) && (gs->reg_out & 0x80)) {
         uint32_t vsync_diff;
-        int bit;
+        uint64_t t0, t1, t2, t3, t4;
 
-        vsync_diff = 3 * SDL_GetTicks() - emu->last_vsync;
-        if (vsync_diff < 50)
-            SDL_Delay((50 - vsync_diff) / 3);
-        emu->last_vsync = 3 * SDL_GetTicks();
-        emu->frame_count++;
+        t0 = t1 = t2 = t3 = 0;
+        if (emu->stats) t0 = gigatron_stats_now();
 
-        src.x = 0;
-        src.y = 0;
-        src.w = WIDTH;
-        src.h = HEIGHT;
+        if (!emu->headless && !emu->unthrottled) {
+            vsync_diff = 3 * SDL_GetTicks() - emu->last_vsync;
+            if (vsync_diff < 50)
+                SDL_Delay((50 - vsync_diff) / 3);
+            emu->last_vsync = 3 * SDL_GetTicks();
+        }
+        emu->frame_count++;
+        if (emu->stats) t1 = gigatron_stats_now();
 
-        dst.x = BORDER / 2;
-        dst.y = BORDER / 2;
-        dst.w = WIDTH;
-        dst.h = HEIGHT;
-        SDL_UpdateTexture(emu->texture, NULL, emu->pixels,
-                          WIDTH * sizeof(uint32_t));
+        /* Backends without a live RAM copy it once per frame. */
+        if (emu->shm || (emu->hashes && (emu->hashes->flags & HASH_RAM)))
+            gigatron_backend_ram(&emu->be);
 
-        SDL_SetRenderDrawColor(emu->renderer, 0, 0, 0, 0);
-        SDL_RenderClear(emu->renderer);
-        SDL_RenderCopy(emu->renderer, emu->texture, &src, &dst);
+        if (emu->shm)
+            gigatron_shm_publish(emu->shm, gs, emu->pixels);
 
-        /* Draw the LEDs. */
-        for (bit = 0; bit < 4; bit++) {
-            int fill;
+        if (emu->recorder) {
+            gigatron_recorder_frame(emu->recorder, emu->pixels,
+                                    emu->rec_samples,
+                                    emu->num_rec_samples);
+            emu->num_rec_samples = 0;
+        }
 
-            fill = (gs->reg_xout & (1 << bit)) != 0;
+        if (emu->hashes) {
+            if (!gigatron_hash_frame(emu->hashes, emu->pixels,
+                                     WIDTH * HEIGHT, gs)) {
+                emu->failed = TRUE;
+                emu->is_running = FALSE;
+            } else if (emu->hashes->golden_done) {
+                fprintf(stderr, "golden hash stream ended at frame %u\n",
+                        emu->hashes->frame);
+                emu->is_running = FALSE;
+            }
+        }
 
-            SDL_SetRenderDrawColor(emu->renderer, 127, 0, 0, 0);
-            draw_cicle(emu->renderer,
-                       (BORDER / 2) + 10 + 30 * bit,
-                       (BORDER / 2) + HEIGHT + 12, 10, TRUE);
+        if (emu->stats) {
+            t2 = gigatron_stats_now();
+            if (emu->overlay)
+                draw_overlay(emu);
+        }
 
-            if (fill) {
-                SDL_SetRenderDrawColor(emu->renderer, 255, 0, 0, 0);
-            } else {
-                SDL_SetRenderDrawColor(emu->renderer, 0, 0, 0, 0);
+        if (!emu->headless)
+            render_screen(emu);
+
+        if (emu->stats) t3 = gigatron_stats_now();
+        if (!emu->headless)
+            SDL_RenderPresent(emu->renderer);
+
+        if (emu->stats) {
+            struct gigatron_stats *st;
+
+            /* The pacing counts as presentation, and the shared
+             * memory, the recorder and the hashes as output.
+             */
+            st = emu->stats;
+            t4 = gigatron_stats_now();
+            st->emulate_ns += t0 - st->mark_ns;
+            st->output_ns += t2 - t1;
+            st->render_ns += t3 - t2;
+            st->present_ns += (t1 - t0) + (t4 - t3);
+            st->mark_ns = t4;
+
+            /* The input was latched by the emulated computer, and
+             * this is the first frame that can show its effect.
+             */
+            if (emu->input_pending && gs->reg_in == gs->in) {
+                gigatron_stats_input(st, t4 - emu->input_ns);
+                emu->input_pending = FALSE;
             }
 
-            draw_cicle(emu->renderer,
-                       (BORDER / 2) + 10 + 30 * bit,
-                       (BORDER / 2) + HEIGHT + 12, 7, TRUE);
+            if (gigatron_stats_end_frame(st, gs->num_cycles)
+                && emu->stats_log) {
+                char line[STATS_MAX_LINE];
+
+                gigatron_stats_format(st, line, sizeof(line));
+                fprintf(stderr, "%s\n", line);
+            }
         }
 
-        SDL_RenderPresent(emu->renderer);
+        if (emu->max_frames > 0 && emu->frame_count >= emu->max_frames)
+            emu->is_running = FALSE;
 
         return TRUE;
     }
@@ -364,41 +628,649 @@ static int update_screen(struct emulator *emu)
     return FALSE;
 }
 
-static void main_loop(struct emulator *emu)
+/* Prints the state of the CPU, and the instruction about to be
+ * executed.
+ */
+static void print_state(const struct emulator *emu)
+{
+    const struct gigatron_state *gs;
+    char line[DISASM_MAX_LINE];
+
+    gs = &emu->be.gs;
+    line[gigatron_disasm_line(gs->prev_pc, gs->reg_ir, gs->reg_d,
+                              line)] = '\0';
+    fprintf(stderr, "%12llu  %-32s acc=$%02X x=$%02X y=$%02X "
+            "out=$%02X in=$%02X vPC=$%04X\n",
+            (unsigned long long) gs->num_cycles, line, gs->reg_acc,
+            gs->reg_x, gs->reg_y, gs->reg_out, gs->reg_in,
+            (uint32_t) (gs->ram[0x16] | (gs->ram[0x17] << 8)));
+}
+
+/* Stops at a breakpoint, and reads debugger commands from the
+ * standard input until the emulation continues.
+ */
+static void debug_prompt(struct emulator *emu)
+{
+    struct gigatron_debugger *dbg;
+    char line[128];
+
+    dbg = emu->debugger;
+    dbg->single_step = FALSE;
+    fprintf(stderr, "stopped at %s ($%04X)\n",
+            gigatron_debug_reason(dbg->reason), (uint32_t) dbg->stop_addr);
+    print_state(emu);
+
+    for (;;) {
+        unsigned long addr;
+        uint32_t i;
+
+        fprintf(stderr, "(c)ontinue, (s)tep, (m)emory <addr>, (q)uit> ");
+        if (!fgets(line, sizeof(line), stdin)) {
+            emu->is_running = FALSE;
+            return;
+        }
+
+        switch (line[0]) {
+        case 'c':
+        case '\n':
+            return;
+        case 's':
+            dbg->single_step = TRUE;
+            return;
+        case 'm':
+            addr = strtoul(&line[1], NULL, 0);
+            fprintf(stderr, "%04lX:", addr & 0xFFFF);
+            for (i = 0; i < 16; i++) {
+                uint32_t a;
+
+                a = (uint32_t) ((addr + i) & 0xFFFF);
+                if (a < emu->be.gs.ram_size)
+                    fprintf(stderr, " %02X", emu->be.gs.ram[a]);
+            }
+            fprintf(stderr, "\n");
+            break;
+        case 'q':
+            emu->is_running = FALSE;
+            return;
+        default:
+            break;
+        }
+    }
+}
+
+/* Calls the instrumentation hooks after each cycle.
+ * This function returns TRUE if the debugger stopped.
+ */
+static int run_hooks(struct emulator *emu)
+{
+    if (emu->trace)
+        gigatron_trace_step(emu->trace, &emu->be.gs);
+    if (emu->profile)
+        gigatron_profile_step(emu->profile, &emu->be.gs);
+    if (emu->vprofile)
+        gigatron_vprofile_step(emu->vprofile, &emu->be.gs);
+    if (emu->memprof)
+        gigatron_memprof_step(emu->memprof, &emu->be.gs);
+    if (emu->debugger)
+        return gigatron_debug_step(emu->debugger, &emu->be.gs);
+    return FALSE;
+}
+
+/* Runs the emulator until the next VSYNC.
+ * The instrumentation hooks are only called if `instrumented` is
+ * TRUE, the backend is only called through its operations if
+ * `native` is FALSE, and the idle loops are only skipped if `fast`
+ * is TRUE (with the reference core). Since this function is always
+ * inlined with constant `instrumented`, `native` and `fast`, the
+ * plain loop of the reference core pays nothing for them.
+ */
+static inline __attribute__((always_inline))
+void run_frame(struct emulator *emu, const int instrumented,
+               const int native, const int fast)
+{
+    struct gigatron_state *gs;
+    uint64_t max_cycles, skipped;
+
+    gs = &emu->be.gs;
+    skipped = 0;
+
+    /* To prevent infinite loops here. */
+    max_cycles = gs->num_cycles + 1000000;
+    if (max_cycles > emu->stop_cycle)
+        max_cycles = emu->stop_cycle;
+
+    /* The state may have changed since the last frame (reset,
+     * writes of the automation server).
+     */
+    if (fast)
+        gigatron_idle_init(&emu->idle, TRUE);
+
+    while (gs->num_cycles < max_cycles) {
+        if (fast) {
+            skipped = gigatron_idle_step(&emu->idle, gs, max_cycles);
+        } else if (native) {
+            gigatron_step(gs);
+        } else {
+            gigatron_backend_step(&emu->be);
+        }
+        if (instrumented) {
+            if (run_hooks(emu)) {
+                debug_prompt(emu);
+                if (!emu->is_running)
+                    break;
+            }
+        }
+
+        update_pixels(emu);
+        if (fast && skipped > 0)
+            skip_pixels(emu, skipped);
+        update_audio(emu);
+        if (update_screen(emu))
+            break;
+    }
+}
+
+/* Resets the computer, and the counters of the frontend. */
+static void reset_emulator(struct emulator *emu)
 {
     struct gigatron_state *gs;
 
-    gs = &emu->gs;
-    gigatron_reset(gs, FALSE);
+    gs = &emu->be.gs;
+    /* Movies start from a cleared RAM. */
+    gigatron_backend_reset(&emu->be, emu->movie != NULL);
     gs->in = 0xFF;
 
-    emu->is_running = TRUE;
     emu->last_vsync = 0;
     emu->frame_count = 0;
     emu->vga_x = 0;
     emu->vga_y = 0;
+    emu->input_pending = FALSE;
+    emu->num_rec_samples = 0;
+    emu->stop_cycle = UINT64_MAX;
+    if (emu->stats)
+        gigatron_stats_init(emu->stats, emu->stats_interval,
+                            gs->num_cycles);
+}
 
-    while (emu->is_running) {
-        uint64_t max_cycles;
+/* Runs the emulator until the next VSYNC or the cycle `stop_cycle`,
+ * and processes the input events.
+ */
+static void run_once(struct emulator *emu, uint64_t stop_cycle)
+{
+    struct gigatron_state *gs;
 
-        /* To prevent infinite loops here. */
-        max_cycles = gs->num_cycles + 1000000;
-        while (gs->num_cycles < max_cycles) {
-            gigatron_step(gs);
+    gs = &emu->be.gs;
+    emu->stop_cycle = stop_cycle;
+    if (emu->movie) {
+        if (emu->movie->recording) {
+            gigatron_movie_input(emu->movie, gs->num_cycles, gs->in);
+        } else {
+            /* The movie overrides the keyboard, and the frames are
+             * cut at the cycles where the input changes.
+             */
+            if (gs->num_cycles >= emu->movie->end_cycle) {
+                emu->is_running = FALSE;
+                return;
+            }
+            gs->in = gigatron_movie_next(emu->movie, gs->num_cycles);
+            if (emu->stop_cycle > gigatron_movie_stop_cycle(emu->movie))
+                emu->stop_cycle = gigatron_movie_stop_cycle(emu->movie);
+        }
+    }
+
+    /* Only the reference core is instrumented. */
+    if (emu->instrumented) {
+        run_frame(emu, TRUE, TRUE, FALSE);
+    } else if (emu->fast_forward) {
+        run_frame(emu, FALSE, TRUE, TRUE);
+    } else if (emu->native) {
+        run_frame(emu, FALSE, TRUE, FALSE);
+    } else {
+        run_frame(emu, FALSE, FALSE, FALSE);
+    }
+
+    process_input_events(emu);
+}
+
+/* Hooks of the automation server. */
+static void server_run_cycles(void *arg, uint64_t num_cycles)
+{
+    struct emulator *emu;
+    uint64_t stop_cycle;
+
+    emu = (struct emulator *) arg;
+    stop_cycle = emu->be.gs.num_cycles + num_cycles;
+    while (emu->is_running && emu->be.gs.num_cycles < stop_cycle)
+        run_once(emu, stop_cycle);
+}
 
-            update_pixels(emu);
-            update_audio(emu);
-            if (update_screen(emu))
-                break;
+static void server_run_frames(void *arg, uint32_t num_frames)
+{
+    struct emulator *emu;
+    uint32_t stop_frame;
+
+    emu = (struct emulator *) arg;
+    stop_frame = emu->frame_count + num_frames;
+    while (emu->is_running && emu->frame_count != stop_frame)
+        run_once(emu, UINT64_MAX);
+}
+
+static void server_reset(void *arg)
+{
+    reset_emulator((struct emulator *) arg);
+}
+
+static void server_quit(void *arg)
+{
+    ((struct emulator *) arg)->is_running = FALSE;
+}
+
+static void main_loop(struct emulator *emu)
+{
+    reset_emulator(emu);
+    emu->is_running = TRUE;
+
+    while (emu->is_running) {
+        if (!emu->server) {
+            run_once(emu, UINT64_MAX);
+            continue;
         }
 
+        /* The clients run the emulation, and the window only needs
+         * its events processed in between.
+         */
+        if (!gigatron_server_poll(emu->server, (emu->headless) ? -1 : 16))
+            break;
         process_input_events(emu);
     }
 }
 
-static int run_emulator(const char *rom_filename)
+/* Deallocates the instrumentation of the emulator. */
+static void destroy_instrumentation(struct emulator *emu)
+{
+    if (emu->trace) {
+        gigatron_trace_destroy(emu->trace);
+        free(emu->trace);
+        emu->trace = NULL;
+    }
+
+    if (emu->profile) {
+        gigatron_profile_destroy(emu->profile);
+        free(emu->profile);
+        emu->profile = NULL;
+    }
+
+    if (emu->vprofile) {
+        free(emu->vprofile);
+        emu->vprofile = NULL;
+    }
+
+    if (emu->memprof) {
+        gigatron_memprof_destroy(emu->memprof);
+        free(emu->memprof);
+        emu->memprof = NULL;
+    }
+
+    if (emu->debugger) {
+        free(emu->debugger);
+        emu->debugger = NULL;
+    }
+    emu->instrumented = FALSE;
+}
+
+/* Arms the breakpoints and watchpoints of the command line.
+ * On success, this function returns TRUE.
+ */
+static int add_breakpoints(struct gigatron_debugger *dbg,
+                           const struct options *opts)
+{
+    int i;
+
+    for (i = 0; i < opts->num_debug_args; i++) {
+        const char *opt, *arg;
+        uint16_t addr;
+        char *p;
+
+        opt = opts->debug_args[i][0];
+        arg = opts->debug_args[i][1];
+        if (strcmp(opt, "--break-if") == 0) {
+            if (!gigatron_debug_parse_condition(dbg, arg))
+                return FALSE;
+            continue;
+        }
+
+        addr = (uint16_t) strtoul(arg, &p, 0);
+        if (p == arg) {
+            fprintf(stderr, "invalid address `%s`\n", arg);
+            return FALSE;
+        }
+
+        if (strcmp(opt, "--break") == 0) {
+            gigatron_debug_break(dbg, addr, TRUE);
+        } else if (strcmp(opt, "--vbreak") == 0) {
+            if (!gigatron_debug_vbreak(dbg, addr, TRUE))
+                return FALSE;
+        } else {
+            uint8_t flags;
+
+            /* --watch <address>[:r|:w|:rw] */
+            flags = DEBUG_WATCH_READ | DEBUG_WATCH_WRITE;
+            if (strcmp(p, ":r") == 0) {
+                flags = DEBUG_WATCH_READ;
+            } else if (strcmp(p, ":w") == 0) {
+                flags = DEBUG_WATCH_WRITE;
+            } else if (*p != '\0' && strcmp(p, ":rw") != 0) {
+                fprintf(stderr, "invalid watchpoint `%s`\n", arg);
+                return FALSE;
+            }
+            gigatron_debug_watch(dbg, addr, flags, TRUE);
+        }
+    }
+    return TRUE;
+}
+
+/* Sets up the instrumentation requested in `opts`.
+ * On success, this function returns TRUE.
+ */
+static int create_instrumentation(struct emulator *emu,
+                                  const struct options *opts)
+{
+    emu->instrumented = FALSE;
+    emu->trace = NULL;
+    emu->profile = NULL;
+    emu->vprofile = NULL;
+    emu->memprof = NULL;
+    emu->debugger = NULL;
+
+    if (opts->trace_filename) {
+        emu->trace = malloc(sizeof(*emu->trace));
+        if (!emu->trace) {
+            fprintf(stderr, "memory exhausted\n");
+            return FALSE;
+        }
+
+        if (!gigatron_trace_create(emu->trace, 0, TRACE_EVENT_CYCLE)) {
+            free(emu->trace);
+            emu->trace = NULL;
+            return FALSE;
+        }
+
+        emu->instrumented = TRUE;
+        if (!gigatron_trace_stream(emu->trace, opts->trace_filename))
+            goto fail_instrumentation;
+    }
+
+    if (opts->profile_filename || opts->profile_frames_filename) {
+        emu->profile = malloc(sizeof(*emu->profile));
+        if (!emu->profile) {
+            fprintf(stderr, "memory exhausted\n");
+            goto fail_instrumentation;
+        }
+
+        if (!gigatron_profile_create(emu->profile, emu->be.gs.rom,
+                                     PROFILE_HISTORY_FRAMES)) {
+            free(emu->profile);
+            emu->profile = NULL;
+            goto fail_instrumentation;
+        }
+
+        emu->instrumented = TRUE;
+        gigatron_profile_classify(emu->profile, emu->be.gs.rom,
+                                  opts->vcpu_dispatch);
+        if (opts->symbols_filename) {
+            if (!gigatron_profile_load_symbols(emu->profile,
+                                               opts->symbols_filename))
+                goto fail_instrumentation;
+        }
+    }
+
+    if (opts->vprofile_filename) {
+        emu->vprofile = malloc(sizeof(*emu->vprofile));
+        if (!emu->vprofile) {
+            fprintf(stderr, "memory exhausted\n");
+            goto fail_instrumentation;
+        }
+
+        emu->instrumented = TRUE;
+        if (!gigatron_vprofile_create(emu->vprofile, emu->be.gs.rom,
+                                      opts->vcpu_dispatch))
+            goto fail_instrumentation;
+
+        if (opts->gt1_filename) {
+            if (!gigatron_vprofile_load_gt1(emu->vprofile,
+                                            opts->gt1_filename))
+                goto fail_instrumentation;
+        }
+    }
+
+    if (opts->memprof_filename) {
+        emu->memprof = malloc(sizeof(*emu->memprof));
+        if (!emu->memprof) {
+            fprintf(stderr, "memory exhausted\n");
+            goto fail_instrumentation;
+        }
+
+        if (!gigatron_memprof_create(emu->memprof,
+                                     MEMPROF_HISTORY_FRAMES)) {
+            free(emu->memprof);
+            emu->memprof = NULL;
+            goto fail_instrumentation;
+        }
+        emu->instrumented = TRUE;
+    }
+
+    if (opts->num_debug_args > 0) {
+        emu->debugger = malloc(sizeof(*emu->debugger));
+        if (!emu->debugger) {
+            fprintf(stderr, "memory exhausted\n");
+            goto fail_instrumentation;
+        }
+
+        gigatron_debug_create(emu->debugger, emu->be.gs.rom,
+                              opts->vcpu_dispatch);
+        emu->instrumented = TRUE;
+        if (!add_breakpoints(emu->debugger, opts))
+            goto fail_instrumentation;
+    }
+
+    return TRUE;
+
+fail_instrumentation:
+    destroy_instrumentation(emu);
+    return FALSE;
+}
+
+/* Writes the outputs of the profilers. */
+static void write_profiles(const struct emulator *emu,
+                           const struct options *opts)
+{
+    FILE *fp;
+
+    if (emu->memprof) {
+        gigatron_memprof_save(emu->memprof, opts->memprof_filename,
+                              emu->be.gs.ram_size);
+        gigatron_memprof_report(emu->memprof, stderr, 20);
+    }
+
+    if (emu->vprofile) {
+        fp = fopen(opts->vprofile_filename, "w");
+        if (!fp) {
+            fprintf(stderr, "could not open file `%s` for writing\n",
+                    opts->vprofile_filename);
+        } else {
+            if (!gigatron_vprofile_write_folded(emu->vprofile, fp))
+                fprintf(stderr, "could not write vCPU profile\n");
+            fclose(fp);
+        }
+
+        gigatron_vprofile_report(emu->vprofile, stderr, 20);
+    }
+
+    if (!emu->profile) return;
+
+    if (opts->profile_filename) {
+        fp = fopen(opts->profile_filename, "w");
+        if (!fp) {
+            fprintf(stderr, "could not open file `%s` for writing\n",
+                    opts->profile_filename);
+        } else {
+            if (!gigatron_profile_write_folded(emu->profile, fp))
+                fprintf(stderr, "could not write profile\n");
+            fclose(fp);
+        }
+    }
+
+    if (opts->profile_frames_filename) {
+        fp = fopen(opts->profile_frames_filename, "w");
+        if (!fp) {
+            fprintf(stderr, "could not open file `%s` for writing\n",
+                    opts->profile_frames_filename);
+        } else {
+            if (!gigatron_profile_write_frames(emu->profile, fp))
+                fprintf(stderr, "could not write profile frames\n");
+            fclose(fp);
+        }
+    }
+
+    gigatron_profile_report(emu->profile, stderr, 20);
+}
+
+/* Creates the window, the renderer and the texture.
+ * On success, this function returns TRUE.
+ */
+static int open_display(struct emulator *emu)
+{
+    emu->win = SDL_CreateWindow("Gigatron TTL",
+                                SDL_WINDOWPOS_CENTERED,
+                                SDL_WINDOWPOS_CENTERED,
+                                WIDTH + BORDER,
+                                HEIGHT + BORDER,
+                                0);
+    if (!emu->win) {
+        fprintf(stderr, "unable to create window: %s\n",
+                SDL_GetError());
+        return FALSE;
+    }
+
+    /* When unthrottled, the presentation must not wait either. */
+    emu->renderer = SDL_CreateRenderer(emu->win,
+                                       -1,
+                                       (emu->unthrottled) ? 0
+                                       : SDL_RENDERER_PRESENTVSYNC);
+    if (!emu->renderer) {
+        fprintf(stderr, "unable to create renderer: %s\n",
+                SDL_GetError());
+        return FALSE;
+    }
+
+    emu->texture = SDL_CreateTexture(emu->renderer,
+                                     SDL_PIXELFORMAT_ARGB8888,
+                                     SDL_TEXTUREACCESS_STATIC,
+                                     WIDTH, HEIGHT);
+    if (!emu->texture) {
+        fprintf(stderr, "unable to create texture: %s\n",
+                SDL_GetError());
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* Opens the audio device.
+ * On success, this function returns TRUE.
+ */
+static int open_audio(struct emulator *emu)
+{
+    memset(&emu->audio_spec, 0, sizeof(emu->audio_spec));
+    emu->audio_spec.freq = 32000;
+    emu->audio_spec.format = AUDIO_U8;
+    emu->audio_spec.channels = 1;
+    emu->audio_spec.samples = 2048;
+    emu->audio_spec.callback = audio_callback;
+    emu->audio_spec.userdata = &emu->afifo;
+    emu->audio_dev_id = SDL_OpenAudioDevice(NULL,
+                                            0,
+                                            &emu->audio_spec,
+                                            NULL,
+                                            SDL_AUDIO_ALLOW_ANY_CHANGE);
+    if (emu->audio_dev_id == 0) {
+        fprintf(stderr, "unable to open audio: %s\n",
+                SDL_GetError());
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* Opens the movie requested in `opts`.
+ * On success, this function returns TRUE.
+ */
+static int open_movie(struct emulator *emu, struct gigatron_movie *mv,
+                      const struct options *opts)
+{
+    uint64_t rom_hash;
+
+    rom_hash = emu->be.gs.rom_image->hash;
+    if (opts->record_movie_filename) {
+        if (!gigatron_movie_record(mv, opts->record_movie_filename,
+                                   rom_hash))
+            return FALSE;
+    } else {
+        if (!gigatron_movie_replay(mv, opts->replay_movie_filename,
+                                   rom_hash))
+            return FALSE;
+    }
+    emu->movie = mv;
+    return TRUE;
+}
+
+/* Closes the movie, writing the final state (when recording) or
+ * comparing it with the movie (when replaying). Returns FALSE if the
+ * movie could not be written or if the replay diverged.
+ */
+static int finish_movie(struct emulator *emu)
+{
+    struct gigatron_movie *mv;
+    const struct gigatron_state *gs;
+    unsigned long long cycle;
+    int ok;
+
+    mv = emu->movie;
+    emu->movie = NULL;
+    gs = &emu->be.gs;
+    gigatron_backend_ram(&emu->be);
+    if (mv->recording)
+        return gigatron_movie_close(mv, gs);
+
+    ok = TRUE;
+    cycle = (unsigned long long) gs->num_cycles;
+    if (mv->end_cycle == UINT64_MAX) {
+        fprintf(stderr, "replayed %llu cycles (the movie has no end)\n",
+                cycle);
+    } else if (gs->num_cycles != mv->end_cycle) {
+        fprintf(stderr, "replay stopped at cycle %llu, before the end of "
+                "the movie (%llu)\n", cycle,
+                (unsigned long long) mv->end_cycle);
+    } else if (gigatron_movie_state_hash(gs) != mv->state_hash) {
+        fprintf(stderr, "replay diverged: the state at cycle %llu does "
+                "not match the movie\n", cycle);
+        ok = FALSE;
+    } else {
+        fprintf(stderr, "replay matches the movie (%llu cycles)\n", cycle);
+    }
+    return gigatron_movie_close(mv, NULL) && ok;
+}
+
+static int run_emulator(const struct options *opts)
 {
+    const struct gigatron_backend_ops *ops;
     struct emulator emu;
+    struct gigatron_stats stats;
+    struct gigatron_shm shm;
+    struct gigatron_dirty dirty;
+    struct gigatron_recorder recorder;
+    struct gigatron_hash_stream hashes;
+    struct gigatron_movie movie;
+    struct gigatron_server server;
+    struct gigatron_server_hooks hooks;
     int ret = FALSE;
 
     emu.win = NULL;
@@ -406,47 +1278,71 @@ static int run_emulator(const char *rom_filename)
     emu.texture = NULL;
     emu.pixels = NULL;
     emu.audio_dev_id = 0;
+    emu.shm = NULL;
+    emu.recorder = NULL;
+    emu.hashes = NULL;
+    emu.movie = NULL;
+    emu.server = NULL;
+    emu.failed = FALSE;
+
+    emu.headless = opts->headless;
+    /* The clients of the automation server set the pace. */
+    emu.unthrottled = opts->unthrottled || (opts->socket_path != NULL);
+    emu.fast_forward = opts->fast_forward;
+    emu.max_frames = opts->max_frames;
+
+    emu.stats = NULL;
+    emu.overlay = opts->overlay;
+    emu.stats_log = (opts->stats_interval > 0);
+    emu.stats_interval = (opts->stats_interval > 0)
+        ? opts->stats_interval : STATS_DEFAULT_INTERVAL;
+    if (emu.overlay || emu.stats_log)
+        emu.stats = &stats;
+
+    ops = gigatron_backend_find(opts->backend_name);
+    if (!ops) {
+        fprintf(stderr, "unknown backend `%s`\n", opts->backend_name);
+        return FALSE;
+    }
 
-    if (!gigatron_create(&emu.gs, rom_filename, 65536)) {
+    if (!gigatron_backend_create(&emu.be, ops, opts->rom_filename, 65536)) {
         return FALSE;
     }
+    emu.native = (ops == gigatron_backend_get(0));
 
-    if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO) != 0) {
-        fprintf(stderr, "unable to initialize SDL: %s\n",
-                SDL_GetError());
-        gigatron_destroy(&emu.gs);
+    if (!create_instrumentation(&emu, opts)) {
+        gigatron_backend_destroy(&emu.be);
         return FALSE;
     }
 
-    emu.win = SDL_CreateWindow("Gigatron TTL",
-                               SDL_WINDOWPOS_CENTERED,
-                               SDL_WINDOWPOS_CENTERED,
-                               WIDTH + BORDER,
-                               HEIGHT + BORDER,
-                               0);
-    if (!emu.win) {
-        fprintf(stderr, "unable to create window: %s\n",
-                SDL_GetError());
-        goto fail_run;
+    if (emu.instrumented && !emu.native) {
+        fprintf(stderr, "the instrumentation requires the `%s` backend\n",
+                gigatron_backend_get(0)->name);
+        destroy_instrumentation(&emu);
+        gigatron_backend_destroy(&emu.be);
+        return FALSE;
     }
 
-    emu.renderer = SDL_CreateRenderer(emu.win,
-                                      -1,
-                                      SDL_RENDERER_PRESENTVSYNC);
-    if (!emu.renderer) {
-        fprintf(stderr, "unable to create renderer: %s\n",
-                SDL_GetError());
-        goto fail_run;
+    /* The instrumentation must see every cycle. */
+    if (emu.fast_forward && (emu.instrumented || !emu.native)) {
+        fprintf(stderr, "`--fast-forward` requires the `%s` backend, "
+                "without instrumentation\n", gigatron_backend_get(0)->name);
+        destroy_instrumentation(&emu);
+        gigatron_backend_destroy(&emu.be);
+        return FALSE;
     }
 
-    emu.texture = SDL_CreateTexture(emu.renderer,
-                                    SDL_PIXELFORMAT_ARGB8888,
-                                    SDL_TEXTUREACCESS_STATIC,
-                                    WIDTH, HEIGHT);
-    if (!emu.texture) {
-        fprintf(stderr, "unable to create texture: %s\n",
-                SDL_GetError());
-        goto fail_run;
+    if (!emu.headless) {
+        if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO) != 0) {
+            fprintf(stderr, "unable to initialize SDL: %s\n",
+                    SDL_GetError());
+            destroy_instrumentation(&emu);
+            gigatron_backend_destroy(&emu.be);
+            return FALSE;
+        }
+
+        if (!open_display(&emu))
+            goto fail_run;
     }
 
     emu.pixels = malloc(WIDTH * HEIGHT * sizeof(uint32_t));
@@ -454,43 +1350,112 @@ static int run_emulator(const char *rom_filename)
         fprintf(stderr, "memory exhausted for pixel buffer\n");
         goto fail_run;
     }
+    memset(emu.pixels, 0, WIDTH * HEIGHT * sizeof(uint32_t));
+
+    if (opts->shm_name) {
+        if (!gigatron_shm_create(&shm, opts->shm_name, emu.be.gs.ram_size,
+                                 WIDTH, HEIGHT))
+            goto fail_run;
+        emu.shm = &shm;
+
+        /* Only the pages written since the last frame are copied. */
+        if (!gigatron_dirty_init(&dirty, emu.be.gs.ram_size,
+                                 DIRTY_PAGE_SHIFT))
+            goto fail_run;
+        emu.be.gs.dirty = &dirty;
+    }
+
+    if (opts->record_video_filename || opts->record_audio_filename) {
+        if (!gigatron_recorder_create(&recorder,
+                                      opts->record_video_filename,
+                                      opts->record_audio_filename,
+                                      WIDTH, HEIGHT, RECORD_QUEUE_FRAMES))
+            goto fail_run;
+        emu.recorder = &recorder;
+    }
+
+    if (opts->hash_filename || opts->golden_filename) {
+        if (!gigatron_hash_open(&hashes, opts->hash_filename,
+                                opts->golden_filename,
+                                HASH_FRAME
+                                | ((opts->hash_ram) ? HASH_RAM : 0)))
+            goto fail_run;
+        emu.hashes = &hashes;
+    }
+
+    if (opts->record_movie_filename || opts->replay_movie_filename) {
+        if (!open_movie(&emu, &movie, opts))
+            goto fail_run;
+    }
+
+    if (opts->socket_path) {
+        hooks.arg = &emu;
+        hooks.run_cycles = &server_run_cycles;
+        hooks.run_frames = &server_run_frames;
+        hooks.reset = &server_reset;
+        hooks.quit = &server_quit;
+        if (!gigatron_server_create(&server, opts->socket_path, &emu.be,
+                                    emu.shm, emu.pixels, &emu.frame_count,
+                                    &hooks))
+            goto fail_run;
+        emu.server = &server;
+    }
 
-    /* Open the audio device. */
     emu.afifo.data = emu.abuf;
     emu.afifo.start = emu.afifo.end = emu.afifo._end = 0;
     emu.afifo.size = sizeof(emu.abuf);
+    emu.afifo.underruns = emu.afifo.dropped = 0;
 
-    memset(&emu.audio_spec, 0, sizeof(emu.audio_spec));
-    emu.audio_spec.freq = 32000;
-    emu.audio_spec.format = AUDIO_U8;
-    emu.audio_spec.channels = 1;
-    emu.audio_spec.samples = 2048;
-    emu.audio_spec.callback = audio_callback;
-    emu.audio_spec.userdata = &emu.afifo;
-    emu.audio_dev_id = SDL_OpenAudioDevice(NULL,
-                                           0,
-                                           &emu.audio_spec,
-                                           NULL,
-                                           SDL_AUDIO_ALLOW_ANY_CHANGE);
-    if (emu.audio_dev_id == 0) {
-        fprintf(stderr, "unable to open audio: %s\n",
-                SDL_GetError());
-        goto fail_run;
-    }
+    if (!emu.headless) {
+        if (!open_audio(&emu))
+            goto fail_run;
 
-    SDL_StartTextInput();
+        SDL_StartTextInput();
 
-    SDL_PauseAudioDevice(emu.audio_dev_id, 0);
+        SDL_PauseAudioDevice(emu.audio_dev_id, 0);
+    }
 
     main_loop(&emu);
-    ret = TRUE;
+    write_profiles(&emu, opts);
+    ret = !emu.failed;
+    if (emu.movie && !finish_movie(&emu))
+        ret = FALSE;
 
 exit_emu:
-    SDL_StopTextInput();
+    if (emu.server) {
+        fprintf(stderr, "served %llu requests (%llu commands)\n",
+                (unsigned long long) server.requests,
+                (unsigned long long) server.commands_run);
+        gigatron_server_destroy(emu.server);
+    }
+
+    if (emu.movie)
+        gigatron_movie_close(emu.movie, NULL);
+
+    if (emu.hashes) {
+        if (!gigatron_hash_close(emu.hashes)) {
+            fprintf(stderr, "could not write the hash stream\n");
+            ret = FALSE;
+        }
+    }
+
+    if (emu.recorder) {
+        if (!gigatron_recorder_destroy(emu.recorder))
+            ret = FALSE;
+        fprintf(stderr, "recorded %llu frames (%llu waits for the "
+                "writer)\n", (unsigned long long) recorder.frames,
+                (unsigned long long) recorder.stalls);
+    }
+
+    if (!emu.headless)
+        SDL_StopTextInput();
 
     if (emu.audio_dev_id != 0)
         SDL_CloseAudioDevice(emu.audio_dev_id);
 
+    if (emu.shm)
+        gigatron_shm_destroy(emu.shm);
+
     if (emu.pixels)
         free(emu.pixels);
 
@@ -503,9 +1468,11 @@ exit_emu:
     if (emu.win)
         SDL_DestroyWindow(emu.win);
 
-    SDL_Quit();
+    if (!emu.headless)
+        SDL_Quit();
 
-    gigatron_destroy(&emu.gs);
+    destroy_instrumentation(&emu);
+    gigatron_backend_destroy(&emu.be);
     return ret;
 
 fail_run:
@@ -516,27 +1483,292 @@ fail_run:
 
 static void print_help(const char *prog_name)
 {
+    const struct gigatron_backend_ops *ops;
+    uint32_t i;
+
     printf("usage:\n");
-    printf("%s [-h | --help] <rom_filename>\n", prog_name);
+    printf("%s [options] <rom_filename>\n", prog_name);
+    printf("options:\n");
+    printf("  -h, --help          print this help\n");
+    printf("  --backend <name>    CPU backend (default: %s)\n",
+           gigatron_backend_get(0)->name);
+    printf("  --trace <filename>  record a binary trace of every cycle\n");
+    printf("  --profile <filename>\n");
+    printf("                      profile the ROM code (folded stacks)\n");
+    printf("  --profile-frames <filename>\n");
+    printf("                      write the cycles per frame (CSV)\n");
+    printf("  --symbols <filename>\n");
+    printf("                      names and categories of the ROM "
+           "routines\n");
+    printf("  --vcpu-profile <filename>\n");
+    printf("                      profile the vCPU code (folded stacks)\n");
+    printf("  --gt1 <filename>    GT1 program with the vCPU segments\n");
+    printf("  --vcpu-dispatch <address>\n");
+    printf("                      ROM address of the vCPU dispatch\n");
+    printf("  --memprof <filename>\n");
+    printf("                      record a heatmap of the RAM traffic\n");
+    printf("  --shm <name>        publish the state in shared memory\n");
+    printf("  --record-video <filename>\n");
+    printf("                      record the video (Y4M if it ends in "
+           ".y4m, raw\n"
+           "                      RGB24 otherwise, or piped to "
+           "\"|command\")\n");
+    printf("  --record-audio <filename>\n");
+    printf("                      record the audio (WAV)\n");
+    printf("  --headless          run without window and sound\n");
+    printf("  --unthrottled       run as fast as possible\n");
+    printf("  --fast-forward      skip the idle loops\n");
+    printf("  --frames <n>        stop after n frames\n");
+    printf("  --hash <filename>   write a hash of every frame\n");
+    printf("  --golden <filename>\n");
+    printf("                      compare the hashes with a golden "
+           "stream\n");
+    printf("  --hash-ram          hash the RAM as well\n");
+    printf("  --record-movie <filename>\n");
+    printf("                      record the changes of the input\n");
+    printf("  --replay-movie <filename>\n");
+    printf("                      replay the input of a movie, and check "
+           "the final\n"
+           "                      state\n");
+    printf("  --socket <path>     serve the automation protocol on a "
+           "Unix socket\n");
+    printf("  --overlay           show the performance statistics\n");
+    printf("  --stats <ms>        log the performance statistics "
+           "periodically\n");
+    printf("  --break <address>   stop at a ROM address\n");
+    printf("  --break-if <address>:<reg><cmp><value>\n");
+    printf("                      stop at a ROM address if a register "
+           "(acc, x, y,\n"
+           "                      out or in) compares (==, !=, <, >) "
+           "with a value\n");
+    printf("  --vbreak <address>  stop at a vCPU address\n");
+    printf("  --watch <address>[:r|:w|:rw]\n");
+    printf("                      stop at the reads and/or writes of a "
+           "RAM address\n");
+    printf("backends:\n");
+    for (i = 0; (ops = gigatron_backend_get(i)) != NULL; i++)
+        printf("  %-19s %s\n", ops->name, ops->description);
 }
 
 int main(int argc, char **argv)
 {
-    char *rom_filename = "../data/ROMv5a.rom";
+    struct options opts;
     int i;
 
+    opts.rom_filename = "../data/ROMv5a.rom";
+    opts.backend_name = gigatron_backend_get(0)->name;
+    opts.trace_filename = NULL;
+    opts.profile_filename = NULL;
+    opts.profile_frames_filename = NULL;
+    opts.symbols_filename = NULL;
+    opts.vprofile_filename = NULL;
+    opts.gt1_filename = NULL;
+    opts.vcpu_dispatch = 0;
+    opts.memprof_filename = NULL;
+    opts.shm_name = NULL;
+    opts.record_video_filename = NULL;
+    opts.record_audio_filename = NULL;
+    opts.headless = FALSE;
+    opts.unthrottled = FALSE;
+    opts.fast_forward = FALSE;
+    opts.max_frames = 0;
+    opts.hash_filename = NULL;
+    opts.golden_filename = NULL;
+    opts.hash_ram = FALSE;
+    opts.record_movie_filename = NULL;
+    opts.replay_movie_filename = NULL;
+    opts.socket_path = NULL;
+    opts.num_debug_args = 0;
+    opts.overlay = FALSE;
+    opts.stats_interval = 0;
+
     for (i = 1; i < argc; i++) {
         if ((strcmp("--help", argv[i]) == 0)
             || (strcmp("-h", argv[i]) == 0)) {
 
             print_help(argv[0]);
             return 0;
+        } else if (strcmp("--trace", argv[i]) == 0) {
+            if (++i == argc) {
+                fprintf(stderr, "missing argument for `--trace`\n");
+                return 1;
+            }
+            opts.trace_filename = argv[i];
+            continue;
+        } else if (strcmp("--profile", argv[i]) == 0) {
+            if (++i == argc) {
+                fprintf(stderr, "missing argument for `--profile`\n");
+                return 1;
+            }
+            opts.profile_filename = argv[i];
+            continue;
+        } else if (strcmp("--profile-frames", argv[i]) == 0) {
+            if (++i == argc) {
+                fprintf(stderr,
+                        "missing argument for `--profile-frames`\n");
+                return 1;
+            }
+            opts.profile_frames_filename = argv[i];
+            continue;
+        } else if (strcmp("--symbols", argv[i]) == 0) {
+            if (++i == argc) {
+                fprintf(stderr, "missing argument for `--symbols`\n");
+                return 1;
+            }
+            opts.symbols_filename = argv[i];
+            continue;
+        } else if (strcmp("--vcpu-profile", argv[i]) == 0) {
+            if (++i == argc) {
+                fprintf(stderr,
+                        "missing argument for `--vcpu-profile`\n");
+                return 1;
+            }
+            opts.vprofile_filename = argv[i];
+            continue;
+        } else if (strcmp("--gt1", argv[i]) == 0) {
+            if (++i == argc) {
+                fprintf(stderr, "missing argument for `--gt1`\n");
+                return 1;
+            }
+            opts.gt1_filename = argv[i];
+            continue;
+        } else if (strcmp("--vcpu-dispatch", argv[i]) == 0) {
+            if (++i == argc) {
+                fprintf(stderr,
+                        "missing argument for `--vcpu-dispatch`\n");
+                return 1;
+            }
+            opts.vcpu_dispatch = (uint16_t) strtoul(argv[i], NULL, 0);
+            continue;
+        } else if (strcmp("--memprof", argv[i]) == 0) {
+            if (++i == argc) {
+                fprintf(stderr, "missing argument for `--memprof`\n");
+                return 1;
+            }
+            opts.memprof_filename = argv[i];
+            continue;
+        } else if (strcmp("--shm", argv[i]) == 0) {
+            if (++i == argc) {
+                fprintf(stderr, "missing argument for `--shm`\n");
+                return 1;
+            }
+            opts.shm_name = argv[i];
+            continue;
+        } else if (strcmp("--record-video", argv[i]) == 0) {
+            if (++i == argc) {
+                fprintf(stderr,
+                        "missing argument for `--record-video`\n");
+                return 1;
+            }
+            opts.record_video_filename = argv[i];
+            continue;
+        } else if (strcmp("--record-audio", argv[i]) == 0) {
+            if (++i == argc) {
+                fprintf(stderr,
+                        "missing argument for `--record-audio`\n");
+                return 1;
+            }
+            opts.record_audio_filename = argv[i];
+            continue;
+        } else if (strcmp("--headless", argv[i]) == 0) {
+            opts.headless = TRUE;
+            continue;
+        } else if (strcmp("--unthrottled", argv[i]) == 0) {
+            opts.unthrottled = TRUE;
+            continue;
+        } else if (strcmp("--fast-forward", argv[i]) == 0) {
+            opts.fast_forward = TRUE;
+            continue;
+        } else if (strcmp("--frames", argv[i]) == 0) {
+            if (++i == argc) {
+                fprintf(stderr, "missing argument for `--frames`\n");
+                return 1;
+            }
+            opts.max_frames = (uint32_t) strtoul(argv[i], NULL, 0);
+            continue;
+        } else if (strcmp("--hash", argv[i]) == 0) {
+            if (++i == argc) {
+                fprintf(stderr, "missing argument for `--hash`\n");
+                return 1;
+            }
+            opts.hash_filename = argv[i];
+            continue;
+        } else if (strcmp("--golden", argv[i]) == 0) {
+            if (++i == argc) {
+                fprintf(stderr, "missing argument for `--golden`\n");
+                return 1;
+            }
+            opts.golden_filename = argv[i];
+            continue;
+        } else if (strcmp("--record-movie", argv[i]) == 0) {
+            if (++i == argc) {
+                fprintf(stderr, "missing argument for `--record-movie`\n");
+                return 1;
+            }
+            opts.record_movie_filename = argv[i];
+            continue;
+        } else if (strcmp("--replay-movie", argv[i]) == 0) {
+            if (++i == argc) {
+                fprintf(stderr, "missing argument for `--replay-movie`\n");
+                return 1;
+            }
+            opts.replay_movie_filename = argv[i];
+            continue;
+        } else if (strcmp("--socket", argv[i]) == 0) {
+            if (++i == argc) {
+                fprintf(stderr, "missing argument for `--socket`\n");
+                return 1;
+            }
+            opts.socket_path = argv[i];
+            continue;
+        } else if (strcmp("--backend", argv[i]) == 0) {
+            if (++i == argc) {
+                fprintf(stderr, "missing argument for `--backend`\n");
+                return 1;
+            }
+            opts.backend_name = argv[i];
+            continue;
+        } else if (strcmp("--hash-ram", argv[i]) == 0) {
+            opts.hash_ram = TRUE;
+            continue;
+        } else if (strcmp("--overlay", argv[i]) == 0) {
+            opts.overlay = TRUE;
+            continue;
+        } else if (strcmp("--stats", argv[i]) == 0) {
+            if (++i == argc) {
+                fprintf(stderr, "missing argument for `--stats`\n");
+                return 1;
+            }
+            opts.stats_interval = (uint32_t) strtoul(argv[i], NULL, 0);
+            continue;
+        } else if (strcmp("--break", argv[i]) == 0
+                   || strcmp("--break-if", argv[i]) == 0
+                   || strcmp("--vbreak", argv[i]) == 0
+                   || strcmp("--watch", argv[i]) == 0) {
+            if (i + 1 == argc) {
+                fprintf(stderr, "missing argument for `%s`\n", argv[i]);
+                return 1;
+            }
+            if (opts.num_debug_args == MAX_DEBUG_ARGS) {
+                fprintf(stderr, "too many breakpoints\n");
+                return 1;
+            }
+            opts.debug_args[opts.num_debug_args][0] = argv[i];
+            opts.debug_args[opts.num_debug_args][1] = argv[i + 1];
+            opts.num_debug_args++;
+            i++;
+            continue;
         }
 
-        rom_filename = argv[i];
+        opts.rom_filename = argv[i];
+    }
+
+    if (opts.record_movie_filename && opts.replay_movie_filename) {
+        fprintf(stderr, "cannot record and replay a movie at once\n");
+        return 1;
     }
 
-    if (!run_emulator(rom_filename))
+    if (!run_emulator(&opts))
         return 1;
 
     return 0;
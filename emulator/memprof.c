@@ -0,0 +1,295 @@
+/* Memory-traffic profiler (RAM access heatmap). */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "byteorder.h"
+#include "memprof.h"
+
+/* Names of the addressing modes (in the order of `memprof_mode`). */
+static const char *mode_name[MEMPROF_NUM_MODES] = {
+    "[D]", "[X]", "[Y,D]", "[Y,X]", "[Y,X++]"
+};
+
+/* An address (or page) and its traffic, used for sorting. */
+struct traffic_count {
+    uint32_t addr;
+    uint64_t reads;
+    uint64_t writes;
+};
+
+/* Addressing mode of each `mod` field (for the RAM accesses). */
+static const uint8_t mod_mode[8] = {
+    MEMPROF_MODE_D, MEMPROF_MODE_X, MEMPROF_MODE_Y_D, MEMPROF_MODE_Y_X,
+    MEMPROF_MODE_D, MEMPROF_MODE_D, MEMPROF_MODE_D, MEMPROF_MODE_Y_XINC
+};
+
+void gigatron_memprof_decode(uint8_t *access)
+{
+    uint32_t opc;
+
+    /* The stores write to memory, the other instructions read it
+     * when the bus is RAM, and the branches always use the address
+     * [D] (as done by `gigatron_step()`).
+     */
+    for (opc = 0; opc < 256; opc++) {
+        uint32_t ins, mod, bus;
+
+        ins = (opc >> 5) & 0x07;
+        mod = (opc >> 2) & 0x07;
+        bus = opc & 0x03;
+
+        access[opc] = 0;
+        if (ins == 7) {
+            if (bus == 1)
+                access[opc] = MEMPROF_READ
+                    | (MEMPROF_MODE_D << MEMPROF_MODE_SHIFT);
+        } else if (ins == 6) {
+            access[opc] = MEMPROF_WRITE
+                | (mod_mode[mod] << MEMPROF_MODE_SHIFT);
+        } else if (bus == 1) {
+            access[opc] = MEMPROF_READ
+                | (mod_mode[mod] << MEMPROF_MODE_SHIFT);
+        }
+    }
+}
+
+int gigatron_memprof_create(struct gigatron_memprof *mp,
+                            uint32_t max_frames)
+{
+    gigatron_memprof_decode(mp->access);
+
+    memset(mp->reads, 0, sizeof(mp->reads));
+    memset(mp->writes, 0, sizeof(mp->writes));
+    memset(mp->page_reads, 0, sizeof(mp->page_reads));
+    memset(mp->page_writes, 0, sizeof(mp->page_writes));
+    memset(&mp->frame, 0, sizeof(mp->frame));
+
+    mp->max_frames = max_frames;
+    mp->num_frames = 0;
+    mp->frames = NULL;
+
+    if (max_frames > 0) {
+        mp->frames = malloc(((size_t) max_frames) * sizeof(*mp->frames));
+        if (!mp->frames) {
+            fprintf(stderr, "memory exhausted\n");
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+void gigatron_memprof_destroy(struct gigatron_memprof *mp)
+{
+    if (mp->frames) free(mp->frames);
+    mp->frames = NULL;
+}
+
+void gigatron_memprof_run(struct gigatron_memprof *mp,
+                          struct gigatron_state *gs,
+                          uint64_t num_cycles)
+{
+    uint64_t i;
+
+    for (i = 0; i < num_cycles; i++) {
+        gigatron_step(gs);
+        gigatron_memprof_step(mp, gs);
+    }
+}
+
+void gigatron_memprof_end_frame(struct gigatron_memprof *mp)
+{
+    if (mp->frames) {
+        memcpy(&mp->frames[mp->num_frames % mp->max_frames],
+               &mp->frame, sizeof(mp->frame));
+    }
+    memset(&mp->frame, 0, sizeof(mp->frame));
+    mp->num_frames++;
+}
+
+/* Writes the array `v` of `count` integers to `fp`, each one as a
+ * little-endian integer of `size` bytes (saturated).
+ */
+static int write_array(FILE *fp, const void *v, int is_64,
+                       size_t count, int size)
+{
+    uint8_t buf[4096];
+    size_t i, len;
+
+    len = 0;
+    for (i = 0; i < count; i++) {
+        uint64_t x;
+
+        x = (is_64) ? ((const uint64_t *) v)[i]
+            : ((const uint32_t *) v)[i];
+        if (size == 4 && x > 0xFFFFFFFF)
+            x = 0xFFFFFFFF;
+
+        gigatron_put_le(&buf[len], x, size);
+        len += size;
+        if (len == sizeof(buf)) {
+            if (fwrite(buf, 1, len, fp) != len) return FALSE;
+            len = 0;
+        }
+    }
+
+    if (len > 0) {
+        if (fwrite(buf, 1, len, fp) != len) return FALSE;
+    }
+    return TRUE;
+}
+
+int gigatron_memprof_save(const struct gigatron_memprof *mp,
+                          const char *filename, uint32_t ram_size)
+{
+    uint8_t header[16];
+    uint32_t first, frame, num_frames;
+    int ret;
+    FILE *fp;
+
+    if (ram_size > 65536) ram_size = 65536;
+
+    fp = fopen(filename, "wb");
+    if (!fp) {
+        fprintf(stderr, "could not open file `%s` for writing\n",
+                filename);
+        return FALSE;
+    }
+
+    first = 0;
+    num_frames = 0;
+    if (mp->frames) {
+        first = (mp->num_frames > mp->max_frames)
+            ? mp->num_frames - mp->max_frames : 0;
+        num_frames = mp->num_frames - first;
+    }
+
+    gigatron_put_le(header, MEMPROF_MAGIC, 4);
+    gigatron_put_le(&header[4], MEMPROF_VERSION, 4);
+    gigatron_put_le(&header[8], ram_size, 4);
+    gigatron_put_le(&header[12], num_frames, 4);
+
+    ret = (fwrite(header, sizeof(header), 1, fp) == 1)
+        && write_array(fp, mp->reads, TRUE, ram_size, 4)
+        && write_array(fp, mp->writes, TRUE, ram_size, 4)
+        && write_array(fp, mp->page_reads, TRUE,
+                       MEMPROF_NUM_PAGES * MEMPROF_NUM_MODES, 8)
+        && write_array(fp, mp->page_writes, TRUE,
+                       MEMPROF_NUM_PAGES * MEMPROF_NUM_MODES, 8);
+
+    for (frame = first; ret && frame < first + num_frames; frame++) {
+        const struct memprof_frame *f;
+
+        f = &mp->frames[frame % mp->max_frames];
+        ret = write_array(fp, f->reads, FALSE, MEMPROF_NUM_PAGES, 4)
+            && write_array(fp, f->writes, FALSE, MEMPROF_NUM_PAGES, 4);
+    }
+
+    if (fclose(fp) != 0) ret = FALSE;
+    if (!ret) {
+        fprintf(stderr, "could not write file `%s`\n", filename);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* Comparison function to sort by decreasing traffic. */
+static int cmp_traffic(const void *p1, const void *p2)
+{
+    const struct traffic_count *c1, *c2;
+    uint64_t t1, t2;
+
+    c1 = (const struct traffic_count *) p1;
+    c2 = (const struct traffic_count *) p2;
+    t1 = c1->reads + c1->writes;
+    t2 = c2->reads + c2->writes;
+    if (t1 != t2)
+        return (t1 < t2) ? 1 : -1;
+    return ((int) c1->addr) - ((int) c2->addr);
+}
+
+void gigatron_memprof_report(const struct gigatron_memprof *mp,
+                             FILE *fp, uint32_t max_lines)
+{
+    struct traffic_count *counts;
+    uint64_t mode_reads[MEMPROF_NUM_MODES], mode_writes[MEMPROF_NUM_MODES];
+    uint64_t total_reads, total_writes;
+    uint32_t i, j, num_counts;
+
+    counts = malloc(65536 * sizeof(*counts));
+    if (!counts) {
+        fprintf(stderr, "memory exhausted\n");
+        return;
+    }
+
+    total_reads = total_writes = 0;
+    for (j = 0; j < MEMPROF_NUM_MODES; j++) {
+        mode_reads[j] = mode_writes[j] = 0;
+        for (i = 0; i < MEMPROF_NUM_PAGES; i++) {
+            mode_reads[j] += mp->page_reads[i][j];
+            mode_writes[j] += mp->page_writes[i][j];
+        }
+        total_reads += mode_reads[j];
+        total_writes += mode_writes[j];
+    }
+
+    fprintf(fp, "frames: %u\n", mp->num_frames);
+    fprintf(fp, "reads: %llu, writes: %llu\n",
+            (unsigned long long) total_reads,
+            (unsigned long long) total_writes);
+    if (mp->num_frames > 0) {
+        fprintf(fp, "per frame: %.1f reads, %.1f writes\n",
+                ((double) total_reads) / mp->num_frames,
+                ((double) total_writes) / mp->num_frames);
+    }
+
+    fprintf(fp, "\naddressing modes:\n");
+    for (j = 0; j < MEMPROF_NUM_MODES; j++) {
+        fprintf(fp, "%-8s %14llu reads %14llu writes\n", mode_name[j],
+                (unsigned long long) mode_reads[j],
+                (unsigned long long) mode_writes[j]);
+    }
+
+    num_counts = 0;
+    for (i = 0; i < MEMPROF_NUM_PAGES; i++) {
+        counts[num_counts].addr = i;
+        counts[num_counts].reads = counts[num_counts].writes = 0;
+        for (j = 0; j < MEMPROF_NUM_MODES; j++) {
+            counts[num_counts].reads += mp->page_reads[i][j];
+            counts[num_counts].writes += mp->page_writes[i][j];
+        }
+        if (counts[num_counts].reads + counts[num_counts].writes > 0)
+            num_counts++;
+    }
+
+    qsort(counts, num_counts, sizeof(*counts), cmp_traffic);
+    fprintf(fp, "\nbusiest pages:\n");
+    for (i = 0; i < num_counts && i < max_lines; i++) {
+        fprintf(fp, "$%02Xxx %14llu reads %14llu writes\n",
+                counts[i].addr,
+                (unsigned long long) counts[i].reads,
+                (unsigned long long) counts[i].writes);
+    }
+
+    num_counts = 0;
+    for (i = 0; i < 65536; i++) {
+        if (mp->reads[i] + mp->writes[i] == 0) continue;
+        counts[num_counts].addr = i;
+        counts[num_counts].reads = mp->reads[i];
+        counts[num_counts].writes = mp->writes[i];
+        num_counts++;
+    }
+
+    qsort(counts, num_counts, sizeof(*counts), cmp_traffic);
+    fprintf(fp, "\nbusiest addresses:\n");
+    for (i = 0; i < num_counts && i < max_lines; i++) {
+        fprintf(fp, "$%04X  %14llu reads %14llu writes\n",
+                counts[i].addr,
+                (unsigned long long) counts[i].reads,
+                (unsigned long long) counts[i].writes);
+    }
+
+    free(counts);
+}
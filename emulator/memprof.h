@@ -0,0 +1,156 @@
+#ifndef __MEMPROF_H
+#define __MEMPROF_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "gigatron.h"
+
+/* Constants. */
+
+/* Addressing modes of the RAM accesses. */
+enum memprof_mode {
+    MEMPROF_MODE_D = 0,  /* [D] */
+    MEMPROF_MODE_X,      /* [X] */
+    MEMPROF_MODE_Y_D,    /* [Y,D] */
+    MEMPROF_MODE_Y_X,    /* [Y,X] */
+    MEMPROF_MODE_Y_XINC, /* [Y,X++] */
+    MEMPROF_NUM_MODES
+};
+
+/* Flags in the access table (the mode is in the upper bits). */
+#define MEMPROF_READ  0x01
+#define MEMPROF_WRITE 0x02
+#define MEMPROF_MODE_SHIFT 2
+
+/* Number of pages of 256 bytes in the address space. */
+#define MEMPROF_NUM_PAGES 256
+
+/* Magic number and version of the heatmap files. */
+#define MEMPROF_MAGIC   0x504D5447 /* "GTMP" */
+#define MEMPROF_VERSION 1
+
+/* Data structures and type declarations. */
+
+/* The RAM traffic of one frame, per page. */
+struct memprof_frame {
+    uint32_t reads[MEMPROF_NUM_PAGES];
+    uint32_t writes[MEMPROF_NUM_PAGES];
+};
+
+/* The memory-traffic profiler.
+ * It counts the reads and writes of each RAM address, of each page
+ * in each addressing mode, and of each page in each frame. The
+ * structure is large (about 1 MiB), so it should not be allocated
+ * on the stack.
+ */
+struct gigatron_memprof {
+    uint8_t access[256]; /* Access of each opcode (see above). */
+
+    uint64_t reads[65536];
+    uint64_t writes[65536];
+    uint64_t page_reads[MEMPROF_NUM_PAGES][MEMPROF_NUM_MODES];
+    uint64_t page_writes[MEMPROF_NUM_PAGES][MEMPROF_NUM_MODES];
+
+    struct memprof_frame frame;   /* The current frame. */
+    struct memprof_frame *frames; /* History of the frames (or NULL). */
+    uint32_t max_frames; /* Size of the history (in frames). */
+    uint32_t num_frames; /* Number of complete frames. */
+};
+
+/* Exported functions. */
+
+/* Decodes the RAM access of each opcode into the table `access`
+ * (of 256 entries), with the flags above.
+ */
+void gigatron_memprof_decode(uint8_t *access);
+
+/* Creates the memory profiler `mp`, keeping the per-page traffic of
+ * the last `max_frames` frames.
+ * On success, this function returns TRUE.
+ */
+int gigatron_memprof_create(struct gigatron_memprof *mp,
+                            uint32_t max_frames);
+
+/* Deallocates the memory allocated by the profiler. */
+void gigatron_memprof_destroy(struct gigatron_memprof *mp);
+
+/* Executes `num_cycles` instructions, profiling each of them. */
+void gigatron_memprof_run(struct gigatron_memprof *mp,
+                          struct gigatron_state *gs,
+                          uint64_t num_cycles);
+
+/* Finishes the current frame (called on each VSYNC). */
+void gigatron_memprof_end_frame(struct gigatron_memprof *mp);
+
+/* Writes the heatmap in the binary file `filename`, for the first
+ * `ram_size` bytes of RAM. The file has a 16-byte header (magic,
+ * version, RAM size and number of frames, as 32-bit little-endian
+ * integers), followed by the reads and writes of each address
+ * (32-bit, saturated), the reads and writes of each page in each
+ * mode (64-bit), and the reads and writes of each page in each
+ * frame of the history (32-bit).
+ * On success, this function returns TRUE.
+ */
+int gigatron_memprof_save(const struct gigatron_memprof *mp,
+                          const char *filename, uint32_t ram_size);
+
+/* Writes a summary report with the busiest pages and addresses
+ * (at most `max_lines` of each).
+ */
+void gigatron_memprof_report(const struct gigatron_memprof *mp,
+                             FILE *fp, uint32_t max_lines);
+
+/* Returns the RAM address accessed by the instruction fetched by
+ * the last `gigatron_step()` (the one executed by the next step,
+ * whose address only depends on the current X and Y registers).
+ * The value `access` is its entry in the table of accesses.
+ */
+static inline uint32_t gigatron_memprof_address(uint8_t access,
+                                                const struct gigatron_state *gs)
+{
+    switch (access >> MEMPROF_MODE_SHIFT) {
+    case MEMPROF_MODE_D:
+        return gs->reg_d;
+    case MEMPROF_MODE_X:
+        return gs->reg_x;
+    case MEMPROF_MODE_Y_D:
+        return (((uint32_t) gs->reg_y) << 8) | gs->reg_d;
+    default:
+        return (((uint32_t) gs->reg_y) << 8) | gs->reg_x;
+    }
+}
+
+/* Profiles the access of the instruction fetched by the last
+ * `gigatron_step()`.
+ */
+static inline void gigatron_memprof_step(struct gigatron_memprof *mp,
+                                         const struct gigatron_state *gs)
+{
+    uint8_t access;
+
+    access = mp->access[gs->reg_ir];
+    if (access) {
+        uint32_t mode, addr;
+
+        mode = access >> MEMPROF_MODE_SHIFT;
+        addr = gigatron_memprof_address(access, gs);
+        if (addr < gs->ram_size) {
+            if (access & MEMPROF_READ) {
+                mp->reads[addr]++;
+                mp->page_reads[addr >> 8][mode]++;
+                mp->frame.reads[addr >> 8]++;
+            } else {
+                mp->writes[addr]++;
+                mp->page_writes[addr >> 8][mode]++;
+                mp->frame.writes[addr >> 8]++;
+            }
+        }
+    }
+
+    /* /VSYNC raised. */
+    if ((gs->reg_out & 0x80) && !(gs->prev_out & 0x80))
+        gigatron_memprof_end_frame(mp);
+}
+
+#endif /* __MEMPROF_H */
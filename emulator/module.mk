@@ -1,4 +1,31 @@
-OBJS := $(OBJS) gigatron.o
+OBJS := $(OBJS) gigatron.o backend.o debug.o dirty.o disasm.o engine.o \
+	hash.o idle.o lockstep.o memprof.o movie.o profile.o record.o rom.o \
+	screen.o server.o shm.o snapshot.o stats.o trace.o vprofile.o
 
-gigatron.o: gigatron.c gigatron.h
-main.o: main.c gigatron.h
+gigatron.o: gigatron.c dirty.h gigatron.h rom.h snapshot.h
+backend.o: backend.c backend.h gigatron.h
+debug.o: debug.c debug.h gigatron.h memprof.h vprofile.h
+dirty.o: dirty.c dirty.h gigatron.h
+disasm.o: disasm.c disasm.h gigatron.h rom.h trace.h
+engine.o: engine.c engine.h gigatron.h idle.h lockstep.h
+hash.o: hash.c byteorder.h hash.h gigatron.h
+idle.o: idle.c idle.h gigatron.h
+lockstep.o: lockstep.c dirty.h lockstep.h gigatron.h
+memprof.o: memprof.c byteorder.h memprof.h gigatron.h
+movie.o: movie.c byteorder.h movie.h gigatron.h hash.h
+profile.o: profile.c profile.h gigatron.h rom.h vprofile.h
+record.o: record.c byteorder.h record.h gigatron.h
+rom.o: rom.c rom.h gigatron.h
+screen.o: screen.c screen.h gigatron.h
+server.o: server.c server.h backend.h byteorder.h dirty.h gigatron.h \
+	shm.h
+shm.o: shm.c dirty.h shm.h gigatron.h
+snapshot.o: snapshot.c snapshot.h rom.h gigatron.h
+stats.o: stats.c stats.h gigatron.h
+trace.o: trace.c byteorder.h trace.h gigatron.h
+vprofile.o: vprofile.c vprofile.h gigatron.h
+main.o: main.c backend.h debug.h dirty.h disasm.h gigatron.h hash.h \
+	idle.h memprof.h movie.h profile.h record.h rom.h screen.h server.h shm.h \
+	stats.h trace.h vprofile.h
+gttrace.o: gttrace.c byteorder.h disasm.h gigatron.h rom.h trace.h
+gtdiff.o: gtdiff.c engine.h gigatron.h input.h rom.h stats.h
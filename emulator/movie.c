@@ -0,0 +1,212 @@
+/* Recording and replay of the input of the emulator. */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "byteorder.h"
+#include "gigatron.h"
+#include "hash.h"
+#include "movie.h"
+
+/* Number of registers hashed by `gigatron_movie_state_hash()`. */
+#define NUM_STATE_REGS 14
+
+/* Writes the header of the movie `mv`. */
+static int write_header(struct gigatron_movie *mv)
+{
+    uint8_t header[MOVIE_HEADER_SIZE];
+
+    memset(header, 0, sizeof(header));
+    gigatron_put_le(&header[0], MOVIE_MAGIC, 4);
+    gigatron_put_le(&header[4], MOVIE_VERSION, 4);
+    gigatron_put_le(&header[8], mv->rom_hash, 8);
+    gigatron_put_le(&header[16],
+                    (mv->end_cycle == UINT64_MAX) ? 0 : mv->end_cycle, 8);
+    gigatron_put_le(&header[24], mv->state_hash, 8);
+    gigatron_put_le(&header[32], mv->num_events, 4);
+    return fwrite(header, 1, sizeof(header), mv->fp) == sizeof(header);
+}
+
+/* Reads the next event of the movie being replayed. */
+static void read_event(struct gigatron_movie *mv)
+{
+    uint64_t delta;
+    int c, shift;
+
+    mv->next_cycle = UINT64_MAX;
+    if (mv->events_left == 0) return;
+
+    delta = 0;
+    shift = 0;
+    do {
+        c = fgetc(mv->fp);
+        if (c == EOF || shift > 63) goto fail_event;
+        delta |= ((uint64_t) (c & 0x7F)) << shift;
+        shift += 7;
+    } while (c & 0x80);
+
+    c = fgetc(mv->fp);
+    if (c == EOF) goto fail_event;
+
+    mv->events_left--;
+    mv->next_cycle = mv->cycle + delta;
+    mv->next_in = (uint8_t) c;
+    return;
+
+fail_event:
+    fprintf(stderr, "truncated movie\n");
+    mv->error = TRUE;
+    mv->events_left = 0;
+}
+
+int gigatron_movie_record(struct gigatron_movie *mv, const char *filename,
+                          uint64_t rom_hash)
+{
+    memset(mv, 0, sizeof(*mv));
+    mv->recording = TRUE;
+    mv->rom_hash = rom_hash;
+    mv->end_cycle = UINT64_MAX;
+
+    mv->fp = fopen(filename, "wb");
+    if (!mv->fp) {
+        fprintf(stderr, "could not open file `%s` for writing\n", filename);
+        return FALSE;
+    }
+
+    /* The end and the number of events are filled in on close. */
+    if (!write_header(mv)) {
+        fprintf(stderr, "could not write to `%s`\n", filename);
+        fclose(mv->fp);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+int gigatron_movie_replay(struct gigatron_movie *mv, const char *filename,
+                          uint64_t rom_hash)
+{
+    uint8_t header[MOVIE_HEADER_SIZE];
+
+    memset(mv, 0, sizeof(*mv));
+    mv->recording = FALSE;
+
+    mv->fp = fopen(filename, "rb");
+    if (!mv->fp) {
+        fprintf(stderr, "could not open file `%s` for reading\n", filename);
+        return FALSE;
+    }
+
+    if (fread(header, sizeof(header), 1, mv->fp) != 1
+        || gigatron_get_le(&header[0], 4) != MOVIE_MAGIC
+        || gigatron_get_le(&header[4], 4) != MOVIE_VERSION) {
+        fprintf(stderr, "invalid movie `%s`\n", filename);
+        goto fail_replay;
+    }
+
+    mv->rom_hash = gigatron_get_le(&header[8], 8);
+    if (mv->rom_hash != rom_hash) {
+        fprintf(stderr, "movie `%s` was recorded with another ROM\n",
+                filename);
+        goto fail_replay;
+    }
+
+    mv->end_cycle = gigatron_get_le(&header[16], 8);
+    if (mv->end_cycle == 0) mv->end_cycle = UINT64_MAX;
+    mv->state_hash = gigatron_get_le(&header[24], 8);
+    mv->num_events = (uint32_t) gigatron_get_le(&header[32], 4);
+    mv->events_left = mv->num_events;
+
+    /* The input before the first event (there is always one at the
+     * first cycle in the movies written by gigatron_movie_record()).
+     */
+    mv->in = 0xFF;
+    read_event(mv);
+    if (mv->error) goto fail_replay;
+    return TRUE;
+
+fail_replay:
+    fclose(mv->fp);
+    return FALSE;
+}
+
+void gigatron_movie_input(struct gigatron_movie *mv, uint64_t cycle,
+                          uint8_t in)
+{
+    uint64_t delta;
+    uint8_t c;
+
+    if (mv->num_events > 0 && in == mv->in) return;
+
+    delta = cycle - mv->cycle;
+    do {
+        c = (uint8_t) (delta & 0x7F);
+        delta >>= 7;
+        if (delta) c |= 0x80;
+        if (fputc(c, mv->fp) == EOF) mv->error = TRUE;
+    } while (delta);
+    if (fputc(in, mv->fp) == EOF) mv->error = TRUE;
+
+    mv->cycle = cycle;
+    mv->in = in;
+    mv->num_events++;
+}
+
+uint8_t gigatron_movie_next(struct gigatron_movie *mv, uint64_t cycle)
+{
+    while (mv->next_cycle <= cycle) {
+        mv->cycle = mv->next_cycle;
+        mv->in = mv->next_in;
+        read_event(mv);
+    }
+    return mv->in;
+}
+
+uint64_t gigatron_movie_stop_cycle(const struct gigatron_movie *mv)
+{
+    return (mv->next_cycle < mv->end_cycle) ? mv->next_cycle : mv->end_cycle;
+}
+
+int gigatron_movie_close(struct gigatron_movie *mv,
+                         const struct gigatron_state *gs)
+{
+    int ok;
+
+    ok = !mv->error;
+    if (mv->recording) {
+        if (gs) {
+            mv->end_cycle = gs->num_cycles;
+            mv->state_hash = gigatron_movie_state_hash(gs);
+        }
+        ok = (fseek(mv->fp, 0, SEEK_SET) == 0) && write_header(mv) && ok;
+    }
+
+    ok = (fclose(mv->fp) == 0) && ok;
+    mv->fp = NULL;
+    if (!ok)
+        fprintf(stderr, "could not %s the movie\n",
+                (mv->recording) ? "write" : "read");
+    return ok;
+}
+
+uint64_t gigatron_movie_state_hash(const struct gigatron_state *gs)
+{
+    uint8_t regs[NUM_STATE_REGS];
+
+    regs[0] = (uint8_t) gs->pc;
+    regs[1] = (uint8_t) (gs->pc >> 8);
+    regs[2] = (uint8_t) gs->prev_pc;
+    regs[3] = (uint8_t) (gs->prev_pc >> 8);
+    regs[4] = gs->reg_ir;
+    regs[5] = gs->reg_d;
+    regs[6] = gs->reg_acc;
+    regs[7] = gs->reg_x;
+    regs[8] = gs->reg_y;
+    regs[9] = gs->reg_out;
+    regs[10] = gs->prev_out;
+    regs[11] = gs->reg_xout;
+    regs[12] = gs->reg_in;
+    regs[13] = gs->in;
+    return gigatron_hash64(gs->ram, gs->ram_size,
+                           gigatron_hash64(regs, sizeof(regs),
+                                           gs->num_cycles));
+}
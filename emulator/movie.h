@@ -0,0 +1,92 @@
+#ifndef __MOVIE_H
+#define __MOVIE_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "gigatron.h"
+
+/* Constants. */
+
+/* Magic number and version of the movie files. */
+#define MOVIE_MAGIC   0x564D5447 /* "GTMV" */
+#define MOVIE_VERSION 1
+
+/* Size of the header of the movie files. */
+#define MOVIE_HEADER_SIZE 40
+
+/* Data structures and type declarations. */
+
+/* A movie: the history of the input of a run.
+ * Since the computer is deterministic given its input, a run can be
+ * reproduced from its initial state (after a reset, with the RAM
+ * cleared) and the changes of `gs->in`.
+ * The file starts with a header of 40 bytes: the magic, the version,
+ * the hash of the ROM (see `rom.h`), the cycle at which the recording
+ * ended, the hash of the state at that cycle (see
+ * `gigatron_movie_state_hash()`), the number of events, and 4
+ * reserved bytes. The header is followed by the events, each one
+ * being the number of cycles since the previous event (LEB128) and
+ * the new input (one byte). All the fields are in little endian.
+ */
+struct gigatron_movie {
+    FILE *fp;
+    int recording;       /* TRUE when recording, FALSE when replaying. */
+    int error;           /* The file could not be written or read. */
+
+    uint64_t rom_hash;   /* The hash of the ROM of the movie. */
+    uint64_t end_cycle;  /* The last cycle (UINT64_MAX if unknown). */
+    uint64_t state_hash; /* The hash of the state at `end_cycle`. */
+    uint32_t num_events;
+
+    uint64_t cycle;      /* Cycle of the last event. */
+    uint8_t in;          /* The input since the last event. */
+
+    /* The next event (when replaying). */
+    uint32_t events_left;
+    uint64_t next_cycle; /* UINT64_MAX if there are no more events. */
+    uint8_t next_in;
+};
+
+/* Exported functions. */
+
+/* Creates the movie file `filename` for the ROM with the hash
+ * `rom_hash`. On success, this function returns TRUE.
+ */
+int gigatron_movie_record(struct gigatron_movie *mv, const char *filename,
+                          uint64_t rom_hash);
+
+/* Opens the movie file `filename` for replay, checking that it was
+ * recorded with the ROM with the hash `rom_hash`.
+ * On success, this function returns TRUE.
+ */
+int gigatron_movie_replay(struct gigatron_movie *mv, const char *filename,
+                          uint64_t rom_hash);
+
+/* Records the input `in` at the cycle `cycle` (only if it changed). */
+void gigatron_movie_input(struct gigatron_movie *mv, uint64_t cycle,
+                          uint8_t in);
+
+/* Returns the input of the movie at the cycle `cycle` (when
+ * replaying). The cycles must not decrease between the calls.
+ */
+uint8_t gigatron_movie_next(struct gigatron_movie *mv, uint64_t cycle);
+
+/* Returns the cycle at which the input changes next, or the end of
+ * the movie (when replaying).
+ */
+uint64_t gigatron_movie_stop_cycle(const struct gigatron_movie *mv);
+
+/* Closes the movie. When recording, the current cycle and the hash of
+ * the state `gs` are written as the end of the movie (`gs` can be
+ * NULL, leaving the end unknown).
+ * Returns FALSE if the file could not be written or read.
+ */
+int gigatron_movie_close(struct gigatron_movie *mv,
+                         const struct gigatron_state *gs);
+
+/* Returns the hash of the registers and the RAM of `gs`. */
+uint64_t gigatron_movie_state_hash(const struct gigatron_state *gs);
+
+#endif /* __MOVIE_H */
@@ -0,0 +1,412 @@
+/* Native-level profiler with per-ROM-address cycle counts. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "profile.h"
+#include "vprofile.h"
+
+/* Names of the categories (in the order of `profile_category`). */
+static const char *category_name[PROFILE_NUM_CATEGORIES] = {
+    "other", "video", "audio", "vcpu"
+};
+
+/* A basic block, used for sorting the blocks in the report. */
+struct block_count {
+    uint16_t start;      /* Start address of the block. */
+    uint64_t cycles;     /* Total cycles in the block. */
+};
+
+int gigatron_profile_create(struct gigatron_profile *prof,
+                            const uint16_t *rom, uint32_t max_frames)
+{
+    uint32_t addr;
+
+    memset(prof->counts, 0, sizeof(prof->counts));
+    memset(prof->leader, 0, sizeof(prof->leader));
+    memset(prof->category, PROFILE_OTHER, sizeof(prof->category));
+    for (addr = 0; addr < GIGATRON_ROM_WORDS; addr++)
+        prof->routine[addr] = PROFILE_NO_ROUTINE;
+
+    /* Find the basic blocks statically: the blocks start at the
+     * beginning of each page, after the delay slot of each branch,
+     * and at the targets of the branches within the same page.
+     */
+    for (addr = 0; addr < GIGATRON_ROM_WORDS; addr++) {
+        uint32_t ins, mod, bus;
+        uint8_t opc, d;
+
+        opc = (uint8_t) (rom[addr] & 0xFF);
+        d = (uint8_t) (rom[addr] >> 8);
+        ins = (((uint32_t) opc) >> 5) & 0x07;
+        mod = (((uint32_t) opc) >> 2) & 0x07;
+        bus = ((uint32_t) opc) & 0x03;
+
+        if ((addr & 0xFF) == 0)
+            prof->leader[addr] = TRUE;
+
+        if (ins != 7) continue;
+
+        prof->leader[(addr + 2) & 0xFFFF] = TRUE;
+        if (mod != 0 && bus == 0)
+            prof->leader[((addr + 1) & 0xFF00) | d] = TRUE;
+    }
+
+    prof->last_pc = 0xFFFF;
+    prof->symbols = NULL;
+    prof->num_symbols = 0;
+
+    memset(prof->frame, 0, sizeof(prof->frame));
+    memset(prof->total, 0, sizeof(prof->total));
+    prof->max_frames = max_frames;
+    prof->num_frames = 0;
+    prof->frames = NULL;
+
+    if (max_frames > 0) {
+        prof->frames = malloc(((size_t) max_frames)
+                              * PROFILE_NUM_CATEGORIES * sizeof(uint32_t));
+        if (!prof->frames) {
+            fprintf(stderr, "memory exhausted\n");
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+void gigatron_profile_destroy(struct gigatron_profile *prof)
+{
+    if (prof->symbols) free(prof->symbols);
+    if (prof->frames) free(prof->frames);
+    prof->symbols = NULL;
+    prof->frames = NULL;
+}
+
+void gigatron_profile_classify(struct gigatron_profile *prof,
+                               const uint16_t *rom, uint16_t dispatch)
+{
+    uint32_t addr, page;
+
+    if (dispatch == 0)
+        dispatch = gigatron_vprofile_find_dispatch(rom);
+    if (dispatch != 0) {
+        page = dispatch & 0xFF00;
+        for (addr = page; addr < page + 0x100; addr++)
+            prof->category[addr] = PROFILE_VCPU;
+    }
+
+    for (addr = 0; addr < GIGATRON_ROM_WORDS; addr++) {
+        /* ld [y,x++],out */
+        if ((rom[addr] & 0xFF) == 0x1D)
+            prof->category[addr] = PROFILE_VIDEO;
+    }
+}
+
+/* Comparison function to sort the symbols by address. */
+static int cmp_symbol(const void *p1, const void *p2)
+{
+    const struct profile_symbol *s1, *s2;
+
+    s1 = (const struct profile_symbol *) p1;
+    s2 = (const struct profile_symbol *) p2;
+    return ((int) s1->addr) - ((int) s2->addr);
+}
+
+int gigatron_profile_load_symbols(struct gigatron_profile *prof,
+                                  const char *filename)
+{
+    struct profile_symbol *symbols;
+    uint32_t num_symbols, capacity, i, addr;
+    char line[256];
+    FILE *fp;
+
+    fp = fopen(filename, "r");
+    if (!fp) {
+        fprintf(stderr, "could not open file `%s` for reading\n",
+                filename);
+        return FALSE;
+    }
+
+    symbols = NULL;
+    num_symbols = capacity = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        struct profile_symbol *sym;
+        char name[PROFILE_MAX_NAME], cat[16], *p;
+        unsigned long value;
+        int n;
+
+        p = line;
+        while (isspace((unsigned char) *p)) p++;
+        if (*p == '#' || *p == '\0') continue;
+        if (*p == '$') p++;
+
+        value = strtoul(p, &p, 16);
+        cat[0] = '\0';
+        n = sscanf(p, "%39s %15s", name, cat);
+        if (n < 1 || value >= GIGATRON_ROM_WORDS) {
+            fprintf(stderr, "invalid symbol: %s", line);
+            continue;
+        }
+
+        if (num_symbols == capacity) {
+            capacity = (capacity) ? 2 * capacity : 256;
+            sym = realloc(symbols, capacity * sizeof(*symbols));
+            if (!sym) {
+                fprintf(stderr, "memory exhausted\n");
+                free(symbols);
+                fclose(fp);
+                return FALSE;
+            }
+            symbols = sym;
+        }
+
+        sym = &symbols[num_symbols++];
+        sym->addr = (uint16_t) value;
+        sym->category = PROFILE_OTHER;
+        strcpy(sym->name, name);
+        for (i = 0; i < PROFILE_NUM_CATEGORIES; i++) {
+            if (strcmp(cat, category_name[i]) == 0)
+                sym->category = (uint8_t) i;
+        }
+    }
+    fclose(fp);
+
+    qsort(symbols, num_symbols, sizeof(*symbols), cmp_symbol);
+
+    /* Assign each address to its routine. */
+    for (i = 0; i < num_symbols; i++) {
+        uint32_t end;
+
+        end = (i + 1 < num_symbols) ? symbols[i + 1].addr
+            : GIGATRON_ROM_WORDS;
+        prof->leader[symbols[i].addr] = TRUE;
+        for (addr = symbols[i].addr; addr < end; addr++) {
+            prof->routine[addr] = i;
+            prof->category[addr] = symbols[i].category;
+        }
+    }
+
+    if (prof->symbols) free(prof->symbols);
+    prof->symbols = symbols;
+    prof->num_symbols = num_symbols;
+    return TRUE;
+}
+
+void gigatron_profile_run(struct gigatron_profile *prof,
+                          struct gigatron_state *gs,
+                          uint64_t num_cycles)
+{
+    uint64_t i;
+
+    for (i = 0; i < num_cycles; i++) {
+        gigatron_step(gs);
+        gigatron_profile_step(prof, gs);
+    }
+}
+
+void gigatron_profile_end_frame(struct gigatron_profile *prof)
+{
+    uint32_t i;
+
+    for (i = 0; i < PROFILE_NUM_CATEGORIES; i++) {
+        prof->total[i] += prof->frame[i];
+        if (prof->frames) {
+            uint32_t pos;
+
+            pos = prof->num_frames % prof->max_frames;
+            prof->frames[pos * PROFILE_NUM_CATEGORIES + i] =
+                (uint32_t) prof->frame[i];
+        }
+        prof->frame[i] = 0;
+    }
+    prof->num_frames++;
+}
+
+/* Writes the name of the routine at `addr` in `name`. */
+static void routine_name(const struct gigatron_profile *prof,
+                         uint16_t addr, char *name, size_t size)
+{
+    uint32_t idx;
+
+    idx = prof->routine[addr];
+    if (idx != PROFILE_NO_ROUTINE) {
+        snprintf(name, size, "%s", prof->symbols[idx].name);
+    } else {
+        snprintf(name, size, "page_%02X", (uint32_t) (addr >> 8));
+    }
+}
+
+/* Computes the total cycles of each basic block. The blocks are
+ * written in `blocks`, and the number of blocks is returned.
+ */
+static uint32_t count_blocks(const struct gigatron_profile *prof,
+                             struct block_count *blocks)
+{
+    uint32_t addr, num_blocks;
+
+    num_blocks = 0;
+    for (addr = 0; addr < GIGATRON_ROM_WORDS; addr++) {
+        if (prof->leader[addr] || num_blocks == 0) {
+            blocks[num_blocks].start = (uint16_t) addr;
+            blocks[num_blocks].cycles = 0;
+            num_blocks++;
+        }
+        blocks[num_blocks - 1].cycles += prof->counts[addr];
+    }
+    return num_blocks;
+}
+
+int gigatron_profile_write_folded(const struct gigatron_profile *prof,
+                                  FILE *fp)
+{
+    struct block_count *blocks;
+    uint32_t i, num_blocks;
+    char name[PROFILE_MAX_NAME];
+
+    blocks = malloc(GIGATRON_ROM_WORDS * sizeof(*blocks));
+    if (!blocks) {
+        fprintf(stderr, "memory exhausted\n");
+        return FALSE;
+    }
+
+    num_blocks = count_blocks(prof, blocks);
+    for (i = 0; i < num_blocks; i++) {
+        uint16_t start;
+
+        if (blocks[i].cycles == 0) continue;
+
+        start = blocks[i].start;
+        routine_name(prof, start, name, sizeof(name));
+        fprintf(fp, "%s;%s;$%04X %llu\n",
+                category_name[prof->category[start]], name,
+                (uint32_t) start, (unsigned long long) blocks[i].cycles);
+    }
+
+    free(blocks);
+    return !ferror(fp);
+}
+
+int gigatron_profile_write_frames(const struct gigatron_profile *prof,
+                                  FILE *fp)
+{
+    uint32_t first, frame, i;
+
+    fprintf(fp, "frame");
+    for (i = 0; i < PROFILE_NUM_CATEGORIES; i++)
+        fprintf(fp, ",%s", category_name[i]);
+    fprintf(fp, "\n");
+
+    if (!prof->frames) return !ferror(fp);
+
+    first = (prof->num_frames > prof->max_frames)
+        ? prof->num_frames - prof->max_frames : 0;
+    for (frame = first; frame < prof->num_frames; frame++) {
+        const uint32_t *f;
+
+        f = &prof->frames[(frame % prof->max_frames)
+                          * PROFILE_NUM_CATEGORIES];
+        fprintf(fp, "%u", frame);
+        for (i = 0; i < PROFILE_NUM_CATEGORIES; i++)
+            fprintf(fp, ",%u", f[i]);
+        fprintf(fp, "\n");
+    }
+
+    return !ferror(fp);
+}
+
+/* Comparison function to sort the blocks by decreasing cycles. */
+static int cmp_block(const void *p1, const void *p2)
+{
+    const struct block_count *b1, *b2;
+
+    b1 = (const struct block_count *) p1;
+    b2 = (const struct block_count *) p2;
+    if (b1->cycles != b2->cycles)
+        return (b1->cycles < b2->cycles) ? 1 : -1;
+    return ((int) b1->start) - ((int) b2->start);
+}
+
+void gigatron_profile_report(const struct gigatron_profile *prof,
+                             FILE *fp, uint32_t max_lines)
+{
+    struct block_count *blocks, *routines;
+    uint64_t total;
+    uint32_t i, num_blocks, num_routines;
+    char name[PROFILE_MAX_NAME];
+
+    blocks = malloc(GIGATRON_ROM_WORDS * sizeof(*blocks));
+    routines = malloc(GIGATRON_ROM_WORDS * sizeof(*routines));
+    if (!blocks || !routines) {
+        fprintf(stderr, "memory exhausted\n");
+        if (blocks) free(blocks);
+        if (routines) free(routines);
+        return;
+    }
+
+    total = 0;
+    for (i = 0; i < PROFILE_NUM_CATEGORIES; i++)
+        total += prof->total[i];
+
+    fprintf(fp, "frames: %u\n", prof->num_frames);
+    if (prof->num_frames > 0) {
+        fprintf(fp, "cycles per frame:");
+        for (i = 0; i < PROFILE_NUM_CATEGORIES; i++) {
+            fprintf(fp, " %s=%.1f (%.1f%%)", category_name[i],
+                    ((double) prof->total[i]) / prof->num_frames,
+                    (total) ? 100.0 * prof->total[i] / total : 0.0);
+        }
+        fprintf(fp, "\n");
+    }
+
+    /* Totals per routine (the routines are identified by the
+     * address of their first block).
+     */
+    num_blocks = count_blocks(prof, blocks);
+    num_routines = 0;
+    for (i = 0; i < num_blocks; i++) {
+        uint16_t start;
+
+        start = blocks[i].start;
+        if (num_routines == 0
+            || prof->routine[start] != prof->routine[routines[num_routines - 1].start]
+            || (prof->routine[start] == PROFILE_NO_ROUTINE
+                && (start >> 8) != (routines[num_routines - 1].start >> 8))) {
+            routines[num_routines].start = start;
+            routines[num_routines].cycles = 0;
+            num_routines++;
+        }
+        routines[num_routines - 1].cycles += blocks[i].cycles;
+    }
+
+    total = 0;
+    for (i = 0; i < num_blocks; i++)
+        total += blocks[i].cycles;
+    if (total == 0) total = 1;
+
+    qsort(routines, num_routines, sizeof(*routines), cmp_block);
+    fprintf(fp, "\nhottest routines:\n");
+    for (i = 0; i < num_routines && i < max_lines; i++) {
+        if (routines[i].cycles == 0) break;
+        routine_name(prof, routines[i].start, name, sizeof(name));
+        fprintf(fp, "%6.2f%% %14llu  %-24s %s\n",
+                100.0 * routines[i].cycles / total,
+                (unsigned long long) routines[i].cycles, name,
+                category_name[prof->category[routines[i].start]]);
+    }
+
+    qsort(blocks, num_blocks, sizeof(*blocks), cmp_block);
+    fprintf(fp, "\nhottest blocks:\n");
+    for (i = 0; i < num_blocks && i < max_lines; i++) {
+        if (blocks[i].cycles == 0) break;
+        routine_name(prof, blocks[i].start, name, sizeof(name));
+        fprintf(fp, "%6.2f%% %14llu  $%04X  %s\n",
+                100.0 * blocks[i].cycles / total,
+                (unsigned long long) blocks[i].cycles,
+                (uint32_t) blocks[i].start, name);
+    }
+
+    free(blocks);
+    free(routines);
+}
@@ -0,0 +1,143 @@
+#ifndef __PROFILE_H
+#define __PROFILE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "gigatron.h"
+#include "rom.h"
+
+/* Constants. */
+
+/* Categories of the ROM routines, for the per-frame breakdown. */
+enum profile_category {
+    PROFILE_OTHER = 0,   /* Uncategorized code. */
+    PROFILE_VIDEO,       /* Video generation. */
+    PROFILE_AUDIO,       /* Sound generation. */
+    PROFILE_VCPU,        /* vCPU interpreter. */
+    PROFILE_NUM_CATEGORIES
+};
+
+/* Maximum length of the name of a routine. */
+#define PROFILE_MAX_NAME 40
+
+/* Value of `routine[]` for addresses without a routine. */
+#define PROFILE_NO_ROUTINE 0xFFFFFFFF
+
+/* Data structures and type declarations. */
+
+/* A named ROM routine (from a symbol file). */
+struct profile_symbol {
+    uint16_t addr;       /* Start address of the routine. */
+    uint8_t category;    /* Category of the routine. */
+    char name[PROFILE_MAX_NAME];
+};
+
+/* The native-level profiler.
+ * It counts the executions of each ROM address, and the cycles
+ * spent in each category of routines in each frame.
+ * The structure is large (about 1 MiB), so it should not be
+ * allocated on the stack.
+ */
+struct gigatron_profile {
+    uint64_t counts[GIGATRON_ROM_WORDS]; /* Executions per address. */
+    uint8_t leader[GIGATRON_ROM_WORDS];  /* Address starts a block. */
+    uint8_t category[GIGATRON_ROM_WORDS];/* Category per address. */
+    uint32_t routine[GIGATRON_ROM_WORDS];/* Routine per address. */
+    uint16_t last_pc;    /* Address of the last instruction. */
+
+    struct profile_symbol *symbols; /* The routines (sorted). */
+    uint32_t num_symbols;
+
+    /* Per-frame breakdown of the cycles. */
+    uint64_t frame[PROFILE_NUM_CATEGORIES]; /* The current frame. */
+    uint64_t total[PROFILE_NUM_CATEGORIES]; /* All frames. */
+    uint32_t *frames;    /* History of the frames (or NULL). */
+    uint32_t max_frames; /* Size of the history (in frames). */
+    uint32_t num_frames; /* Number of complete frames. */
+};
+
+/* Exported functions. */
+
+/* Creates the profiler `prof` for the ROM `rom`, keeping the
+ * per-frame breakdown of the last `max_frames` frames.
+ * On success, this function returns TRUE.
+ */
+int gigatron_profile_create(struct gigatron_profile *prof,
+                            const uint16_t *rom, uint32_t max_frames);
+
+/* Deallocates the memory allocated by the profiler. */
+void gigatron_profile_destroy(struct gigatron_profile *prof);
+
+/* Assigns the categories that can be told from the ROM alone: the
+ * page of the vCPU dispatch (found as in `vprofile.h` if `dispatch`
+ * is 0) is `vcpu`, and the pixel bursts (`ld [y,x++],out`) are
+ * `video` (no code is `vcpu` if the dispatch is not found). The rest
+ * of the video and the sound cannot be told apart from the other
+ * code without a symbol file, and stay `other`.
+ */
+void gigatron_profile_classify(struct gigatron_profile *prof,
+                               const uint16_t *rom, uint16_t dispatch);
+
+/* Loads the names of the ROM routines from the file `filename`.
+ * Each line has the form "<address> <name> [<category>]", where
+ * the address is in hexadecimal (optionally prefixed by `$` or
+ * `0x`), and the category is one of `video`, `audio`, `vcpu` or
+ * `other`. A routine extends up to the start of the next one.
+ * Lines starting with `#` are ignored.
+ * On success, this function returns TRUE.
+ */
+int gigatron_profile_load_symbols(struct gigatron_profile *prof,
+                                  const char *filename);
+
+/* Executes `num_cycles` instructions, profiling each of them. */
+void gigatron_profile_run(struct gigatron_profile *prof,
+                          struct gigatron_state *gs,
+                          uint64_t num_cycles);
+
+/* Finishes the current frame (called on each VSYNC). */
+void gigatron_profile_end_frame(struct gigatron_profile *prof);
+
+/* Writes the profile as folded stacks (one line per basic block,
+ * in the form "category;routine;block count"), which is the input
+ * format of the flamegraph tools. The counts are in cycles.
+ * On success, this function returns TRUE.
+ */
+int gigatron_profile_write_folded(const struct gigatron_profile *prof,
+                                  FILE *fp);
+
+/* Writes the per-frame breakdown (one line per frame, in CSV
+ * format). On success, this function returns TRUE.
+ */
+int gigatron_profile_write_frames(const struct gigatron_profile *prof,
+                                  FILE *fp);
+
+/* Writes a summary report with the hottest routines and basic
+ * blocks (at most `max_lines` of each).
+ */
+void gigatron_profile_report(const struct gigatron_profile *prof,
+                             FILE *fp, uint32_t max_lines);
+
+/* Profiles the cycle just executed by `gs`. This is meant to be
+ * called right after `gigatron_step()`.
+ */
+static inline void gigatron_profile_step(struct gigatron_profile *prof,
+                                         const struct gigatron_state *gs)
+{
+    uint16_t pc;
+
+    pc = gs->prev_pc;
+    prof->counts[pc]++;
+    prof->frame[prof->category[pc]]++;
+
+    /* Entry points of the basic blocks found at runtime. */
+    if (pc != (uint16_t) (prof->last_pc + 1))
+        prof->leader[pc] = TRUE;
+    prof->last_pc = pc;
+
+    /* /VSYNC raised. */
+    if ((gs->reg_out & 0x80) && !(gs->prev_out & 0x80))
+        gigatron_profile_end_frame(prof);
+}
+
+#endif /* __PROFILE_H */
@@ -0,0 +1,312 @@
+/* Audio/video recorder. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "byteorder.h"
+#include "gigatron.h"
+#include "record.h"
+
+/* Size of the header of the WAV files. */
+#define WAV_HEADER_SIZE 44
+
+/* Writes the header of a WAV file (8-bit unsigned, mono) with
+ * `data_size` bytes of samples.
+ */
+static int write_wav_header(FILE *fp, uint32_t data_size)
+{
+    uint8_t header[WAV_HEADER_SIZE];
+
+    memcpy(&header[0], "RIFF", 4);
+    gigatron_put_le(&header[4], 36 + data_size, 4);
+    memcpy(&header[8], "WAVE", 4);
+    memcpy(&header[12], "fmt ", 4);
+    gigatron_put_le(&header[16], 16, 4);               /* Size of the chunk. */
+    gigatron_put_le(&header[20], 1, 2);                /* PCM. */
+    gigatron_put_le(&header[22], 1, 2);                /* Channels. */
+    gigatron_put_le(&header[24], RECORD_SAMPLE_RATE, 4); /* Sample rate. */
+    gigatron_put_le(&header[28], RECORD_SAMPLE_RATE, 4); /* Byte rate. */
+    gigatron_put_le(&header[32], 1, 2);                /* Block align. */
+    gigatron_put_le(&header[34], 8, 2);                /* Bits per sample. */
+    memcpy(&header[36], "data", 4);
+    gigatron_put_le(&header[40], data_size, 4);
+
+    return fwrite(header, 1, sizeof(header), fp) == sizeof(header);
+}
+
+/* Returns TRUE if `filename` ends with `ext`. */
+static int has_extension(const char *filename, const char *ext)
+{
+    size_t len, ext_len;
+
+    len = strlen(filename);
+    ext_len = strlen(ext);
+    return len >= ext_len && strcmp(&filename[len - ext_len], ext) == 0;
+}
+
+/* Writes the frame `pixels` to the video output. */
+static int write_video(struct gigatron_recorder *rec,
+                       const uint32_t *pixels)
+{
+    uint32_t i, n;
+    uint8_t *buf;
+
+    n = rec->width * rec->height;
+    buf = rec->buf;
+
+    if (rec->format == RECORD_RAW) {
+        for (i = 0; i < n; i++) {
+            uint32_t c = pixels[i];
+            buf[3 * i] = (uint8_t) (c >> 16);
+            buf[3 * i + 1] = (uint8_t) (c >> 8);
+            buf[3 * i + 2] = (uint8_t) c;
+        }
+        return fwrite(buf, 3, n, rec->video) == n;
+    }
+
+    /* BT.601 (limited range), in planar 4:4:4. */
+    for (i = 0; i < n; i++) {
+        uint32_t c = pixels[i];
+        int r, g, b;
+
+        r = (c >> 16) & 0xFF;
+        g = (c >> 8) & 0xFF;
+        b = c & 0xFF;
+        buf[i] = (uint8_t) (((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+        buf[n + i] = (uint8_t)
+            (((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+        buf[2 * n + i] = (uint8_t)
+            (((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+    }
+
+    if (fputs("FRAME\n", rec->video) < 0)
+        return FALSE;
+    return fwrite(buf, 3, n, rec->video) == n;
+}
+
+/* The writer thread. */
+static void *writer_thread(void *arg)
+{
+    struct gigatron_recorder *rec;
+    struct record_item *item;
+    int ok;
+
+    rec = (struct gigatron_recorder *) arg;
+    for (;;) {
+        pthread_mutex_lock(&rec->lock);
+        while (rec->count == 0 && !rec->done)
+            pthread_cond_wait(&rec->not_empty, &rec->lock);
+        if (rec->count == 0) {
+            pthread_mutex_unlock(&rec->lock);
+            break;
+        }
+        item = &rec->items[rec->head];
+        pthread_mutex_unlock(&rec->lock);
+
+        /* The item is not touched by the emulation until it is
+         * released below.
+         */
+        ok = TRUE;
+        if (rec->video)
+            ok = write_video(rec, item->pixels);
+
+        if (rec->audio && item->num_samples > 0) {
+            ok = ok && fwrite(item->samples, 1, item->num_samples,
+                              rec->audio) == item->num_samples;
+            rec->audio_bytes += item->num_samples;
+        }
+
+        pthread_mutex_lock(&rec->lock);
+        if (!ok) rec->error = TRUE;
+        rec->head = (rec->head + 1) % rec->queue_size;
+        rec->count--;
+        pthread_cond_signal(&rec->not_full);
+        pthread_mutex_unlock(&rec->lock);
+    }
+    return NULL;
+}
+
+/* Closes the outputs. */
+static int close_outputs(struct gigatron_recorder *rec)
+{
+    int ok;
+
+    ok = TRUE;
+    if (rec->video) {
+        if (rec->video_pipe) {
+            ok = (pclose(rec->video) == 0) && ok;
+        } else {
+            ok = (fclose(rec->video) == 0) && ok;
+        }
+        rec->video = NULL;
+    }
+
+    if (rec->audio) {
+        /* Now that the size is known, the header is rewritten. */
+        if (fseek(rec->audio, 0, SEEK_SET) == 0) {
+            ok = write_wav_header(rec->audio, (uint32_t) rec->audio_bytes)
+                && ok;
+        }
+        ok = (fclose(rec->audio) == 0) && ok;
+        rec->audio = NULL;
+    }
+    return ok;
+}
+
+/* Frees the queue. */
+static void free_items(struct gigatron_recorder *rec)
+{
+    uint32_t i;
+
+    if (rec->items) {
+        for (i = 0; i < rec->queue_size; i++)
+            free(rec->items[i].pixels);
+        free(rec->items);
+        rec->items = NULL;
+    }
+    free(rec->buf);
+    rec->buf = NULL;
+}
+
+int gigatron_recorder_create(struct gigatron_recorder *rec,
+                             const char *video_filename,
+                             const char *audio_filename,
+                             uint32_t width, uint32_t height,
+                             uint32_t queue_size)
+{
+    size_t frame_size;
+    uint32_t i;
+
+    memset(rec, 0, sizeof(*rec));
+    rec->width = width;
+    rec->height = height;
+    rec->queue_size = (queue_size > 0) ? queue_size : 1;
+    frame_size = ((size_t) width) * height;
+
+    if (video_filename) {
+        if (video_filename[0] == '|') {
+            rec->video = popen(&video_filename[1], "w");
+            rec->video_pipe = TRUE;
+        } else {
+            rec->video = fopen(video_filename, "wb");
+        }
+        if (!rec->video) {
+            fprintf(stderr, "could not open `%s`\n", video_filename);
+            return FALSE;
+        }
+
+        rec->format = (!rec->video_pipe
+                       && has_extension(video_filename, ".y4m"))
+            ? RECORD_Y4M : RECORD_RAW;
+        if (rec->format == RECORD_Y4M) {
+            fprintf(rec->video, "YUV4MPEG2 W%u H%u F%u:%u Ip A1:1 C444\n",
+                    width, height, RECORD_FPS_NUM, RECORD_FPS_DEN);
+        }
+    }
+
+    if (audio_filename) {
+        rec->audio = fopen(audio_filename, "wb");
+        if (!rec->audio) {
+            fprintf(stderr, "could not open `%s`\n", audio_filename);
+            goto fail_create;
+        }
+
+        /* The sizes are filled in when the file is closed. */
+        if (!write_wav_header(rec->audio, 0)) {
+            fprintf(stderr, "could not write to `%s`\n", audio_filename);
+            goto fail_create;
+        }
+    }
+
+    rec->buf = (uint8_t *) malloc(3 * frame_size);
+    rec->items = (struct record_item *)
+        calloc(rec->queue_size, sizeof(struct record_item));
+    if (!rec->buf || !rec->items) {
+        fprintf(stderr, "memory exhausted\n");
+        goto fail_create;
+    }
+
+    for (i = 0; i < rec->queue_size; i++) {
+        rec->items[i].pixels = (uint32_t *)
+            malloc(frame_size * sizeof(uint32_t));
+        if (!rec->items[i].pixels) {
+            fprintf(stderr, "memory exhausted\n");
+            goto fail_create;
+        }
+    }
+
+    pthread_mutex_init(&rec->lock, NULL);
+    pthread_cond_init(&rec->not_empty, NULL);
+    pthread_cond_init(&rec->not_full, NULL);
+
+    if (pthread_create(&rec->thread, NULL, &writer_thread, rec) != 0) {
+        fprintf(stderr, "could not start the recorder thread\n");
+        pthread_cond_destroy(&rec->not_full);
+        pthread_cond_destroy(&rec->not_empty);
+        pthread_mutex_destroy(&rec->lock);
+        goto fail_create;
+    }
+    return TRUE;
+
+fail_create:
+    free_items(rec);
+    close_outputs(rec);
+    return FALSE;
+}
+
+void gigatron_recorder_frame(struct gigatron_recorder *rec,
+                             const uint32_t *pixels,
+                             const uint8_t *samples, uint32_t num_samples)
+{
+    struct record_item *item;
+
+    pthread_mutex_lock(&rec->lock);
+    if (rec->count == rec->queue_size) {
+        rec->stalls++;
+        while (rec->count == rec->queue_size)
+            pthread_cond_wait(&rec->not_full, &rec->lock);
+    }
+    item = &rec->items[(rec->head + rec->count) % rec->queue_size];
+    pthread_mutex_unlock(&rec->lock);
+
+    /* The free item belongs to the emulation until it is queued. */
+    if (rec->video) {
+        memcpy(item->pixels, pixels,
+               ((size_t) rec->width) * rec->height * sizeof(uint32_t));
+    }
+
+    if (num_samples > RECORD_MAX_SAMPLES)
+        num_samples = RECORD_MAX_SAMPLES;
+    memcpy(item->samples, samples, num_samples);
+    item->num_samples = num_samples;
+
+    pthread_mutex_lock(&rec->lock);
+    rec->count++;
+    rec->frames++;
+    pthread_cond_signal(&rec->not_empty);
+    pthread_mutex_unlock(&rec->lock);
+}
+
+int gigatron_recorder_destroy(struct gigatron_recorder *rec)
+{
+    int ok;
+
+    pthread_mutex_lock(&rec->lock);
+    rec->done = TRUE;
+    pthread_cond_signal(&rec->not_empty);
+    pthread_mutex_unlock(&rec->lock);
+    pthread_join(rec->thread, NULL);
+
+    pthread_cond_destroy(&rec->not_full);
+    pthread_cond_destroy(&rec->not_empty);
+    pthread_mutex_destroy(&rec->lock);
+
+    ok = !rec->error;
+    ok = close_outputs(rec) && ok;
+    free_items(rec);
+
+    if (!ok)
+        fprintf(stderr, "could not write the recording\n");
+    return ok;
+}
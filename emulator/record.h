@@ -0,0 +1,94 @@
+#ifndef __RECORD_H
+#define __RECORD_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+/* Constants. */
+
+/* Frame rate of the Gigatron (6.25 MHz / 104200 cycles per frame),
+ * and its sample rate (one sample per line, 6.25 MHz / 200).
+ */
+#define RECORD_FPS_NUM 31250
+#define RECORD_FPS_DEN 521
+#define RECORD_SAMPLE_RATE 31250
+
+/* Maximum number of audio samples per frame. */
+#define RECORD_MAX_SAMPLES 1024
+
+/* Data structures and type declarations. */
+
+/* Formats of the video output. */
+enum record_format {
+    RECORD_RAW = 0,      /* Raw RGB24 frames. */
+    RECORD_Y4M           /* YUV4MPEG2 (4:4:4). */
+};
+
+/* A frame in the queue, with the audio samples of the frame. */
+struct record_item {
+    uint32_t *pixels;    /* ARGB8888 pixels. */
+    uint8_t samples[RECORD_MAX_SAMPLES];
+    uint32_t num_samples;
+};
+
+/* The audio/video recorder.
+ * The emulator hands each finished frame (and its audio samples) to
+ * a background writer thread through a bounded queue. The writer
+ * converts the frames and writes them, so the emulation thread only
+ * pays for a copy of the frame. When the queue is full, the
+ * emulation waits for the writer (no frame is ever dropped).
+ */
+struct gigatron_recorder {
+    uint32_t width, height;
+
+    FILE *video;         /* The video output (or NULL). */
+    int video_pipe;      /* The video output is a pipe. */
+    enum record_format format;
+    FILE *audio;         /* The WAV output (or NULL). */
+    uint64_t audio_bytes;/* Bytes of audio data written. */
+    uint8_t *buf;        /* Conversion buffer of the writer. */
+
+    struct record_item *items; /* The queue (ring buffer). */
+    uint32_t queue_size;
+    uint32_t head, count;/* Next item to write, and items queued. */
+    int done;            /* No more items will be queued. */
+    int error;           /* The writer failed to write. */
+
+    uint64_t frames;     /* Frames recorded. */
+    uint64_t stalls;     /* Times the emulation waited for the writer. */
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty, not_full;
+};
+
+/* Exported functions. */
+
+/* Creates the recorder `rec` for frames of `width` x `height`
+ * pixels, with a queue of `queue_size` frames, and starts the
+ * writer thread. The video is written to `video_filename` (Y4M if
+ * the name ends in ".y4m", raw RGB24 otherwise, or to the standard
+ * input of a command if the name starts with '|'), and the audio to
+ * the WAV file `audio_filename`. Either of them can be NULL.
+ * On success, this function returns TRUE.
+ */
+int gigatron_recorder_create(struct gigatron_recorder *rec,
+                             const char *video_filename,
+                             const char *audio_filename,
+                             uint32_t width, uint32_t height,
+                             uint32_t queue_size);
+
+/* Queues the frame `pixels` (ARGB8888), with the `num_samples`
+ * audio samples in `samples` (8-bit unsigned). The data is copied.
+ */
+void gigatron_recorder_frame(struct gigatron_recorder *rec,
+                             const uint32_t *pixels,
+                             const uint8_t *samples, uint32_t num_samples);
+
+/* Writes the queued frames, stops the writer thread, and closes the
+ * outputs. Returns FALSE if some data could not be written.
+ */
+int gigatron_recorder_destroy(struct gigatron_recorder *rec);
+
+#endif /* __RECORD_H */
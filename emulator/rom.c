@@ -0,0 +1,170 @@
+/* ROM images shared by many instances. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "gigatron.h"
+#include "rom.h"
+
+/* Computes the 64-bit FNV-1a hash of the ROM contents. */
+static uint64_t hash_rom(const uint16_t *data)
+{
+    const uint8_t *p;
+    uint64_t h;
+    size_t i;
+
+    p = (const uint8_t *) data;
+    h = 0xCBF29CE484222325ULL;
+    for (i = 0; i < GIGATRON_ROM_SIZE; i++) {
+        h ^= p[i];
+        h *= 0x100000001B3ULL;
+    }
+    return h;
+}
+
+int gigatron_rom_load(struct gigatron_rom **prom,
+                      const char *rom_filename)
+{
+    struct gigatron_rom *rom;
+    struct stat st;
+    size_t size;
+    int fd;
+
+    fd = open(rom_filename, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "could not open file `%s` for reading\n",
+                rom_filename);
+        return FALSE;
+    }
+
+    if (fstat(fd, &st) != 0) {
+        fprintf(stderr, "could not stat file `%s`\n", rom_filename);
+        close(fd);
+        return FALSE;
+    }
+
+    size = (size_t) st.st_size;
+    if (size == 0 || (size % sizeof(uint16_t)) != 0) {
+        fprintf(stderr, "invalid rom size in `%s`: %lu bytes\n",
+                rom_filename, (unsigned long) size);
+        close(fd);
+        return FALSE;
+    }
+
+    rom = calloc(1, sizeof(*rom));
+    if (!rom) {
+        fprintf(stderr, "memory exhausted\n");
+        close(fd);
+        return FALSE;
+    }
+
+    if (size > GIGATRON_ROM_SIZE) {
+        fprintf(stderr, "rom `%s` is too large (%lu bytes), "
+                "ignoring the extra bytes\n",
+                rom_filename, (unsigned long) size);
+    }
+
+    if (size >= GIGATRON_ROM_SIZE) {
+        rom->map = mmap(NULL, GIGATRON_ROM_SIZE, PROT_READ,
+                        MAP_PRIVATE, fd, 0);
+        if (rom->map == MAP_FAILED) rom->map = NULL;
+    }
+
+    if (!rom->map) {
+        /* Fall back to reading the file. */
+        if (size < GIGATRON_ROM_SIZE) {
+            fprintf(stderr, "rom `%s` is too short (%lu bytes), "
+                    "padding with zeros\n",
+                    rom_filename, (unsigned long) size);
+        } else {
+            size = GIGATRON_ROM_SIZE;
+        }
+
+        rom->buf = calloc(GIGATRON_ROM_WORDS, sizeof(uint16_t));
+        if (!rom->buf) {
+            fprintf(stderr, "memory exhausted\n");
+            goto fail_load;
+        }
+
+        if (pread(fd, rom->buf, size, 0) != (ssize_t) size) {
+            fprintf(stderr, "could not read file `%s`\n",
+                    rom_filename);
+            goto fail_load;
+        }
+    }
+
+    close(fd);
+
+    rom->data = (rom->map) ? rom->map : rom->buf;
+    rom->hash = hash_rom(rom->data);
+    rom->refcount = 1;
+
+    *prom = rom;
+    return TRUE;
+
+fail_load:
+    close(fd);
+    if (rom->buf) free(rom->buf);
+    free(rom);
+    return FALSE;
+}
+
+struct gigatron_rom *gigatron_rom_acquire(struct gigatron_rom *rom)
+{
+    __atomic_add_fetch(&rom->refcount, 1, __ATOMIC_RELAXED);
+    return rom;
+}
+
+void gigatron_rom_release(struct gigatron_rom *rom)
+{
+    int i;
+
+    if (__atomic_sub_fetch(&rom->refcount, 1, __ATOMIC_ACQ_REL) != 0)
+        return;
+
+    for (i = 0; i < ROM_NUM_CACHES; i++) {
+        struct gigatron_rom_cache *cache;
+
+        cache = &rom->caches[i];
+        if (cache->data && cache->destroy)
+            cache->destroy(cache->data);
+    }
+
+    if (rom->map) munmap(rom->map, GIGATRON_ROM_SIZE);
+    if (rom->buf) free(rom->buf);
+    free(rom);
+}
+
+void *gigatron_rom_cache_get(struct gigatron_rom *rom,
+                             enum gigatron_rom_cache_id id)
+{
+    return __atomic_load_n(&rom->caches[id].data, __ATOMIC_ACQUIRE);
+}
+
+void *gigatron_rom_cache_set(struct gigatron_rom *rom,
+                             enum gigatron_rom_cache_id id,
+                             void *data, void (*destroy)(void *data))
+{
+    struct gigatron_rom_cache *cache;
+    void *expected;
+
+    cache = &rom->caches[id];
+    expected = NULL;
+    if (__atomic_compare_exchange_n(&cache->data, &expected, data,
+                                    FALSE, __ATOMIC_ACQ_REL,
+                                    __ATOMIC_ACQUIRE)) {
+        /* The destructor is only used when the last reference is
+         * released, which synchronizes with this thread.
+         */
+        cache->destroy = destroy;
+        return data;
+    }
+
+    if (data && destroy) destroy(data);
+    return expected;
+}
@@ -0,0 +1,81 @@
+#ifndef __ROM_H
+#define __ROM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Constants. */
+
+/* Number of 16-bit words in a ROM image. */
+#define GIGATRON_ROM_WORDS 65536
+
+/* Size of a ROM image (in bytes). */
+#define GIGATRON_ROM_SIZE (GIGATRON_ROM_WORDS * sizeof(uint16_t))
+
+/* Identifiers of the caches of data derived from the ROM. */
+enum gigatron_rom_cache_id {
+    ROM_CACHE_USER = 0,  /* Free for use by applications. */
+    ROM_CACHE_LISTING,   /* Disassembly listing (see `disasm.h`). */
+    ROM_NUM_CACHES
+};
+
+/* Data structures and type declarations. */
+
+/* A cache of data derived from the ROM contents. */
+struct gigatron_rom_cache {
+    void *data;                  /* The cached data. */
+    void (*destroy)(void *data); /* Function to deallocate `data`. */
+};
+
+/* A ROM image shared (read-only) by many instances.
+ * The image is reference counted, and it is destroyed when the
+ * last reference is released.
+ */
+struct gigatron_rom {
+    const uint16_t *data; /* The contents of the ROM. */
+    uint64_t hash;        /* The hash (FNV-1a) of the contents. */
+
+    void *map;            /* The mapping of the ROM file (or NULL). */
+    uint16_t *buf;        /* The allocated buffer (if not mapped). */
+
+    int refcount;         /* Number of references to the image. */
+    struct gigatron_rom_cache caches[ROM_NUM_CACHES];
+};
+
+/* Exported functions. */
+
+/* Loads the ROM image in the file `rom_filename`.
+ * The file is mapped in memory when it has the right size.
+ * Shorter files are padded with zeros (with a warning).
+ * The image is returned in `*prom` with one reference owned by
+ * the caller. On success, this function returns TRUE.
+ */
+int gigatron_rom_load(struct gigatron_rom **prom,
+                      const char *rom_filename);
+
+/* Acquires one more reference to the ROM image `rom`.
+ * Returns `rom` for convenience.
+ */
+struct gigatron_rom *gigatron_rom_acquire(struct gigatron_rom *rom);
+
+/* Releases one reference to the ROM image `rom`. */
+void gigatron_rom_release(struct gigatron_rom *rom);
+
+/* Obtains the cache with identifier `id` of the ROM `rom`.
+ * Returns NULL if the cache was not set yet.
+ */
+void *gigatron_rom_cache_get(struct gigatron_rom *rom,
+                             enum gigatron_rom_cache_id id);
+
+/* Sets the cache with identifier `id` of the ROM `rom` to `data`.
+ * The function `destroy` (which can be NULL) is called to
+ * deallocate `data` when the image is destroyed. If the cache
+ * was already set (for example, by another thread), `data` is
+ * destroyed instead, and the existing data is returned.
+ * Otherwise, this function returns `data`.
+ */
+void *gigatron_rom_cache_set(struct gigatron_rom *rom,
+                             enum gigatron_rom_cache_id id,
+                             void *data, void (*destroy)(void *data));
+
+#endif /* __ROM_H */
@@ -0,0 +1,55 @@
+/* Reconstruction of the display from the RAM. */
+
+#include "screen.h"
+
+/* Returns the pointer to the pixels of the line `y`, and its
+ * horizontal offset in `dx`. Returns NULL if the line is outside of
+ * the RAM (it reads as black, as on the real hardware with missing
+ * RAM).
+ */
+static const uint8_t *line_pixels(const struct gigatron_state *gs,
+                                  uint32_t y, uint8_t *dx)
+{
+    uint32_t entry, page;
+
+    entry = SCREEN_VIDEO_TABLE + 2 * y;
+    if (entry + 1 >= gs->ram_size) return NULL;
+
+    page = gs->ram[entry];
+    *dx = gs->ram[entry + 1];
+    if ((page << 8) + 0xFF >= gs->ram_size) return NULL;
+    return &gs->ram[page << 8];
+}
+
+void gigatron_screen_read(const struct gigatron_state *gs, uint8_t *pixels)
+{
+    const uint8_t *line;
+    uint32_t x, y;
+    uint8_t dx;
+
+    for (y = 0; y < SCREEN_HEIGHT; y++) {
+        line = line_pixels(gs, y, &dx);
+        for (x = 0; x < SCREEN_WIDTH; x++) {
+            /* The offset wraps around within the page. */
+            pixels[x] = (line) ? (line[(uint8_t) (dx + x)] & 0x3F) : 0;
+        }
+        pixels += SCREEN_WIDTH;
+    }
+}
+
+void gigatron_screen_render(const struct gigatron_state *gs,
+                            uint32_t *pixels, uint32_t pitch)
+{
+    const uint8_t *line;
+    uint32_t x, y;
+    uint8_t dx;
+
+    for (y = 0; y < SCREEN_HEIGHT; y++) {
+        line = line_pixels(gs, y, &dx);
+        for (x = 0; x < SCREEN_WIDTH; x++) {
+            pixels[x] = (line)
+                ? gigatron_screen_color(line[(uint8_t) (dx + x)]) : 0;
+        }
+        pixels += pitch;
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef __SCREEN_H
+#define __SCREEN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "gigatron.h"
+
+/* Constants. */
+
+/* Size of the display (in Gigatron pixels). */
+#define SCREEN_WIDTH  160
+#define SCREEN_HEIGHT 120
+
+/* Address of the video table in RAM. Each of the 120 lines has two
+ * bytes: the page with the pixels of the line, and its horizontal
+ * offset (dX, for scrolling).
+ */
+#define SCREEN_VIDEO_TABLE 0x0100
+
+/* Exported functions. */
+
+/* Rebuilds the display from the RAM of `gs`, as the ROM would draw it
+ * in the next frame, without running the video pipeline. The
+ * 160x120 pixels (the 6-bit colors, `BBGGRR`) are written to
+ * `pixels`, which holds `SCREEN_WIDTH * SCREEN_HEIGHT` bytes.
+ * This can be called at any cycle.
+ */
+void gigatron_screen_read(const struct gigatron_state *gs, uint8_t *pixels);
+
+/* Same as `gigatron_screen_read()`, but the pixels are converted to
+ * ARGB8888 (as in the frame buffer of the emulator) and written to
+ * `pixels`, with `pitch` pixels per line.
+ */
+void gigatron_screen_render(const struct gigatron_state *gs,
+                            uint32_t *pixels, uint32_t pitch);
+
+/* Converts the 6-bit color `color` to ARGB8888. */
+static inline uint32_t gigatron_screen_color(uint8_t color)
+{
+    return ((uint32_t) ((color & 0x03) << 6) << 16)
+        | ((uint32_t) ((color & 0x0C) << 4) << 8)
+        | ((uint32_t) ((color & 0x30) << 2));
+}
+
+#endif /* __SCREEN_H */
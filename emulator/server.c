@@ -0,0 +1,387 @@
+/* Automation server (Unix domain socket). */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "backend.h"
+#include "byteorder.h"
+#include "dirty.h"
+#include "gigatron.h"
+#include "server.h"
+#include "shm.h"
+
+/* Initial size of the reply buffer. */
+#define REPLY_INITIAL_SIZE 4096
+
+/* Writes exactly `size` bytes to the non-blocking socket `fd`,
+ * waiting at most SERVER_WRITE_TIMEOUT_MS each time it is full.
+ * Returns FALSE on error or when the time runs out.
+ */
+static int write_full(int fd, const void *buf, size_t size)
+{
+    struct pollfd pfd;
+    const uint8_t *p;
+    ssize_t n;
+    int ret;
+
+    p = (const uint8_t *) buf;
+    while (size > 0) {
+        n = send(fd, p, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            pfd.fd = fd;
+            pfd.events = POLLOUT;
+            pfd.revents = 0;
+            ret = poll(&pfd, 1, SERVER_WRITE_TIMEOUT_MS);
+            if (ret < 0 && errno == EINTR) continue;
+            if (ret <= 0) return FALSE;
+            continue;
+        }
+        if (n <= 0) return FALSE;
+        p += n;
+        size -= (size_t) n;
+    }
+    return TRUE;
+}
+
+/* Disconnects the client. */
+static void close_client(struct gigatron_server *srv)
+{
+    if (srv->client_fd >= 0) {
+        close(srv->client_fd);
+        srv->client_fd = -1;
+    }
+    srv->request_size = 0;
+}
+
+/* Appends a result to the reply, and returns a pointer to its `size`
+ * bytes of data (or NULL if the memory is exhausted).
+ */
+static uint8_t *add_result(struct gigatron_server *srv, uint8_t opcode,
+                           uint8_t status, uint32_t size)
+{
+    uint8_t *p;
+    size_t needed;
+
+    needed = srv->reply_size + SERVER_RESULT_HEADER_SIZE + size;
+    if (needed > srv->reply_capacity) {
+        size_t capacity;
+
+        capacity = 2 * srv->reply_capacity;
+        if (capacity < needed) capacity = needed;
+        p = (uint8_t *) realloc(srv->reply, capacity);
+        if (!p) return NULL;
+        srv->reply = p;
+        srv->reply_capacity = capacity;
+    }
+
+    p = &srv->reply[srv->reply_size];
+    p[0] = opcode;
+    p[1] = status;
+    p[2] = p[3] = 0;
+    gigatron_put_le(&p[4], size, 4);
+    srv->reply_size = needed;
+    return &p[SERVER_RESULT_HEADER_SIZE];
+}
+
+/* Executes the command `cmd`, and appends its result to the reply.
+ * Returns FALSE if the memory is exhausted.
+ */
+static int run_command(struct gigatron_server *srv,
+                       const struct server_command *cmd)
+{
+    struct gigatron_state *gs;
+    const struct gigatron_shm_header *header;
+    const uint8_t *ram;
+    uint8_t *p;
+
+    gs = &srv->be->gs;
+    switch (cmd->opcode) {
+    case SERVER_SET_INPUT:
+        gs->in = cmd->value;
+        p = add_result(srv, cmd->opcode, SERVER_OK, 0);
+        break;
+
+    case SERVER_RUN_CYCLES:
+        srv->hooks.run_cycles(srv->hooks.arg, cmd->count);
+        p = add_result(srv, cmd->opcode, SERVER_OK, 8);
+        if (p) gigatron_put_le(p, gs->num_cycles, 8);
+        break;
+
+    case SERVER_RUN_FRAMES:
+        srv->hooks.run_frames(srv->hooks.arg, cmd->count);
+        p = add_result(srv, cmd->opcode, SERVER_OK, 12);
+        if (p) {
+            gigatron_put_le(p, gs->num_cycles, 8);
+            gigatron_put_le(&p[8], *srv->frame_count, 4);
+        }
+        break;
+
+    case SERVER_GET_REGS:
+        p = add_result(srv, cmd->opcode, SERVER_OK, 22);
+        if (p) {
+            gigatron_put_le(p, gs->num_cycles, 8);
+            gigatron_put_le(&p[8], gs->pc, 2);
+            gigatron_put_le(&p[10], gs->prev_pc, 2);
+            p[12] = gs->reg_ir;
+            p[13] = gs->reg_d;
+            p[14] = gs->reg_acc;
+            p[15] = gs->reg_x;
+            p[16] = gs->reg_y;
+            p[17] = gs->reg_out;
+            p[18] = gs->reg_xout;
+            p[19] = gs->reg_in;
+            p[20] = gs->in;
+            p[21] = gs->prev_out;
+        }
+        break;
+
+    case SERVER_READ_RAM:
+        if ((uint64_t) cmd->addr + cmd->count > gs->ram_size) {
+            p = add_result(srv, cmd->opcode, SERVER_INVALID_ARGUMENT, 0);
+            break;
+        }
+        ram = gigatron_backend_ram(srv->be);
+        p = add_result(srv, cmd->opcode, SERVER_OK, cmd->count);
+        if (p) memcpy(p, &ram[cmd->addr], cmd->count);
+        break;
+
+    case SERVER_WRITE_RAM:
+        if (!(srv->be->ops->flags & BACKEND_LIVE_RAM)) {
+            p = add_result(srv, cmd->opcode, SERVER_UNAVAILABLE, 0);
+        } else if (cmd->addr >= gs->ram_size) {
+            p = add_result(srv, cmd->opcode, SERVER_INVALID_ARGUMENT, 0);
+        } else {
+            gs->ram[cmd->addr] = cmd->value;
+            if (gs->dirty) gigatron_dirty_mark(gs->dirty, cmd->addr);
+            p = add_result(srv, cmd->opcode, SERVER_OK, 0);
+        }
+        break;
+
+    case SERVER_PUBLISH:
+        if (!srv->shm) {
+            p = add_result(srv, cmd->opcode, SERVER_UNAVAILABLE, 0);
+            break;
+        }
+        gigatron_backend_ram(srv->be);
+        gigatron_shm_publish(srv->shm, gs, srv->pixels);
+
+        header = srv->shm->header;
+        p = add_result(srv, cmd->opcode, SERVER_OK, 24);
+        if (p) {
+            gigatron_put_le(p, header->seq, 4);
+            gigatron_put_le(&p[4], header->frame, 4);
+            gigatron_put_le(&p[8], header->ram_offset, 4);
+            gigatron_put_le(&p[12], header->fb_offset, 4);
+            gigatron_put_le(&p[16], header->fb_width, 4);
+            gigatron_put_le(&p[20], header->fb_height, 4);
+        }
+        break;
+
+    case SERVER_RESET:
+        srv->hooks.reset(srv->hooks.arg);
+        p = add_result(srv, cmd->opcode, SERVER_OK, 0);
+        break;
+
+    case SERVER_QUIT:
+        srv->hooks.quit(srv->hooks.arg);
+        p = add_result(srv, cmd->opcode, SERVER_OK, 0);
+        break;
+
+    default:
+        p = add_result(srv, cmd->opcode, SERVER_UNKNOWN_COMMAND, 0);
+        break;
+    }
+
+    return p != NULL;
+}
+
+/* Executes the `num` commands of the request received, and sends
+ * the reply. Returns FALSE if the client must be disconnected.
+ */
+static int serve_request(struct gigatron_server *srv, uint32_t num)
+{
+    struct server_command cmd;
+    const uint8_t *c;
+    uint32_t i;
+
+    srv->reply_size = SERVER_REPLY_HEADER_SIZE;
+    for (i = 0; i < num; i++) {
+        c = &srv->request[SERVER_REQUEST_HEADER_SIZE
+                          + i * SERVER_COMMAND_SIZE];
+        cmd.opcode = c[0];
+        cmd.value = c[1];
+        cmd.addr = (uint16_t) gigatron_get_le(&c[2], 2);
+        cmd.count = (uint32_t) gigatron_get_le(&c[4], 4);
+
+        if (!run_command(srv, &cmd)) {
+            fprintf(stderr, "server: memory exhausted\n");
+            return FALSE;
+        }
+    }
+    srv->requests++;
+    srv->commands_run += num;
+
+    gigatron_put_le(srv->reply, srv->reply_size - 4, 4);
+    gigatron_put_le(&srv->reply[4], num, 4);
+    return write_full(srv->client_fd, srv->reply, srv->reply_size);
+}
+
+/* Reads the data available from the client without blocking, and
+ * serves the requests it completes. A partial request stays in
+ * `srv->request` until the next call. The client is disconnected at
+ * the end of the stream, or if a request is invalid.
+ */
+static void receive_requests(struct gigatron_server *srv)
+{
+    size_t needed;
+    uint32_t num;
+    ssize_t n;
+
+    for (;;) {
+        num = 0;
+        needed = SERVER_REQUEST_HEADER_SIZE;
+        if (srv->request_size >= SERVER_REQUEST_HEADER_SIZE) {
+            num = (uint32_t) gigatron_get_le(srv->request, 4);
+            if (num > SERVER_MAX_COMMANDS) {
+                fprintf(stderr, "server: too many commands (%u)\n", num);
+                close_client(srv);
+                return;
+            }
+            needed += ((size_t) num) * SERVER_COMMAND_SIZE;
+        }
+
+        if (srv->request_size == needed) {
+            srv->request_size = 0;
+            if (!serve_request(srv, num)) {
+                close_client(srv);
+                return;
+            }
+            continue;
+        }
+
+        n = read(srv->client_fd, &srv->request[srv->request_size],
+                 needed - srv->request_size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        if (n <= 0) {
+            close_client(srv);
+            return;
+        }
+        srv->request_size += (size_t) n;
+    }
+}
+
+int gigatron_server_create(struct gigatron_server *srv, const char *path,
+                           struct gigatron_backend *be,
+                           struct gigatron_shm *shm,
+                           const uint32_t *pixels,
+                           const uint32_t *frame_count,
+                           const struct gigatron_server_hooks *hooks)
+{
+    struct sockaddr_un addr;
+    struct stat st;
+
+    memset(srv, 0, sizeof(*srv));
+    srv->listen_fd = -1;
+    srv->client_fd = -1;
+    srv->be = be;
+    srv->shm = shm;
+    srv->pixels = pixels;
+    srv->frame_count = frame_count;
+    srv->hooks = *hooks;
+
+    if (strlen(path) >= sizeof(srv->path)
+        || strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "socket path `%s` is too long\n", path);
+        return FALSE;
+    }
+    strcpy(srv->path, path);
+
+    srv->request = (uint8_t *)
+        malloc(SERVER_REQUEST_HEADER_SIZE
+               + SERVER_MAX_COMMANDS * SERVER_COMMAND_SIZE);
+    srv->reply_capacity = REPLY_INITIAL_SIZE;
+    srv->reply = (uint8_t *) malloc(srv->reply_capacity);
+    if (!srv->request || !srv->reply) {
+        fprintf(stderr, "memory exhausted\n");
+        goto fail_create;
+    }
+
+    srv->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (srv->listen_fd < 0) {
+        fprintf(stderr, "could not create socket\n");
+        goto fail_create;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    /* A socket left behind by a previous run is replaced, but any
+     * other file is left alone (and bind() then fails).
+     */
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+        unlink(path);
+    if (bind(srv->listen_fd, (struct sockaddr *) &addr, sizeof(addr)) != 0
+        || listen(srv->listen_fd, 1) != 0) {
+        fprintf(stderr, "could not listen on `%s`\n", path);
+        goto fail_create;
+    }
+    return TRUE;
+
+fail_create:
+    if (srv->listen_fd >= 0) close(srv->listen_fd);
+    free(srv->request);
+    free(srv->reply);
+    return FALSE;
+}
+
+void gigatron_server_destroy(struct gigatron_server *srv)
+{
+    close_client(srv);
+    close(srv->listen_fd);
+    unlink(srv->path);
+    free(srv->request);
+    free(srv->reply);
+}
+
+int gigatron_server_poll(struct gigatron_server *srv, int timeout_ms)
+{
+    struct pollfd pfd;
+    int ret;
+
+    pfd.fd = (srv->client_fd >= 0) ? srv->client_fd : srv->listen_fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+
+    ret = poll(&pfd, 1, timeout_ms);
+    if (ret < 0) {
+        if (errno == EINTR) return TRUE;
+        fprintf(stderr, "server: poll failed\n");
+        return FALSE;
+    }
+    if (ret == 0) return TRUE;
+
+    if (srv->client_fd < 0) {
+        srv->client_fd = accept(srv->listen_fd, NULL, NULL);
+        if (srv->client_fd >= 0
+            && fcntl(srv->client_fd, F_SETFL, O_NONBLOCK) != 0) {
+            fprintf(stderr, "server: could not set up the client\n");
+            close_client(srv);
+        }
+        return TRUE;
+    }
+
+    if (pfd.revents & (POLLIN | POLLHUP | POLLERR))
+        receive_requests(srv);
+    return TRUE;
+}
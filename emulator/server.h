@@ -0,0 +1,139 @@
+#ifndef __SERVER_H
+#define __SERVER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "backend.h"
+#include "gigatron.h"
+#include "shm.h"
+
+/* Constants. */
+
+/* Maximum number of commands in a request. */
+#define SERVER_MAX_COMMANDS 4096
+
+/* Size of a command, of the header of a reply, and of the header of
+ * each result in a reply.
+ */
+#define SERVER_COMMAND_SIZE 8
+#define SERVER_REPLY_HEADER_SIZE 8
+#define SERVER_RESULT_HEADER_SIZE 8
+
+/* Size of the header of a request (the number of commands). */
+#define SERVER_REQUEST_HEADER_SIZE 4
+
+/* Time given to the client to make room for a reply. */
+#define SERVER_WRITE_TIMEOUT_MS 1000
+
+/* The commands (the results they return are given in parentheses).
+ * The emulation only runs in SERVER_RUN_CYCLES and SERVER_RUN_FRAMES,
+ * so the state stays still between the requests.
+ */
+enum server_opcode {
+    SERVER_SET_INPUT = 1,  /* Sets the input to `value` (nothing). */
+    SERVER_RUN_CYCLES,     /* Runs `count` cycles (u64 cycle). */
+    SERVER_RUN_FRAMES,     /* Runs until the `count`-th next VSYNC
+                            * (u64 cycle, u32 frame). */
+    SERVER_GET_REGS,       /* Reads the registers (u64 cycle, u16 pc,
+                            * u16 prev_pc, then ir, d, acc, x, y, out,
+                            * xout, reg_in, in and prev_out as u8). */
+    SERVER_READ_RAM,       /* Reads `count` bytes of RAM at `addr`
+                            * (the bytes). */
+    SERVER_WRITE_RAM,      /* Writes `value` at `addr` (nothing). */
+    SERVER_PUBLISH,        /* Publishes the registers, the RAM and the
+                            * frame buffer in the shared memory (u32
+                            * seq, u32 frame, u32 ram_offset, u32
+                            * fb_offset, u32 fb_width, u32 fb_height). */
+    SERVER_RESET,          /* Resets the computer (nothing). */
+    SERVER_QUIT            /* Stops the emulator (nothing). */
+};
+
+/* Status of the results. */
+enum server_status {
+    SERVER_OK = 0,
+    SERVER_UNKNOWN_COMMAND,
+    SERVER_INVALID_ARGUMENT,
+    SERVER_UNAVAILABLE     /* Not supported by this configuration. */
+};
+
+/* Data structures and type declarations. */
+
+/* A command, as received (8 bytes, in little endian). */
+struct server_command {
+    uint8_t opcode;
+    uint8_t value;
+    uint16_t addr;
+    uint32_t count;
+};
+
+/* Hooks called by the server to run the emulator. */
+struct gigatron_server_hooks {
+    void *arg;           /* The argument of the hooks. */
+    void (*run_cycles)(void *arg, uint64_t num_cycles);
+    void (*run_frames)(void *arg, uint32_t num_frames);
+    void (*reset)(void *arg);
+    void (*quit)(void *arg);
+};
+
+/* The automation server.
+ * Clients connect to a Unix domain socket (one at a time), and send
+ * requests: a u32 with the number of commands, followed by the
+ * commands (see `struct server_command`). The commands are executed
+ * in order, and the server answers with one reply: a u32 with the
+ * size of the rest of the reply, a u32 with the number of results,
+ * and one result per command: opcode (u8), status (u8), 2 reserved
+ * bytes, the size of the data (u32), and the data. All the integers
+ * are in little endian. Frames are not copied in the replies:
+ * SERVER_PUBLISH gives their place in the shared memory (`--shm`).
+ * The client socket is non-blocking: a request is buffered across
+ * the polls until it is complete, so a slow client never stalls the
+ * emulation. A client which does not read its reply within
+ * SERVER_WRITE_TIMEOUT_MS is disconnected.
+ */
+struct gigatron_server {
+    int listen_fd;
+    int client_fd;       /* The connected client (or -1). */
+    char path[108];      /* The path of the socket. */
+
+    struct gigatron_backend *be;
+    struct gigatron_shm *shm;  /* The shared memory (or NULL). */
+    const uint32_t *pixels;    /* The frame buffer. */
+    const uint32_t *frame_count;
+    struct gigatron_server_hooks hooks;
+
+    uint8_t *request;    /* The request being received. */
+    size_t request_size; /* Bytes of it received so far. */
+    uint8_t *reply;      /* The reply being built. */
+    size_t reply_size, reply_capacity;
+
+    uint64_t requests;   /* Requests served. */
+    uint64_t commands_run;
+};
+
+/* Exported functions. */
+
+/* Creates the server `srv` listening on the Unix domain socket
+ * `path`, for the backend `be`, the shared memory `shm` (which can
+ * be NULL), the frame buffer `pixels` and the counter of frames
+ * `frame_count` of the frontend.
+ * On success, this function returns TRUE.
+ */
+int gigatron_server_create(struct gigatron_server *srv, const char *path,
+                           struct gigatron_backend *be,
+                           struct gigatron_shm *shm,
+                           const uint32_t *pixels,
+                           const uint32_t *frame_count,
+                           const struct gigatron_server_hooks *hooks);
+
+/* Closes the sockets, and removes the socket file. */
+void gigatron_server_destroy(struct gigatron_server *srv);
+
+/* Waits at most `timeout_ms` milliseconds (-1 for no limit) for
+ * data from the client, accepting a client if there is none, and
+ * serves the requests completed by this data.
+ * Returns FALSE on a fatal error.
+ */
+int gigatron_server_poll(struct gigatron_server *srv, int timeout_ms);
+
+#endif /* __SERVER_H */
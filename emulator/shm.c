@@ -0,0 +1,235 @@
+/* Shared-memory export of the state and the frame buffer. */
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "dirty.h"
+#include "shm.h"
+
+/* Alignment of the areas in the segment. */
+#define SHM_ALIGN 64
+
+/* Rounds `v` up to a multiple of `SHM_ALIGN`. */
+static uint32_t align_up(uint32_t v)
+{
+    return (v + SHM_ALIGN - 1) & ~((uint32_t) SHM_ALIGN - 1);
+}
+
+/* Copies the `ram_size` first bytes of `ram` to `dest`, but only the
+ * blocks marked in the dirty bitmap `dt`.
+ */
+static void copy_dirty(uint8_t *dest, const uint8_t *ram, uint32_t ram_size,
+                       struct gigatron_dirty *dt)
+{
+    uint64_t bits[DIRTY_MAX_WORDS];
+    uint64_t rest;
+    uint32_t i, start, size;
+
+    gigatron_dirty_fetch(dt, bits);
+    for (i = 0; i < dt->num_words; i++) {
+        for (rest = bits[i]; rest; rest &= rest - 1) {
+            start = (64 * i + (uint32_t) __builtin_ctzll(rest)) << dt->shift;
+            if (start >= ram_size) break;
+            size = ((uint32_t) 1) << dt->shift;
+            if (size > ram_size - start) size = ram_size - start;
+            memcpy(&dest[start], &ram[start], size);
+        }
+    }
+}
+
+/* Copies the name of the segment, which must start with '/'. */
+static void set_name(struct gigatron_shm *shm, const char *name)
+{
+    snprintf(shm->name, sizeof(shm->name), "%s%s",
+             (name[0] == '/') ? "" : "/", name);
+}
+
+/* Sets the pointers to the areas of the segment. */
+static void set_areas(struct gigatron_shm *shm)
+{
+    uint8_t *base;
+
+    base = (uint8_t *) shm->header;
+    shm->ram = &base[shm->header->ram_offset];
+    shm->fb = (uint32_t *) &base[shm->header->fb_offset];
+}
+
+int gigatron_shm_create(struct gigatron_shm *shm, const char *name,
+                        uint32_t ram_size, uint32_t fb_width,
+                        uint32_t fb_height)
+{
+    struct gigatron_shm_header *header;
+    uint32_t ram_offset, fb_offset, size;
+    void *ptr;
+    int fd;
+
+    set_name(shm, name);
+    shm->header = NULL;
+    shm->owner = TRUE;
+
+    ram_offset = align_up(sizeof(*header));
+    fb_offset = align_up(ram_offset + ram_size);
+    size = fb_offset + fb_width * fb_height * sizeof(uint32_t);
+
+    fd = shm_open(shm->name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "could not create shared memory `%s`\n",
+                shm->name);
+        return FALSE;
+    }
+
+    if (ftruncate(fd, (off_t) size) != 0) {
+        fprintf(stderr, "could not resize shared memory `%s`\n",
+                shm->name);
+        goto fail_create;
+    }
+
+    ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (ptr == MAP_FAILED) {
+        fprintf(stderr, "could not map shared memory `%s`\n",
+                shm->name);
+        goto fail_create;
+    }
+    close(fd);
+
+    header = (struct gigatron_shm_header *) ptr;
+    memset(header, 0, sizeof(*header));
+    header->version = SHM_VERSION;
+    header->ram_size = ram_size;
+    header->ram_offset = ram_offset;
+    header->fb_width = fb_width;
+    header->fb_height = fb_height;
+    header->fb_offset = fb_offset;
+    header->size = size;
+
+    /* The magic is written last, so that the readers do not use a
+     * partially initialized segment.
+     */
+    __atomic_store_n(&header->magic, SHM_MAGIC, __ATOMIC_RELEASE);
+
+    shm->header = header;
+    set_areas(shm);
+    return TRUE;
+
+fail_create:
+    close(fd);
+    shm_unlink(shm->name);
+    return FALSE;
+}
+
+int gigatron_shm_open(struct gigatron_shm *shm, const char *name)
+{
+    struct gigatron_shm_header *header;
+    struct stat st;
+    void *ptr;
+    int fd;
+
+    set_name(shm, name);
+    shm->header = NULL;
+    shm->owner = FALSE;
+
+    fd = shm_open(shm->name, O_RDONLY, 0);
+    if (fd < 0) {
+        fprintf(stderr, "could not open shared memory `%s`\n",
+                shm->name);
+        return FALSE;
+    }
+
+    if (fstat(fd, &st) != 0
+        || (size_t) st.st_size < sizeof(struct gigatron_shm_header)) {
+        fprintf(stderr, "invalid shared memory `%s`\n", shm->name);
+        close(fd);
+        return FALSE;
+    }
+
+    ptr = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED) {
+        fprintf(stderr, "could not map shared memory `%s`\n",
+                shm->name);
+        return FALSE;
+    }
+
+    header = (struct gigatron_shm_header *) ptr;
+    if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != SHM_MAGIC
+        || header->version != SHM_VERSION
+        || header->size != (uint32_t) st.st_size) {
+        fprintf(stderr, "invalid shared memory `%s`\n", shm->name);
+        munmap(ptr, (size_t) st.st_size);
+        return FALSE;
+    }
+
+    shm->header = header;
+    set_areas(shm);
+    return TRUE;
+}
+
+void gigatron_shm_destroy(struct gigatron_shm *shm)
+{
+    if (!shm->header) return;
+
+    munmap(shm->header, shm->header->size);
+    if (shm->owner)
+        shm_unlink(shm->name);
+    shm->header = NULL;
+}
+
+void gigatron_shm_publish(struct gigatron_shm *shm,
+                          const struct gigatron_state *gs,
+                          const uint32_t *pixels)
+{
+    struct gigatron_shm_header *header;
+    struct gigatron_shm_regs *regs;
+    uint32_t seq, ram_size;
+
+    header = shm->header;
+    seq = header->seq;
+    __atomic_store_n(&header->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    regs = &header->regs;
+    regs->num_cycles = gs->num_cycles;
+    regs->pc = gs->pc;
+    regs->prev_pc = gs->prev_pc;
+    regs->ir = gs->reg_ir;
+    regs->d = gs->reg_d;
+    regs->acc = gs->reg_acc;
+    regs->x = gs->reg_x;
+    regs->y = gs->reg_y;
+    regs->out = gs->reg_out;
+    regs->xout = gs->reg_xout;
+    regs->in = gs->reg_in;
+
+    ram_size = (gs->ram_size < header->ram_size)
+        ? gs->ram_size : header->ram_size;
+    if (gs->dirty) {
+        copy_dirty(shm->ram, gs->ram, ram_size, gs->dirty);
+    } else {
+        memcpy(shm->ram, gs->ram, ram_size);
+    }
+
+    if (pixels) {
+        memcpy(shm->fb, pixels, ((size_t) header->fb_width)
+               * header->fb_height * sizeof(uint32_t));
+    }
+
+    header->frame++;
+    __atomic_store_n(&header->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+uint32_t gigatron_shm_read_begin(const struct gigatron_shm *shm)
+{
+    return __atomic_load_n(&shm->header->seq, __ATOMIC_ACQUIRE);
+}
+
+int gigatron_shm_read_retry(const struct gigatron_shm *shm,
+                            uint32_t seq)
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return (seq & 1)
+        || __atomic_load_n(&shm->header->seq, __ATOMIC_RELAXED) != seq;
+}
@@ -0,0 +1,104 @@
+#ifndef __SHM_H
+#define __SHM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "gigatron.h"
+
+/* Constants. */
+
+/* Magic number and version of the shared-memory segments. */
+#define SHM_MAGIC   0x4D535447 /* "GTSM" */
+#define SHM_VERSION 1
+
+/* Data structures and type declarations. */
+
+/* The register block of the segment. */
+struct gigatron_shm_regs {
+    uint64_t num_cycles;
+    uint16_t pc;
+    uint16_t prev_pc;
+    uint8_t ir, d, acc, x, y, out, xout, in;
+};
+
+/* The header at the beginning of the segment.
+ * The writer increments `seq` before and after each update, so it
+ * is odd while the contents are being updated. A reader copies
+ * what it needs between two reads of `seq`, and retries if `seq`
+ * was odd or changed (see `gigatron_shm_read_begin()` and
+ * `gigatron_shm_read_retry()`). The writer never waits for the
+ * readers.
+ */
+struct gigatron_shm_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t seq;        /* The sequence counter (seqlock). */
+    uint32_t frame;      /* Number of frames published. */
+
+    struct gigatron_shm_regs regs;
+
+    uint32_t ram_size;   /* Size of the RAM (in bytes). */
+    uint32_t ram_offset; /* Offset of the RAM in the segment. */
+    uint32_t fb_width;   /* Size of the frame buffer (in pixels). */
+    uint32_t fb_height;
+    uint32_t fb_offset;  /* Offset of the frame buffer (ARGB8888). */
+    uint32_t size;       /* Total size of the segment. */
+};
+
+/* A mapping of a shared-memory segment (by the writer or by a
+ * reader).
+ */
+struct gigatron_shm {
+    struct gigatron_shm_header *header;
+    uint8_t *ram;        /* The RAM in the segment. */
+    uint32_t *fb;        /* The frame buffer in the segment. */
+    char name[64];       /* The name of the segment. */
+    int owner;           /* The segment was created by us. */
+};
+
+/* Exported functions. */
+
+/* Creates the shared-memory segment `name` (for example, "/gtemu"),
+ * for a RAM of `ram_size` bytes and a frame buffer of `fb_width` x
+ * `fb_height` pixels. The segment is removed by
+ * `gigatron_shm_destroy()`.
+ * On success, this function returns TRUE.
+ */
+int gigatron_shm_create(struct gigatron_shm *shm, const char *name,
+                        uint32_t ram_size, uint32_t fb_width,
+                        uint32_t fb_height);
+
+/* Maps (read-only) the existing shared-memory segment `name`.
+ * On success, this function returns TRUE.
+ */
+int gigatron_shm_open(struct gigatron_shm *shm, const char *name);
+
+/* Unmaps the segment (and removes it, if it was created by
+ * `gigatron_shm_create()`).
+ */
+void gigatron_shm_destroy(struct gigatron_shm *shm);
+
+/* Publishes the state `gs` and the frame buffer `pixels` (which
+ * can be NULL) in the segment. This is meant to be called once per
+ * frame. If `gs->dirty` is set, only the blocks of the RAM written
+ * since the last fetch of the bitmap are copied (and the bitmap is
+ * fetched and cleared).
+ */
+void gigatron_shm_publish(struct gigatron_shm *shm,
+                          const struct gigatron_state *gs,
+                          const uint32_t *pixels);
+
+/* Starts a consistent read of the segment. Returns the sequence
+ * counter to be passed to `gigatron_shm_read_retry()`.
+ */
+uint32_t gigatron_shm_read_begin(const struct gigatron_shm *shm);
+
+/* Finishes a read started with `gigatron_shm_read_begin()`.
+ * Returns TRUE if the data read in between may be inconsistent,
+ * and the read must be retried.
+ */
+int gigatron_shm_read_retry(const struct gigatron_shm *shm,
+                            uint32_t seq);
+
+#endif /* __SHM_H */
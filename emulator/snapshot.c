@@ -0,0 +1,144 @@
+/* Snapshots of running instances, and copy-on-write forks. */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "rom.h"
+#include "snapshot.h"
+
+/* Auxiliary function to create the anonymous file that holds
+ * the RAM image of a snapshot.
+ */
+static int create_ram_file(void)
+{
+#ifdef MFD_CLOEXEC
+    return memfd_create("gigatron-ram", MFD_CLOEXEC);
+#else
+    char name[] = "/tmp/gigatron-ram-XXXXXX";
+    int fd;
+
+    fd = mkstemp(name);
+    if (fd >= 0) unlink(name);
+    return fd;
+#endif
+}
+
+int gigatron_snapshot_create(struct gigatron_snapshot **psnap,
+                             const struct gigatron_state *gs)
+{
+    struct gigatron_snapshot *snap;
+    size_t page_size;
+    ssize_t ret;
+    void *ptr;
+
+    snap = malloc(sizeof(*snap));
+    if (!snap) {
+        fprintf(stderr, "memory exhausted\n");
+        return FALSE;
+    }
+
+    page_size = (size_t) sysconf(_SC_PAGESIZE);
+
+    snap->regs = *gs;
+    snap->regs.ram = NULL;
+    snap->regs.snapshot = NULL;
+    snap->regs.dirty = NULL;
+    snap->ram = NULL;
+    snap->ram_size = gs->ram_size;
+    snap->map_size = ((gs->ram_size + page_size - 1) / page_size)
+        * page_size;
+    snap->refcount = 1;
+
+    snap->fd = create_ram_file();
+    if (snap->fd < 0) {
+        fprintf(stderr, "could not create the ram file\n");
+        goto fail_create;
+    }
+
+    if (ftruncate(snap->fd, (off_t) snap->map_size) != 0) {
+        fprintf(stderr, "could not resize the ram file\n");
+        goto fail_create;
+    }
+
+    ret = pwrite(snap->fd, gs->ram, gs->ram_size, 0);
+    if (ret != (ssize_t) gs->ram_size) {
+        fprintf(stderr, "could not write the ram file\n");
+        goto fail_create;
+    }
+
+    ptr = mmap(NULL, snap->map_size, PROT_READ, MAP_SHARED,
+               snap->fd, 0);
+    if (ptr == MAP_FAILED) {
+        fprintf(stderr, "could not map the ram file\n");
+        goto fail_create;
+    }
+    snap->ram = ptr;
+
+    if (snap->regs.rom_image)
+        gigatron_rom_acquire(snap->regs.rom_image);
+
+    *psnap = snap;
+    return TRUE;
+
+fail_create:
+    if (snap->fd >= 0) close(snap->fd);
+    free(snap);
+    return FALSE;
+}
+
+void gigatron_snapshot_release(struct gigatron_snapshot *snap)
+{
+    if (__atomic_sub_fetch(&snap->refcount, 1, __ATOMIC_ACQ_REL) != 0)
+        return;
+
+    if (snap->regs.rom_image)
+        gigatron_rom_release(snap->regs.rom_image);
+    if (snap->ram) munmap(snap->ram, snap->map_size);
+    close(snap->fd);
+    free(snap);
+}
+
+int gigatron_fork(struct gigatron_state *child,
+                  struct gigatron_snapshot *snap)
+{
+    void *ptr;
+
+    ptr = mmap(NULL, snap->map_size, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE, snap->fd, 0);
+    if (ptr == MAP_FAILED) {
+        fprintf(stderr, "could not map the ram file\n");
+        return FALSE;
+    }
+
+    __atomic_add_fetch(&snap->refcount, 1, __ATOMIC_RELAXED);
+    if (snap->regs.rom_image)
+        gigatron_rom_acquire(snap->regs.rom_image);
+
+    *child = snap->regs;
+    child->ram = ptr;
+    child->ram_size = snap->ram_size;
+    child->snapshot = snap;
+    return TRUE;
+}
+
+void gigatron_fork_discard(struct gigatron_state *child)
+{
+    struct gigatron_snapshot *snap;
+
+    snap = child->snapshot;
+    if (!snap) return;
+
+    munmap(child->ram, snap->map_size);
+    if (child->rom_image)
+        gigatron_rom_release(child->rom_image);
+    child->ram = NULL;
+    child->rom_image = NULL;
+    child->rom = NULL;
+    child->snapshot = NULL;
+    gigatron_snapshot_release(snap);
+}
@@ -0,0 +1,60 @@
+#ifndef __SNAPSHOT_H
+#define __SNAPSHOT_H
+
+#include <stdint.h>
+
+#include "gigatron.h"
+
+/* Data structures and type declarations. */
+
+/* A frozen copy of the state of a running instance.
+ * The RAM image is kept in an anonymous memory file, which is
+ * mapped privately by every child created by `gigatron_fork()`.
+ * The children share the pages of the snapshot until they write
+ * to them, at which point the kernel copies the written page
+ * (copy-on-write at the granularity of the host pages).
+ */
+struct gigatron_snapshot {
+    struct gigatron_state regs; /* The registers (RAM not included). */
+
+    int fd;              /* File descriptor of the RAM image. */
+    uint8_t *ram;        /* Read-only mapping of the RAM image. */
+    uint32_t ram_size;   /* The size of the RAM (in bytes). */
+    size_t map_size;     /* Size of the mappings (in bytes). */
+
+    int refcount;        /* Number of references to the snapshot. */
+};
+
+/* Exported functions. */
+
+/* Creates a snapshot of the running instance `gs`.
+ * The snapshot is returned in `*psnap` with one reference, owned
+ * by the caller. The instance `gs` is not modified, and it can
+ * keep running independently of the snapshot.
+ * On success, this function returns TRUE.
+ */
+int gigatron_snapshot_create(struct gigatron_snapshot **psnap,
+                             const struct gigatron_state *gs);
+
+/* Releases one reference to the snapshot `snap`. The snapshot
+ * is destroyed when the last reference is released (each child
+ * holds one reference).
+ */
+void gigatron_snapshot_release(struct gigatron_snapshot *snap);
+
+/* Creates a new instance in `child` with the state of the
+ * snapshot `snap`. The RAM of the child is shared copy-on-write
+ * with the snapshot, so creating a child does not copy the RAM.
+ * The child holds its own reference to the ROM image.
+ * On success, this function returns TRUE.
+ */
+int gigatron_fork(struct gigatron_state *child,
+                  struct gigatron_snapshot *snap);
+
+/* Discards the instance `child` created by `gigatron_fork()`,
+ * releasing its RAM and its reference to the snapshot.
+ * This is also called by `gigatron_destroy()` for such instances.
+ */
+void gigatron_fork_discard(struct gigatron_state *child);
+
+#endif /* __SNAPSHOT_H */
@@ -0,0 +1,182 @@
+/* Live performance and health statistics. */
+
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+
+#include "gigatron.h"
+#include "stats.h"
+
+/* A character of the font (3x5 pixels, one row every 3 bits, with
+ * the top row in the highest bits).
+ */
+struct glyph {
+    char c;
+    uint16_t bits;
+};
+
+/* The font used by `gigatron_stats_draw()`. */
+static const struct glyph font[] = {
+    { '0', 0x7B6F }, { '1', 0x2C97 }, { '2', 0x73E7 }, { '3', 0x73CF },
+    { '4', 0x5BC9 }, { '5', 0x79CF }, { '6', 0x79EF }, { '7', 0x7292 },
+    { '8', 0x7BEF }, { '9', 0x7BCF }, { 'A', 0x2BED }, { 'B', 0x6BAE },
+    { 'C', 0x3923 }, { 'D', 0x6B6E }, { 'E', 0x79A7 }, { 'F', 0x79A4 },
+    { 'G', 0x396B }, { 'H', 0x5BED }, { 'I', 0x7497 }, { 'J', 0x126A },
+    { 'K', 0x5BAD }, { 'L', 0x4927 }, { 'M', 0x5FED }, { 'N', 0x6B6D },
+    { 'O', 0x2B6A }, { 'P', 0x6BA4 }, { 'Q', 0x2B73 }, { 'R', 0x6BAD },
+    { 'S', 0x388E }, { 'T', 0x7492 }, { 'U', 0x5B6F }, { 'V', 0x5B6A },
+    { 'W', 0x5BFD }, { 'X', 0x5AAD }, { 'Y', 0x5A92 }, { 'Z', 0x72A7 },
+    { '.', 0x0002 }, { ':', 0x0410 }, { '%', 0x52A5 }, { '/', 0x12A4 },
+    { '-', 0x01C0 }, { '=', 0x0E38 }
+};
+
+uint64_t gigatron_stats_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t) ts.tv_sec) * 1000000000 + (uint64_t) ts.tv_nsec;
+}
+
+/* Resets the counters of the current window. */
+static void reset_window(struct gigatron_stats *st)
+{
+    st->frames = 0;
+    st->emulate_ns = st->output_ns = 0;
+    st->render_ns = st->present_ns = 0;
+    st->audio_fill = 0;
+    st->audio_min = UINT32_MAX;
+    st->underruns = st->dropped = 0;
+    st->num_inputs = 0;
+    st->latency_ns = st->latency_max_ns = 0;
+}
+
+void gigatron_stats_init(struct gigatron_stats *st, uint32_t interval_ms,
+                         uint64_t num_cycles)
+{
+    memset(st, 0, sizeof(*st));
+    st->interval_ns = ((uint64_t) interval_ms) * 1000000;
+    st->start_ns = st->mark_ns = gigatron_stats_now();
+    st->start_cycles = num_cycles;
+    reset_window(st);
+}
+
+void gigatron_stats_input(struct gigatron_stats *st, uint64_t latency_ns)
+{
+    st->num_inputs++;
+    st->latency_ns += latency_ns;
+    if (latency_ns > st->latency_max_ns)
+        st->latency_max_ns = latency_ns;
+}
+
+void gigatron_stats_audio(struct gigatron_stats *st, uint32_t fill)
+{
+    st->audio_fill = fill;
+    if (fill < st->audio_min)
+        st->audio_min = fill;
+}
+
+int gigatron_stats_end_frame(struct gigatron_stats *st,
+                             uint64_t num_cycles)
+{
+    struct gigatron_stats_window *w;
+    uint64_t now;
+    double frames;
+
+    st->frames++;
+    st->total_frames++;
+
+    now = gigatron_stats_now();
+    if (now - st->start_ns < st->interval_ns)
+        return FALSE;
+
+    w = &st->last;
+    frames = (double) st->frames;
+    w->seconds = (now - st->start_ns) / 1e9;
+    w->mhz = (num_cycles - st->start_cycles) / w->seconds / 1e6;
+    w->fps = frames / w->seconds;
+    w->emulate_ms = st->emulate_ns / frames / 1e6;
+    w->output_ms = st->output_ns / frames / 1e6;
+    w->render_ms = st->render_ns / frames / 1e6;
+    w->present_ms = st->present_ns / frames / 1e6;
+    w->audio_fill = st->audio_fill;
+    w->audio_min = (st->audio_min == UINT32_MAX) ? 0 : st->audio_min;
+    w->underruns = st->underruns;
+    w->dropped = st->dropped;
+    w->latency_ms = (st->num_inputs)
+        ? st->latency_ns / (double) st->num_inputs / 1e6 : 0.0;
+    w->latency_max_ms = st->latency_max_ns / 1e6;
+
+    st->start_ns = now;
+    st->start_cycles = num_cycles;
+    reset_window(st);
+    return TRUE;
+}
+
+size_t gigatron_stats_format(const struct gigatron_stats *st,
+                             char *outbuf, size_t size)
+{
+    const struct gigatron_stats_window *w;
+    int len;
+
+    w = &st->last;
+    len = snprintf(outbuf, size,
+                   "stats frames=%llu mhz=%.3f fps=%.2f "
+                   "emulate_ms=%.3f output_ms=%.3f render_ms=%.3f "
+                   "present_ms=%.3f "
+                   "audio_fill=%u audio_min=%u underruns=%u dropped=%u "
+                   "input_latency_ms=%.1f input_latency_max_ms=%.1f",
+                   (unsigned long long) st->total_frames, w->mhz, w->fps,
+                   w->emulate_ms, w->output_ms, w->render_ms,
+                   w->present_ms,
+                   w->audio_fill, w->audio_min, w->underruns, w->dropped,
+                   w->latency_ms, w->latency_max_ms);
+    if (len < 0) return 0;
+    return ((size_t) len < size) ? (size_t) len : size - 1;
+}
+
+/* Returns the bits of the character `c` (or 0 if not in the font). */
+static uint16_t glyph_bits(char c)
+{
+    size_t i;
+
+    c = (char) toupper((unsigned char) c);
+    for (i = 0; i < sizeof(font) / sizeof(font[0]); i++) {
+        if (font[i].c == c)
+            return font[i].bits;
+    }
+    return 0;
+}
+
+void gigatron_stats_draw(uint32_t *pixels, int width, int height,
+                         int x, int y, const char *text,
+                         uint32_t color, int scale)
+{
+    for (; *text; text++, x += STATS_CHAR_WIDTH * scale) {
+        uint16_t bits;
+        int row, col;
+
+        bits = glyph_bits(*text);
+        if (bits == 0) continue;
+
+        for (row = 0; row < 5; row++) {
+            for (col = 0; col < 3; col++) {
+                int px, py, i, j;
+
+                if (!(bits & (1 << (14 - 3 * row - col))))
+                    continue;
+
+                px = x + col * scale;
+                py = y + row * scale;
+                for (j = 0; j < scale; j++) {
+                    if (py + j < 0 || py + j >= height) continue;
+                    for (i = 0; i < scale; i++) {
+                        if (px + i < 0 || px + i >= width) continue;
+                        pixels[(py + j) * width + px + i] = color;
+                    }
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,103 @@
+#ifndef __STATS_H
+#define __STATS_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Constants. */
+
+/* Size of the characters drawn by `gigatron_stats_draw()` (in
+ * pixels, before scaling), including the spacing.
+ */
+#define STATS_CHAR_WIDTH  4
+#define STATS_CHAR_HEIGHT 6
+
+/* Maximum length of a formatted line of statistics. */
+#define STATS_MAX_LINE 256
+
+/* Data structures and type declarations. */
+
+/* The statistics of one measurement window. */
+struct gigatron_stats_window {
+    double seconds;      /* Length of the window. */
+    double mhz;          /* Emulated clock frequency. */
+    double fps;          /* Frames per second. */
+    double emulate_ms;   /* Host time per frame spent emulating, */
+    double output_ms;    /* publishing, recording and hashing, */
+    double render_ms;    /* rendering, */
+    double present_ms;   /* and presenting (including the pacing). */
+    uint32_t audio_fill; /* Samples in the audio FIFO (at the end). */
+    uint32_t audio_min;  /* Minimum samples in the audio FIFO. */
+    uint32_t underruns;  /* Audio callbacks that ran out of samples. */
+    uint32_t dropped;    /* Samples dropped because the FIFO was full. */
+    double latency_ms;   /* Average input latency (or 0). */
+    double latency_max_ms; /* Maximum input latency. */
+};
+
+/* The live performance and health statistics of the emulator.
+ * The counters are accumulated by the emulator (once per frame, so
+ * they cost nothing per cycle), and summarized at regular intervals
+ * in `last`.
+ */
+struct gigatron_stats {
+    uint64_t interval_ns;  /* Length of the windows. */
+    uint64_t start_ns;     /* Start of the current window. */
+    uint64_t start_cycles; /* Cycles at the start of the window. */
+    uint64_t mark_ns;      /* End of the last measured phase. */
+    uint64_t total_frames; /* Frames since the start. */
+
+    /* Counters of the current window. */
+    uint32_t frames;
+    uint64_t emulate_ns, output_ns, render_ns, present_ns;
+    uint32_t audio_fill, audio_min;
+    uint32_t underruns, dropped;
+    uint32_t num_inputs;
+    uint64_t latency_ns, latency_max_ns;
+
+    struct gigatron_stats_window last; /* The last complete window. */
+};
+
+/* Exported functions. */
+
+/* Returns the time of a monotonic clock (in nanoseconds). */
+uint64_t gigatron_stats_now(void);
+
+/* Initializes the statistics `st`, with windows of `interval_ms`
+ * milliseconds, starting at the cycle `num_cycles`.
+ */
+void gigatron_stats_init(struct gigatron_stats *st, uint32_t interval_ms,
+                         uint64_t num_cycles);
+
+/* Records the input latency `latency_ns`. */
+void gigatron_stats_input(struct gigatron_stats *st, uint64_t latency_ns);
+
+/* Records the level of the audio FIFO (in samples) at the end of a
+ * frame.
+ */
+void gigatron_stats_audio(struct gigatron_stats *st, uint32_t fill);
+
+/* Finishes a frame (at the cycle `num_cycles`). If the current
+ * window is complete, it is summarized in `st->last` and this
+ * function returns TRUE.
+ */
+int gigatron_stats_end_frame(struct gigatron_stats *st,
+                             uint64_t num_cycles);
+
+/* Formats the last window as a machine-readable line of
+ * "key=value" pairs in `outbuf` (of size `size`).
+ * Returns the length of the line.
+ */
+size_t gigatron_stats_format(const struct gigatron_stats *st,
+                             char *outbuf, size_t size);
+
+/* Draws the text `text` in the pixel buffer `pixels` (of `width` x
+ * `height` pixels, in ARGB8888 format) at `(x, y)`, with the color
+ * `color`, scaled by `scale`. Only digits, upper case letters and
+ * " .:%/-=" are drawn (lower case letters are converted).
+ */
+void gigatron_stats_draw(uint32_t *pixels, int width, int height,
+                         int x, int y, const char *text,
+                         uint32_t color, int scale);
+
+#endif /* __STATS_H */
@@ -0,0 +1,412 @@
+/* Binary execution trace recorder. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "byteorder.h"
+#include "trace.h"
+
+/* Flags of the encoded records. Each flag indicates that the
+ * corresponding field is present in the encoded record. The
+ * fields that are not present have the same value as in the
+ * previous record (or, for the program counter, the previous
+ * value plus one).
+ */
+#define FLAG_PC    0x01
+#define FLAG_IR    0x02
+#define FLAG_D     0x04
+#define FLAG_ACC   0x08
+#define FLAG_X     0x10
+#define FLAG_Y     0x20
+#define FLAG_OUT   0x40
+#define FLAG_CYCLE 0x80 /* Cycles were skipped before this record. */
+
+/* Writes the header of the trace file. */
+static int write_header(FILE *fp, uint32_t events)
+{
+    uint8_t header[16];
+
+    memset(header, 0, sizeof(header));
+    gigatron_put_le(header, TRACE_MAGIC, 4);
+    gigatron_put_le(&header[4], TRACE_VERSION, 4);
+    gigatron_put_le(&header[8], events, 4);
+
+    return (fwrite(header, sizeof(header), 1, fp) == 1);
+}
+
+/* Encodes and writes one chunk of `n` records. */
+static int write_chunk(FILE *fp, const struct gigatron_trace_record *records,
+                       const uint64_t *cycles, uint64_t first_cycle,
+                       uint32_t n, uint8_t *outbuf, uint64_t *bytes)
+{
+    uint8_t header[16];
+    size_t size;
+
+    size = gigatron_trace_encode(records, cycles, first_cycle, n, outbuf);
+    if (cycles) first_cycle = cycles[0];
+
+    gigatron_put_le(header, n, 4);
+    gigatron_put_le(&header[4], (uint32_t) size, 4);
+    gigatron_put_le(&header[8], first_cycle, 8);
+
+    if (fwrite(header, sizeof(header), 1, fp) != 1)
+        return FALSE;
+    if (fwrite(outbuf, 1, size, fp) != size)
+        return FALSE;
+
+    *bytes += sizeof(header) + size;
+    return TRUE;
+}
+
+/* Writes the records in the range [start, end) of the ring
+ * buffer. The range can not be larger than the ring buffer.
+ */
+static int write_range(const struct gigatron_trace *tr, FILE *fp,
+                       uint64_t start, uint64_t end,
+                       uint8_t *outbuf, uint64_t *bytes)
+{
+    while (start < end) {
+        uint64_t pos, n;
+
+        pos = start & (tr->capacity - 1);
+        n = end - start;
+        if (n > TRACE_BLOCK_SIZE) n = TRACE_BLOCK_SIZE;
+        if (n > tr->capacity - pos) n = tr->capacity - pos;
+
+        if (!write_chunk(fp, &tr->records[pos],
+                         (tr->cycles) ? &tr->cycles[pos] : NULL,
+                         tr->first_cycle + start, (uint32_t) n,
+                         outbuf, bytes))
+            return FALSE;
+
+        start += n;
+    }
+    return TRUE;
+}
+
+/* The writer thread. */
+static void *writer_thread(void *arg)
+{
+    struct gigatron_trace *tr;
+    uint64_t start, end;
+    int stop;
+
+    tr = (struct gigatron_trace *) arg;
+    for (;;) {
+        pthread_mutex_lock(&tr->lock);
+        while (!tr->stop && tr->committed == tr->tail)
+            pthread_cond_wait(&tr->cond_data, &tr->lock);
+        start = tr->tail;
+        end = tr->committed;
+        stop = tr->stop;
+        pthread_mutex_unlock(&tr->lock);
+
+        if (start == end && stop) break;
+
+        if (!write_range(tr, tr->fp, start, end, tr->outbuf,
+                         &tr->bytes_written)) {
+            fprintf(stderr, "could not write the trace file\n");
+        }
+
+        pthread_mutex_lock(&tr->lock);
+        tr->tail = end;
+        pthread_cond_signal(&tr->cond_space);
+        pthread_mutex_unlock(&tr->lock);
+    }
+
+    return NULL;
+}
+
+int gigatron_trace_create(struct gigatron_trace *tr,
+                          uint64_t capacity, uint32_t events)
+{
+    uint64_t size;
+
+    memset(tr, 0, sizeof(*tr));
+
+    size = 2 * TRACE_BLOCK_SIZE;
+    while (size < capacity) size <<= 1;
+
+    tr->capacity = size;
+    tr->events = events;
+    tr->records = malloc(size * sizeof(struct gigatron_trace_record));
+    if (!tr->records) {
+        fprintf(stderr, "memory exhausted\n");
+        return FALSE;
+    }
+
+    if (!(events & TRACE_EVENT_CYCLE)) {
+        tr->cycles = malloc(size * sizeof(uint64_t));
+        if (!tr->cycles) {
+            fprintf(stderr, "memory exhausted\n");
+            free(tr->records);
+            tr->records = NULL;
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+void gigatron_trace_destroy(struct gigatron_trace *tr)
+{
+    if (tr->streaming) {
+        pthread_mutex_lock(&tr->lock);
+        tr->committed = tr->head;
+        tr->stop = TRUE;
+        pthread_cond_signal(&tr->cond_data);
+        pthread_mutex_unlock(&tr->lock);
+
+        pthread_join(tr->thread, NULL);
+        pthread_cond_destroy(&tr->cond_space);
+        pthread_cond_destroy(&tr->cond_data);
+        pthread_mutex_destroy(&tr->lock);
+
+        fclose(tr->fp);
+        free(tr->outbuf);
+        tr->streaming = FALSE;
+    }
+
+    if (tr->records) free(tr->records);
+    if (tr->cycles) free(tr->cycles);
+    tr->records = NULL;
+    tr->cycles = NULL;
+}
+
+int gigatron_trace_stream(struct gigatron_trace *tr,
+                          const char *filename)
+{
+    if (tr->streaming || tr->head != 0) {
+        fprintf(stderr, "trace already started\n");
+        return FALSE;
+    }
+
+    tr->fp = fopen(filename, "wb");
+    if (!tr->fp) {
+        fprintf(stderr, "could not open file `%s` for writing\n",
+                filename);
+        return FALSE;
+    }
+
+    tr->outbuf = malloc(TRACE_BLOCK_SIZE * TRACE_MAX_RECORD_SIZE);
+    if (!tr->outbuf) {
+        fprintf(stderr, "memory exhausted\n");
+        fclose(tr->fp);
+        return FALSE;
+    }
+
+    if (!write_header(tr->fp, tr->events)) {
+        fprintf(stderr, "could not write the trace file\n");
+        goto fail_stream;
+    }
+
+    tr->stop = FALSE;
+    tr->committed = 0;
+    tr->tail = 0;
+    tr->bytes_written = 0;
+    pthread_mutex_init(&tr->lock, NULL);
+    pthread_cond_init(&tr->cond_data, NULL);
+    pthread_cond_init(&tr->cond_space, NULL);
+
+    if (pthread_create(&tr->thread, NULL, writer_thread, tr) != 0) {
+        fprintf(stderr, "could not create the writer thread\n");
+        pthread_cond_destroy(&tr->cond_space);
+        pthread_cond_destroy(&tr->cond_data);
+        pthread_mutex_destroy(&tr->lock);
+        goto fail_stream;
+    }
+
+    tr->streaming = TRUE;
+    return TRUE;
+
+fail_stream:
+    fclose(tr->fp);
+    free(tr->outbuf);
+    tr->fp = NULL;
+    tr->outbuf = NULL;
+    return FALSE;
+}
+
+int gigatron_trace_save(const struct gigatron_trace *tr,
+                        const char *filename)
+{
+    uint64_t start, bytes;
+    uint8_t *outbuf;
+    FILE *fp;
+    int ret;
+
+    fp = fopen(filename, "wb");
+    if (!fp) {
+        fprintf(stderr, "could not open file `%s` for writing\n",
+                filename);
+        return FALSE;
+    }
+
+    outbuf = malloc(TRACE_BLOCK_SIZE * TRACE_MAX_RECORD_SIZE);
+    if (!outbuf) {
+        fprintf(stderr, "memory exhausted\n");
+        fclose(fp);
+        return FALSE;
+    }
+
+    start = (tr->head > tr->capacity) ? tr->head - tr->capacity : 0;
+    bytes = 0;
+    ret = write_header(fp, tr->events)
+        && write_range(tr, fp, start, tr->head, outbuf, &bytes);
+    if (!ret)
+        fprintf(stderr, "could not write the trace file\n");
+
+    free(outbuf);
+    fclose(fp);
+    return ret;
+}
+
+void gigatron_trace_commit(struct gigatron_trace *tr)
+{
+    if (!tr->streaming) return;
+
+    pthread_mutex_lock(&tr->lock);
+    tr->committed = tr->head;
+    pthread_cond_signal(&tr->cond_data);
+
+    /* Wait until the next block is free. */
+    while (tr->head + TRACE_BLOCK_SIZE - tr->tail > tr->capacity)
+        pthread_cond_wait(&tr->cond_space, &tr->lock);
+    pthread_mutex_unlock(&tr->lock);
+}
+
+size_t gigatron_trace_encode(const struct gigatron_trace_record *records,
+                             const uint64_t *cycles, uint64_t first_cycle,
+                             uint32_t n, uint8_t *outbuf)
+{
+    struct gigatron_trace_record prev;
+    uint64_t cycle;
+    uint32_t i;
+    size_t len;
+
+    memset(&prev, 0, sizeof(prev));
+    prev.pc = 0xFFFF;
+    cycle = (cycles) ? cycles[0] : first_cycle;
+    len = 0;
+
+    for (i = 0; i < n; i++) {
+        const struct gigatron_trace_record *r;
+        uint64_t gap;
+        size_t pos;
+        uint8_t flags;
+
+        r = &records[i];
+        pos = len++;
+        flags = 0;
+
+        gap = (cycles) ? cycles[i] - cycle : 0;
+        cycle += gap + 1;
+        if (gap != 0) {
+            flags |= FLAG_CYCLE;
+            while (gap >= 0x80) {
+                outbuf[len++] = (uint8_t) (gap | 0x80);
+                gap >>= 7;
+            }
+            outbuf[len++] = (uint8_t) gap;
+        }
+
+        if (r->pc != (uint16_t) (prev.pc + 1)) {
+            flags |= FLAG_PC;
+            outbuf[len++] = (uint8_t) r->pc;
+            outbuf[len++] = (uint8_t) (r->pc >> 8);
+        }
+
+        if (r->ir != prev.ir) {
+            flags |= FLAG_IR;
+            outbuf[len++] = r->ir;
+        }
+
+        if (r->d != prev.d) {
+            flags |= FLAG_D;
+            outbuf[len++] = r->d;
+        }
+
+        if (r->acc != prev.acc) {
+            flags |= FLAG_ACC;
+            outbuf[len++] = r->acc;
+        }
+
+        if (r->x != prev.x) {
+            flags |= FLAG_X;
+            outbuf[len++] = r->x;
+        }
+
+        if (r->y != prev.y) {
+            flags |= FLAG_Y;
+            outbuf[len++] = r->y;
+        }
+
+        if (r->out != prev.out) {
+            flags |= FLAG_OUT;
+            outbuf[len++] = r->out;
+        }
+
+        outbuf[pos] = flags;
+        prev = *r;
+    }
+
+    return len;
+}
+
+int64_t gigatron_trace_decode(const uint8_t *inbuf, size_t size,
+                              uint64_t first_cycle, uint32_t n,
+                              struct gigatron_trace_record *records,
+                              uint64_t *cycles)
+{
+    struct gigatron_trace_record cur;
+    uint64_t cycle;
+    size_t pos;
+    uint32_t i;
+
+    memset(&cur, 0, sizeof(cur));
+    cur.pc = 0xFFFF;
+    cycle = first_cycle;
+    pos = 0;
+
+    for (i = 0; i < n && pos < size; i++) {
+        uint8_t flags;
+
+        flags = inbuf[pos++];
+        cur.pc++;
+
+        if (flags & FLAG_CYCLE) {
+            uint64_t gap;
+            int shift;
+
+            gap = 0;
+            shift = 0;
+            do {
+                if (pos >= size || shift > 63) return -1;
+                gap |= ((uint64_t) (inbuf[pos] & 0x7F)) << shift;
+                shift += 7;
+            } while (inbuf[pos++] & 0x80);
+            cycle += gap;
+        }
+
+        if (flags & FLAG_PC) {
+            if (pos + 2 > size) return -1;
+            cur.pc = inbuf[pos] | (((uint16_t) inbuf[pos + 1]) << 8);
+            pos += 2;
+        }
+
+        if (pos + __builtin_popcount(flags & 0x7E) > size) return -1;
+        if (flags & FLAG_IR) cur.ir = inbuf[pos++];
+        if (flags & FLAG_D) cur.d = inbuf[pos++];
+        if (flags & FLAG_ACC) cur.acc = inbuf[pos++];
+        if (flags & FLAG_X) cur.x = inbuf[pos++];
+        if (flags & FLAG_Y) cur.y = inbuf[pos++];
+        if (flags & FLAG_OUT) cur.out = inbuf[pos++];
+
+        records[i] = cur;
+        if (cycles) cycles[i] = cycle;
+        cycle++;
+    }
+
+    return (int64_t) i;
+}
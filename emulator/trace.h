@@ -0,0 +1,184 @@
+#ifndef __TRACE_H
+#define __TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "gigatron.h"
+
+/* Constants. */
+
+/* Classes of events that are recorded in the trace. */
+#define TRACE_EVENT_CYCLE 0x01 /* Every cycle. */
+#define TRACE_EVENT_STORE 0x02 /* Store instructions. */
+#define TRACE_EVENT_JUMP  0x04 /* Branch instructions. */
+#define TRACE_EVENT_HSYNC 0x08 /* Rising edges of /HSYNC. */
+#define TRACE_EVENT_VSYNC 0x10 /* Rising edges of /VSYNC. */
+
+/* The records are handed to the writer thread in blocks of
+ * this many records (must be a power of two).
+ */
+#define TRACE_BLOCK_SIZE 65536
+
+/* Maximum size of one encoded record (in bytes): the flags (1),
+ * the cycle gap as LEB128 (up to 10 for a 64-bit gap), the address
+ * (2), and the six registers (1 each).
+ */
+#define TRACE_MAX_RECORD_SIZE 19
+
+/* Magic number and version of the trace files. */
+#define TRACE_MAGIC   0x52544754 /* "GTTR" */
+#define TRACE_VERSION 1
+
+/* Data structures and type declarations. */
+
+/* One record of the trace. This is the state as seen by
+ * `gigatron_disasm()`: the instruction `(ir, d)` at address `pc`
+ * is about to be executed, and the remaining registers hold the
+ * values before its execution.
+ */
+struct gigatron_trace_record {
+    uint16_t pc;         /* Address of the instruction. */
+    uint8_t  ir;         /* Instruction register. */
+    uint8_t  d;          /* Data register. */
+    uint8_t  acc;        /* Accumulator. */
+    uint8_t  x;          /* X index register. */
+    uint8_t  y;          /* Y index register. */
+    uint8_t  out;        /* Output register. */
+};
+
+/* The trace recorder.
+ * The records are kept in a preallocated ring buffer, so that the
+ * last `capacity` records are always available. Optionally, a
+ * background thread streams all records to a file.
+ */
+struct gigatron_trace {
+    struct gigatron_trace_record *records; /* The ring buffer. */
+    uint64_t *cycles;    /* Cycle of each record (or NULL if all
+                          * cycles are recorded). */
+    uint64_t capacity;   /* Size of the ring buffer (in records). */
+    uint64_t head;       /* Number of records written so far. */
+    uint64_t first_cycle;/* Cycle of the first record. */
+    uint32_t events;     /* Classes of events being recorded. */
+
+    /* Fields used for streaming to a file. */
+    int streaming;       /* Streaming to a file is enabled. */
+    int stop;            /* Request for the writer thread to stop. */
+    FILE *fp;            /* The file being written. */
+    uint8_t *outbuf;     /* Buffer for the encoded records. */
+    uint64_t committed;  /* Records handed to the writer thread. */
+    uint64_t tail;       /* Records already written to the file. */
+    uint64_t bytes_written; /* Size of the encoded records. */
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond_data;  /* Signaled on new committed data. */
+    pthread_cond_t cond_space; /* Signaled on space in the buffer. */
+};
+
+/* Exported functions. */
+
+/* Creates the trace recorder `tr`, with a ring buffer for
+ * `capacity` records (rounded up to a power of two, and to at
+ * least two blocks). The parameter `events` is a combination of the
+ * TRACE_EVENT_* flags.
+ * On success, this function returns TRUE.
+ */
+int gigatron_trace_create(struct gigatron_trace *tr,
+                          uint64_t capacity, uint32_t events);
+
+/* Deallocates the trace recorder, flushing all pending records
+ * to the file (if streaming).
+ */
+void gigatron_trace_destroy(struct gigatron_trace *tr);
+
+/* Starts streaming all records to the file `filename`.
+ * The records are compressed and written by a background thread.
+ * If the thread falls behind, the recording waits for it, so no
+ * records are lost. On success, this function returns TRUE.
+ */
+int gigatron_trace_stream(struct gigatron_trace *tr,
+                          const char *filename);
+
+/* Saves the records currently in the ring buffer to the file
+ * `filename`. On success, this function returns TRUE.
+ */
+int gigatron_trace_save(const struct gigatron_trace *tr,
+                        const char *filename);
+
+/* Hands the last block of records to the writer thread.
+ * This is called by `gigatron_trace_step()` at the end of every
+ * block, and it should not be called directly.
+ */
+void gigatron_trace_commit(struct gigatron_trace *tr);
+
+/* Encodes `n` records of `records` into `outbuf`, which must have
+ * room for `n * TRACE_MAX_RECORD_SIZE` bytes. The cycles of the
+ * records are in `cycles` (or, if NULL, they are consecutive
+ * starting at `first_cycle`). Returns the encoded size.
+ */
+size_t gigatron_trace_encode(const struct gigatron_trace_record *records,
+                             const uint64_t *cycles, uint64_t first_cycle,
+                             uint32_t n, uint8_t *outbuf);
+
+/* Decodes the `size` bytes in `inbuf` into at most `n` records
+ * (and their cycles, starting at `first_cycle`). Returns the number
+ * of records decoded, or -1 if the data is corrupted.
+ */
+int64_t gigatron_trace_decode(const uint8_t *inbuf, size_t size,
+                              uint64_t first_cycle, uint32_t n,
+                              struct gigatron_trace_record *records,
+                              uint64_t *cycles);
+
+/* Returns TRUE if the current state of `gs` matches one of the
+ * classes of events in `events`.
+ */
+static inline int gigatron_trace_match(uint32_t events,
+                                       const struct gigatron_state *gs)
+{
+    uint32_t ins;
+    uint8_t rise;
+
+    if (events & TRACE_EVENT_CYCLE) return TRUE;
+
+    ins = (((uint32_t) gs->reg_ir) >> 5) & 0x07;
+    rise = gs->reg_out & ~gs->prev_out;
+
+    if ((events & TRACE_EVENT_STORE) && (ins == 6)) return TRUE;
+    if ((events & TRACE_EVENT_JUMP) && (ins == 7)) return TRUE;
+    if ((events & TRACE_EVENT_HSYNC) && (rise & 0x40)) return TRUE;
+    if ((events & TRACE_EVENT_VSYNC) && (rise & 0x80)) return TRUE;
+    return FALSE;
+}
+
+/* Records the state `gs` in the trace, if it matches the classes
+ * of events being recorded. This is meant to be called right
+ * after `gigatron_step()`, and it never allocates memory.
+ */
+static inline void gigatron_trace_step(struct gigatron_trace *tr,
+                                       const struct gigatron_state *gs)
+{
+    struct gigatron_trace_record *r;
+    uint64_t pos;
+
+    if (!gigatron_trace_match(tr->events, gs)) return;
+
+    if (tr->head == 0) tr->first_cycle = gs->num_cycles;
+
+    pos = tr->head & (tr->capacity - 1);
+    r = &tr->records[pos];
+    r->pc = gs->prev_pc;
+    r->ir = gs->reg_ir;
+    r->d = gs->reg_d;
+    r->acc = gs->reg_acc;
+    r->x = gs->reg_x;
+    r->y = gs->reg_y;
+    r->out = gs->reg_out;
+    if (tr->cycles) tr->cycles[pos] = gs->num_cycles;
+
+    tr->head++;
+    if ((tr->head & (TRACE_BLOCK_SIZE - 1)) == 0)
+        gigatron_trace_commit(tr);
+}
+
+#endif /* __TRACE_H */
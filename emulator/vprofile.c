@@ -0,0 +1,318 @@
+/* vCPU-level profiler for the programs run by the ROM interpreter. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vprofile.h"
+
+/* Maximum size of a GT1 file. */
+#define GT1_MAX_SIZE (1 << 17)
+
+/* A vCPU address and its counts, used for sorting the report. */
+struct vpc_count {
+    uint16_t vpc;
+    uint64_t insns;
+    uint64_t cycles;
+};
+
+/* Mnemonics of the vCPU instructions (ROM v5a). */
+static const struct {
+    uint8_t opcode;
+    const char *name;
+} vcpu_mnemonics[] = {
+    { 0x11, "LDWI" }, { 0x1A, "LD" },    { 0x1F, "CMPHS" },
+    { 0x21, "LDW" },  { 0x2B, "STW" },   { 0x35, "BCC" },
+    { 0x59, "LDI" },  { 0x5E, "ST" },    { 0x63, "POP" },
+    { 0x75, "PUSH" }, { 0x7F, "LUP" },   { 0x82, "ANDI" },
+    { 0x85, "CALLI" },{ 0x88, "ORI" },   { 0x8C, "XORI" },
+    { 0x90, "BRA" },  { 0x93, "INC" },   { 0x97, "CMPHU" },
+    { 0x99, "ADDW" }, { 0xAD, "PEEK" },  { 0xB4, "SYS" },
+    { 0xB8, "SUBW" }, { 0xCD, "DEF" },   { 0xCF, "CALL" },
+    { 0xDF, "ALLOC" },{ 0xE3, "ADDI" },  { 0xE6, "SUBI" },
+    { 0xE9, "LSLW" }, { 0xEC, "STLW" },  { 0xEE, "LDLW" },
+    { 0xF0, "POKE" }, { 0xF3, "DOKE" },  { 0xF6, "DEEK" },
+    { 0xF8, "ANDW" }, { 0xFA, "ORW" },   { 0xFC, "XORW" },
+    { 0xFF, "RET" }
+};
+
+uint16_t gigatron_vprofile_find_dispatch(const uint16_t *rom)
+{
+    uint32_t addr;
+
+    for (addr = (VPROFILE_FIRST_PAGE << 8);
+         addr < ((VPROFILE_FIRST_PAGE + 1) << 8); addr++) {
+        /* bra ac */
+        if ((rom[addr] & 0xFF) == 0xFE)
+            return (uint16_t) addr;
+    }
+    return 0;
+}
+
+int gigatron_vprofile_create(struct gigatron_vprofile *vp,
+                             const uint16_t *rom, uint16_t dispatch)
+{
+    memset(vp->insns, 0, sizeof(vp->insns));
+    memset(vp->cycles, 0, sizeof(vp->cycles));
+    memset(vp->opcode, 0, sizeof(vp->opcode));
+
+    vp->vpc = VPROFILE_NO_VPC;
+    vp->num_segments = 0;
+    vp->program = NULL;
+    vp->num_insns = 0;
+    vp->num_cycles = 0;
+
+    if (dispatch == 0) {
+        dispatch = gigatron_vprofile_find_dispatch(rom);
+        if (dispatch == 0) {
+            fprintf(stderr, "could not find the vCPU dispatch\n");
+            return FALSE;
+        }
+    }
+
+    vp->dispatch = dispatch;
+    return TRUE;
+}
+
+int gigatron_vprofile_load_gt1(struct gigatron_vprofile *vp,
+                               const char *filename)
+{
+    uint8_t *buf;
+    size_t size, pos;
+    int valid;
+    FILE *fp;
+
+    fp = fopen(filename, "rb");
+    if (!fp) {
+        fprintf(stderr, "could not open file `%s` for reading\n",
+                filename);
+        return FALSE;
+    }
+
+    buf = malloc(GT1_MAX_SIZE);
+    if (!buf) {
+        fprintf(stderr, "memory exhausted\n");
+        fclose(fp);
+        return FALSE;
+    }
+
+    size = fread(buf, 1, GT1_MAX_SIZE, fp);
+    fclose(fp);
+
+    /* Each segment is "<high> <low> <size> <data>", where a size of
+     * zero means 256 bytes. The list is terminated by a zero high
+     * byte (except for the first segment), followed by the start
+     * address.
+     */
+    vp->num_segments = 0;
+    valid = FALSE;
+    pos = 0;
+    while (pos + 3 <= size) {
+        struct vprofile_segment *seg;
+        uint32_t len;
+
+        if (buf[pos] == 0 && vp->num_segments > 0) {
+            valid = TRUE;
+            break;
+        }
+
+        len = (buf[pos + 2] == 0) ? 256 : buf[pos + 2];
+        if (pos + 3 + len > size
+            || vp->num_segments == VPROFILE_MAX_SEGMENTS)
+            break;
+
+        seg = &vp->segments[vp->num_segments++];
+        seg->addr = (uint16_t) ((buf[pos] << 8) | buf[pos + 1]);
+        seg->size = (uint16_t) len;
+        pos += 3 + len;
+    }
+    free(buf);
+
+    if (!valid) {
+        fprintf(stderr, "invalid GT1 file `%s`\n", filename);
+        vp->num_segments = 0;
+        return FALSE;
+    }
+
+    vp->program = filename;
+    return TRUE;
+}
+
+void gigatron_vprofile_run(struct gigatron_vprofile *vp,
+                           struct gigatron_state *gs,
+                           uint64_t num_cycles)
+{
+    uint64_t i;
+
+    for (i = 0; i < num_cycles; i++) {
+        gigatron_step(gs);
+        gigatron_vprofile_step(vp, gs);
+    }
+}
+
+/* Returns the index of the segment containing `vpc`, or
+ * `num_segments` if there is none.
+ */
+static uint32_t find_segment(const struct gigatron_vprofile *vp,
+                             uint16_t vpc)
+{
+    uint32_t i;
+
+    for (i = 0; i < vp->num_segments; i++) {
+        const struct vprofile_segment *seg;
+
+        seg = &vp->segments[i];
+        if (vpc >= seg->addr && vpc < seg->addr + seg->size)
+            return i;
+    }
+    return vp->num_segments;
+}
+
+/* Returns the mnemonic of the vCPU `opcode` (or NULL). */
+static const char *vcpu_mnemonic(uint8_t opcode)
+{
+    size_t i;
+
+    for (i = 0; i < sizeof(vcpu_mnemonics) / sizeof(vcpu_mnemonics[0]);
+         i++) {
+        if (vcpu_mnemonics[i].opcode == opcode)
+            return vcpu_mnemonics[i].name;
+    }
+    return NULL;
+}
+
+/* Writes the name of the segment containing `vpc` in `name`. */
+static void segment_name(const struct gigatron_vprofile *vp,
+                         uint16_t vpc, char *name, size_t size)
+{
+    uint32_t i;
+
+    i = find_segment(vp, vpc);
+    if (i < vp->num_segments) {
+        snprintf(name, size, "seg_%04X", (uint32_t) vp->segments[i].addr);
+    } else {
+        snprintf(name, size, "page_%02X", (uint32_t) (vpc >> 8));
+    }
+}
+
+int gigatron_vprofile_write_folded(const struct gigatron_vprofile *vp,
+                                   FILE *fp)
+{
+    const char *program;
+    char name[16];
+    uint32_t vpc;
+
+    program = (vp->program) ? vp->program : "vcpu";
+    for (vpc = 0; vpc < 65536; vpc++) {
+        const char *mnemonic;
+
+        if (vp->cycles[vpc] == 0) continue;
+
+        segment_name(vp, (uint16_t) vpc, name, sizeof(name));
+        mnemonic = vcpu_mnemonic(vp->opcode[vpc]);
+        fprintf(fp, "%s;%s;$%04X", program, name, vpc);
+        if (mnemonic) {
+            fprintf(fp, "_%s", mnemonic);
+        } else {
+            fprintf(fp, "_$%02X", (uint32_t) vp->opcode[vpc]);
+        }
+        fprintf(fp, " %llu\n", (unsigned long long) vp->cycles[vpc]);
+    }
+
+    return !ferror(fp);
+}
+
+/* Comparison function to sort by decreasing cycles. */
+static int cmp_vpc_count(const void *p1, const void *p2)
+{
+    const struct vpc_count *c1, *c2;
+
+    c1 = (const struct vpc_count *) p1;
+    c2 = (const struct vpc_count *) p2;
+    if (c1->cycles != c2->cycles)
+        return (c1->cycles < c2->cycles) ? 1 : -1;
+    return ((int) c1->vpc) - ((int) c2->vpc);
+}
+
+void gigatron_vprofile_report(const struct gigatron_vprofile *vp,
+                              FILE *fp, uint32_t max_lines)
+{
+    struct vpc_count *counts;
+    uint64_t seg_insns[VPROFILE_MAX_SEGMENTS + 1];
+    uint64_t seg_cycles[VPROFILE_MAX_SEGMENTS + 1];
+    double total;
+    uint32_t i, num_counts;
+    char name[16];
+
+    counts = malloc(65536 * sizeof(*counts));
+    if (!counts) {
+        fprintf(stderr, "memory exhausted\n");
+        return;
+    }
+
+    memset(seg_insns, 0, sizeof(seg_insns));
+    memset(seg_cycles, 0, sizeof(seg_cycles));
+
+    num_counts = 0;
+    for (i = 0; i < 65536; i++) {
+        uint32_t seg;
+
+        if (vp->insns[i] == 0 && vp->cycles[i] == 0) continue;
+
+        counts[num_counts].vpc = (uint16_t) i;
+        counts[num_counts].insns = vp->insns[i];
+        counts[num_counts].cycles = vp->cycles[i];
+        num_counts++;
+
+        seg = find_segment(vp, (uint16_t) i);
+        seg_insns[seg] += vp->insns[i];
+        seg_cycles[seg] += vp->cycles[i];
+    }
+
+    total = (vp->num_cycles) ? (double) vp->num_cycles : 1.0;
+    fprintf(fp, "vCPU dispatch: $%04X\n", (uint32_t) vp->dispatch);
+    fprintf(fp, "vCPU instructions: %llu (%.2f cycles each)\n",
+            (unsigned long long) vp->num_insns,
+            (vp->num_insns) ? vp->num_cycles / (double) vp->num_insns
+            : 0.0);
+
+    qsort(counts, num_counts, sizeof(*counts), cmp_vpc_count);
+    fprintf(fp, "\nhottest vCPU instructions:\n");
+    for (i = 0; i < num_counts && i < max_lines; i++) {
+        const char *mnemonic;
+        char opname[8];
+
+        mnemonic = vcpu_mnemonic(vp->opcode[counts[i].vpc]);
+        if (!mnemonic) {
+            snprintf(opname, sizeof(opname), "$%02X",
+                     (uint32_t) vp->opcode[counts[i].vpc]);
+            mnemonic = opname;
+        }
+
+        segment_name(vp, counts[i].vpc, name, sizeof(name));
+        fprintf(fp, "%6.2f%% %14llu cycles %12llu insns  $%04X %-6s %s\n",
+                100.0 * counts[i].cycles / total,
+                (unsigned long long) counts[i].cycles,
+                (unsigned long long) counts[i].insns,
+                (uint32_t) counts[i].vpc, mnemonic, name);
+    }
+
+    if (vp->num_segments > 0) {
+        fprintf(fp, "\nsegments of `%s`:\n", vp->program);
+        for (i = 0; i <= vp->num_segments; i++) {
+            if (i < vp->num_segments) {
+                snprintf(name, sizeof(name), "seg_%04X",
+                         (uint32_t) vp->segments[i].addr);
+            } else {
+                snprintf(name, sizeof(name), "(other)");
+            }
+
+            fprintf(fp, "%6.2f%% %14llu cycles %12llu insns  %s\n",
+                    100.0 * seg_cycles[i] / total,
+                    (unsigned long long) seg_cycles[i],
+                    (unsigned long long) seg_insns[i], name);
+        }
+    }
+
+    free(counts);
+}
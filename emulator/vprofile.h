@@ -0,0 +1,126 @@
+#ifndef __VPROFILE_H
+#define __VPROFILE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "gigatron.h"
+
+/* Constants. */
+
+/* Address of the vCPU program counter (vPC) in the zero page. */
+#define VPROFILE_VPC_ADDR 0x16
+
+/* First ROM page of the vCPU interpreter. The pages below it hold
+ * the reset, video and sound code in all the ROM versions, so the
+ * cycles spent there are not charged to the vCPU instructions.
+ */
+#define VPROFILE_FIRST_PAGE 3
+
+/* Maximum number of GT1 segments. */
+#define VPROFILE_MAX_SEGMENTS 256
+
+/* Value of `vpc` when no vCPU instruction was dispatched yet. */
+#define VPROFILE_NO_VPC 0xFFFFFFFF
+
+/* Data structures and type declarations. */
+
+/* A segment of a GT1 program. */
+struct vprofile_segment {
+    uint16_t addr;       /* Start address of the segment. */
+    uint16_t size;       /* Size of the segment (in bytes). */
+};
+
+/* The vCPU-level profiler.
+ * It recognizes the dispatch of the vCPU instructions in the ROM,
+ * and charges the instructions and the native cycles to the vCPU
+ * addresses. The structure is large (about 1 MiB), so it should
+ * not be allocated on the stack.
+ */
+struct gigatron_vprofile {
+    uint64_t insns[65536];  /* Instructions per vCPU address. */
+    uint64_t cycles[65536]; /* Native cycles per vCPU address. */
+    uint8_t opcode[65536];  /* Last opcode seen at each address. */
+
+    uint16_t dispatch;   /* ROM address of the dispatch (`bra ac`). */
+    uint32_t vpc;        /* Address of the current instruction. */
+
+    struct vprofile_segment segments[VPROFILE_MAX_SEGMENTS];
+    uint32_t num_segments;
+    const char *program; /* Name of the GT1 program (or NULL). */
+
+    uint64_t num_insns;  /* Total instructions. */
+    uint64_t num_cycles; /* Total native cycles charged. */
+};
+
+/* Exported functions. */
+
+/* Finds the dispatch of the vCPU interpreter in the ROM `rom`, as
+ * the first `bra ac` instruction in the first page of the
+ * interpreter. Returns zero if it was not found.
+ */
+uint16_t gigatron_vprofile_find_dispatch(const uint16_t *rom);
+
+/* Creates the vCPU profiler `vp` for the ROM `rom`.
+ * The dispatch of the interpreter is found automatically (see
+ * above), unless `dispatch` is not zero.
+ * On success, this function returns TRUE.
+ */
+int gigatron_vprofile_create(struct gigatron_vprofile *vp,
+                             const uint16_t *rom, uint16_t dispatch);
+
+/* Loads the segments of the GT1 program in the file `filename`,
+ * so that the report is broken down by segment. The file name is
+ * kept (not copied) as the name of the program.
+ * On success, this function returns TRUE.
+ */
+int gigatron_vprofile_load_gt1(struct gigatron_vprofile *vp,
+                               const char *filename);
+
+/* Executes `num_cycles` instructions, profiling each of them. */
+void gigatron_vprofile_run(struct gigatron_vprofile *vp,
+                           struct gigatron_state *gs,
+                           uint64_t num_cycles);
+
+/* Writes the profile as folded stacks (one line per vCPU address,
+ * in the form "program;segment;address count"), which is the input
+ * format of the flamegraph tools. The counts are native cycles.
+ * On success, this function returns TRUE.
+ */
+int gigatron_vprofile_write_folded(const struct gigatron_vprofile *vp,
+                                   FILE *fp);
+
+/* Writes a report with the hottest vCPU addresses (at most
+ * `max_lines`) and the totals of each segment.
+ */
+void gigatron_vprofile_report(const struct gigatron_vprofile *vp,
+                              FILE *fp, uint32_t max_lines);
+
+/* Profiles the cycle just executed by `gs`. This is meant to be
+ * called right after `gigatron_step()`.
+ */
+static inline void gigatron_vprofile_step(struct gigatron_vprofile *vp,
+                                          const struct gigatron_state *gs)
+{
+    uint16_t pc;
+
+    pc = gs->prev_pc;
+    if (pc == vp->dispatch) {
+        uint16_t vpc;
+
+        vpc = (uint16_t) (gs->ram[VPROFILE_VPC_ADDR]
+                          | (gs->ram[VPROFILE_VPC_ADDR + 1] << 8));
+        vp->vpc = vpc;
+        vp->insns[vpc]++;
+        vp->num_insns++;
+        if (((size_t) vpc) < gs->ram_size)
+            vp->opcode[vpc] = gs->ram[vpc];
+    }
+
+    if (vp->vpc != VPROFILE_NO_VPC && (pc >> 8) >= VPROFILE_FIRST_PAGE) {
+        vp->cycles[vp->vpc]++;
+        vp->num_cycles++;
+    }
+}
+
+#endif /* __VPROFILE_H */
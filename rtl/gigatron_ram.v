@@ -47,6 +47,13 @@ module gigatron_ram(i_clock,
         for (i = 0; i < RAM_SIZE; i = i + 1)
           ram[i] = 0;
      end
+
+   // Reads the RAM from the simulator (for the co-simulation)
+   export "DPI-C" function gigatron_ram_peek;
+
+   function int gigatron_ram_peek(input int addr);
+      gigatron_ram_peek = { 24'b0, ram[addr[15:0]] };
+   endfunction
 `endif
 
 endmodule
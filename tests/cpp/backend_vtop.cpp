@@ -0,0 +1,134 @@
+// Backend of the emulator frontend running the Verilated RTL model
+// (see emulator/backend.h). It is linked into `gtemu_rtl`, which
+// must run from this directory, as the model reads its ROM from
+// ../../data/rom.hex.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <verilated.h>
+#include <svdpi.h>
+#include <Vtop.h>
+#include <Vtop__Dpi.h>
+
+extern "C" {
+#include "backend.h"
+#include "dirty.h"
+#include "gigatron.h"
+}
+
+// Current simulation time (64-bit unsigned)
+static vluint64_t main_time;
+
+// Called by $time in Verilog
+double sc_time_stamp()
+{
+    return main_time;
+}
+
+// Copies the registers of the model into `gs`
+static void read_registers(const Vtop* top, struct gigatron_state* gs)
+{
+    gs->pc = top->o_pc;
+    gs->prev_pc = top->o_prev_pc;
+    gs->reg_ir = top->o_ir;
+    gs->reg_d = top->o_d;
+    gs->reg_acc = top->o_acc;
+    gs->reg_x = top->o_x;
+    gs->reg_y = top->o_y;
+    gs->reg_out = top->o_out;
+    gs->prev_out = top->o_prev_out;
+    gs->reg_xout = top->o_xout;
+}
+
+static int vtop_create(struct gigatron_backend* be,
+                       const char* rom_filename, uint32_t ram_size)
+{
+    Vtop* top;
+
+    // The ROM is loaded for the tools of the frontend, and the RAM
+    // holds the copies made by vtop_sync_ram()
+    if (!gigatron_create(&be->gs, rom_filename, ram_size))
+        return FALSE;
+
+    top = new Vtop();
+    be->priv = top;
+    return TRUE;
+}
+
+static void vtop_destroy(struct gigatron_backend* be)
+{
+    Vtop* top = (Vtop*) be->priv;
+
+    top->final();
+    delete top;
+    be->priv = NULL;
+    gigatron_destroy(&be->gs);
+}
+
+static void vtop_reset(struct gigatron_backend* be, int zero_ram)
+{
+    Vtop* top = (Vtop*) be->priv;
+
+    // The RAM of the model cannot be cleared from here
+    gigatron_reset(&be->gs, zero_ram);
+
+    top->i_reset = 1;
+    top->i_ready = 1;
+    top->i_in = 0xFF;
+
+    // Evaluate the model 2 times for reset, as in sim_main.cpp
+    top->i_clock = 0;
+    top->eval();
+    top->i_clock = 1;
+    top->eval();
+    top->i_reset = 0;
+
+    // The scope of the RAM, for gigatron_ram_peek()
+    svSetScope(svGetScopeFromName("TOP.top.gram1"));
+    read_registers(top, &be->gs);
+}
+
+static void vtop_step(struct gigatron_backend* be)
+{
+    Vtop* top = (Vtop*) be->priv;
+    struct gigatron_state* gs = &be->gs;
+    int i;
+
+    // The model latches the input itself; the input register is
+    // only kept for the frontend
+    if ((gs->reg_out & 0x40) && !(gs->prev_out & 0x40))
+        gs->reg_in = gs->in;
+
+    top->i_in = gs->in;
+    for (i = 0; i < 2; i++) {
+        main_time++;
+        top->i_clock = !top->i_clock;
+        top->eval();
+    }
+
+    read_registers(top, gs);
+    gs->num_cycles++;
+}
+
+static void vtop_sync_ram(struct gigatron_backend* be)
+{
+    struct gigatron_state* gs = &be->gs;
+    uint32_t addr;
+    uint8_t value;
+
+    // Only the bytes that changed are marked in the dirty bitmap
+    for (addr = 0; addr < gs->ram_size; addr++) {
+        value = (uint8_t) gigatron_ram_peek((int) addr);
+        if (value != gs->ram[addr]) {
+            gs->ram[addr] = value;
+            if (gs->dirty) gigatron_dirty_mark(gs->dirty, addr);
+        }
+    }
+}
+
+extern "C" const struct gigatron_backend_ops gigatron_backend_vtop = {
+    "verilator", "the Verilated RTL model (tests/rtl)", 0,
+    &vtop_create, &vtop_destroy, &vtop_reset, &vtop_step, &vtop_sync_ram
+};
@@ -0,0 +1,112 @@
+import argparse
+import os
+import subprocess
+import sys
+from concurrent.futures import ThreadPoolExecutor
+
+# Size of the coverage maps written by the simulator (one byte per
+# ROM address).
+COVERAGE_SIZE = 65536
+
+
+def run_seed(args, seed):
+    """Runs the co-simulation with the random input of `seed`, and
+    returns (seed, exit code, output, coverage map)."""
+    cov_filename = os.path.join(args.logs, "cov_%d.bin" % seed)
+    log_filename = os.path.join(args.logs, "seed_%d.log" % seed)
+    cmd = [args.sim, "+seed=%d" % seed, "+cycles=%d" % args.cycles,
+           "+coverage=%s" % cov_filename]
+    if args.checkpoint > 0:
+        cmd.append("+checkpoint=%d" % args.checkpoint)
+
+    proc = subprocess.run(cmd, stdout=subprocess.PIPE,
+                          stderr=subprocess.STDOUT)
+    output = proc.stdout.decode("utf-8", "replace")
+    with open(log_filename, "w") as f:
+        f.write(output)
+
+    coverage = bytes(COVERAGE_SIZE)
+    if os.path.exists(cov_filename):
+        with open(cov_filename, "rb") as f:
+            coverage = f.read()
+    return seed, proc.returncode, output, coverage
+
+
+def covered(coverage):
+    return sum(1 for c in coverage if c)
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="run the co-simulation with random input, "
+        "one seed per process, and merge the results")
+    parser.add_argument("--sim", type=str, default="./sim_fast",
+                        help="the simulator (default: ./sim_fast)")
+    parser.add_argument("--seeds", type=int, default=16,
+                        help="number of seeds (default: 16)")
+    parser.add_argument("--first-seed", type=int, default=1,
+                        help="first seed (default: 1)")
+    parser.add_argument("--cycles", type=int, default=10000000,
+                        help="cycles per seed (default: 10000000)")
+    parser.add_argument("--checkpoint", type=int, default=1000000,
+                        help="cycles between checkpoints, "
+                        "0 for lockstep (default: 1000000)")
+    parser.add_argument("--jobs", type=int, default=os.cpu_count(),
+                        help="parallel simulations (default: all cores)")
+    parser.add_argument("--logs", type=str, default="logs/campaign",
+                        help="output directory (default: logs/campaign)")
+    args = parser.parse_args()
+
+    os.makedirs(args.logs, exist_ok=True)
+
+    # Seed 0 runs without input, as the baseline of the coverage.
+    seeds = [0] + list(range(args.first_seed,
+                             args.first_seed + args.seeds))
+    with ThreadPoolExecutor(max_workers=max(1, args.jobs)) as pool:
+        results = list(pool.map(lambda s: run_seed(args, s), seeds))
+
+    merged = bytearray(COVERAGE_SIZE)
+    for _, _, _, coverage in results:
+        for i, c in enumerate(coverage[:COVERAGE_SIZE]):
+            if c:
+                merged[i] = 1
+    baseline = results[0][3]
+    new = [i for i in range(COVERAGE_SIZE) if merged[i] and not baseline[i]]
+
+    failures = [r for r in results if r[1] != 0]
+    report_filename = os.path.join(args.logs, "report.txt")
+    with open(report_filename, "w") as f:
+        f.write("seeds: %d, cycles per seed: %d, checkpoint: %d\n"
+                % (len(seeds), args.cycles, args.checkpoint))
+        f.write("failures: %d\n" % len(failures))
+        f.write("covered ROM addresses: %d (baseline %d, %d only "
+                "with random input)\n"
+                % (covered(merged), covered(baseline), len(new)))
+        f.write("\n")
+        for seed, code, _, coverage in results:
+            f.write("seed %d: %s, %d addresses\n"
+                    % (seed, "ok" if code == 0 else "FAILED (%d)" % code,
+                       covered(coverage)))
+        for seed, code, output, _ in failures:
+            f.write("\n=== seed %d (exit code %d) ===\n" % (seed, code))
+            f.write(output)
+        if new:
+            f.write("\naddresses reached only with random input:\n")
+            for i in new:
+                f.write("%04x\n" % i)
+
+    with open(os.path.join(args.logs, "coverage.bin"), "wb") as f:
+        f.write(merged)
+
+    print("%d seeds, %d failures, %d ROM addresses covered "
+          "(%d only with random input)"
+          % (len(seeds), len(failures), covered(merged), len(new)))
+    for seed, code, _, _ in failures:
+        print("seed %d failed (exit code %d), see %s"
+              % (seed, code, os.path.join(args.logs, "seed_%d.log" % seed)))
+    print("report written to %s" % report_filename)
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -1,15 +1,22 @@
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include <verilated.h>
+#include <svdpi.h>
 #include <Vtop.h>
+#include <Vtop__Dpi.h>
 
 #if VM_TRACE
 #include <verilated_vcd_c.h>
+#include "vcd_window.h"
 #endif
 
 extern "C" {
 #include "gigatron.h"
+#include "hash.h"
+#include "input.h"
+#include "memprof.h"
 }
 
 // Current simulation time (64-bit unsigned)
@@ -23,11 +30,394 @@ double sc_time_stamp()
 
 static const char *rom_filename = "../../data/ROMv5a.rom";
 
+// Frequency of the Gigatron clock (for the speed report)
+static const double gigatron_hz = 6250000.0;
+
+// Size of the RAM of both models
+#define RAM_SIZE 65536
+
+// Number of registers compared
+#define NUM_REGS 12
+
+// Generator of random input (with +seed=<n>). A new value is
+// presented after each HSYNC pulse, and latched by the next one.
+// Each side has its own generator, so that they can run apart.
+struct input_gen {
+    uint64_t state;      // 0 when disabled
+    uint8_t value;
+};
+
+static uint64_t input_seed = 0;
+static struct input_gen emu_input, model_input;
+
+// ROM addresses fetched by the emulator (with +coverage=<file>)
+static uint8_t* coverage = NULL;
+
+#if VM_TRACE
+static VerilatedVcdC* tfp = NULL;
+
+// Rolling window of the trace (with +trace_window=<n>)
+static VcdWindowFile* window = NULL;
+static vluint64_t window_cycles = 0;
+#endif
+
+// Returns the time of a monotonic clock, in seconds
+static double now_seconds()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+// Starts the generator of random input
+static void input_init(struct input_gen* gen)
+{
+    gen->state = (input_seed) ? gigatron_input_init(input_seed) : 0;
+    gen->value = INPUT_IDLE;
+}
+
+// Returns the next input (see input.h)
+static uint8_t input_next(struct input_gen* gen)
+{
+    gen->value = gigatron_input_next(&gen->state, gen->value);
+    return gen->value;
+}
+
+// Resets the Verilated model
+static void reset_model(Vtop* top)
+{
+    top->i_reset = 1;
+    top->i_ready = 1;
+    top->i_in = INPUT_IDLE;
+    input_init(&model_input);
+
+    // Evaluate the model 2 times for reset
+    top->i_clock = 0;
+    top->eval();
+    top->i_clock = 1;
+    top->eval();
+
+    top->i_reset = 0;
+
+    // The scope of the RAM, for gigatron_ram_peek()
+    svSetScope(svGetScopeFromName("TOP.top.gram1"));
+}
+
+// Simulates one clock cycle of the model (falling and rising edges)
+static void clock_model(Vtop* top)
+{
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        main_time++;  // Time passes...
+
+        // Toggle clocks and such
+        top->i_clock = !top->i_clock;
+
+        // Evaluate model
+        top->eval();
+
+#if VM_TRACE
+        // Dump trace data for this cycle
+        if (tfp) tfp->dump(main_time);
+#endif
+    }
+}
+
+// Simulates one cycle of the model, and presents a new input after
+// the cycle that latched the previous one
+static void step_model(Vtop* top)
+{
+    int latch;
+
+    latch = (top->o_out & 0x40) && !(top->o_prev_out & 0x40);
+    clock_model(top);
+    if (latch && model_input.state)
+        top->i_in = input_next(&model_input);
+}
+
+// Executes one cycle of the emulator (see step_model())
+static void step_emulator(struct gigatron_state* gs)
+{
+    int latch;
+
+    latch = (gs->reg_out & 0x40) && !(gs->prev_out & 0x40);
+    gigatron_step(gs);
+    if (latch && emu_input.state)
+        gs->in = input_next(&emu_input);
+    if (coverage)
+        coverage[gs->prev_pc] = 1;
+}
+
+// Reads the registers of the emulator
+static void emulator_regs(const struct gigatron_state* gs, uint8_t* regs)
+{
+    regs[0] = gs->pc & 0xFF;
+    regs[1] = gs->pc >> 8;
+    regs[2] = gs->prev_pc & 0xFF;
+    regs[3] = gs->prev_pc >> 8;
+    regs[4] = gs->reg_ir;
+    regs[5] = gs->reg_d;
+    regs[6] = gs->reg_acc;
+    regs[7] = gs->reg_x;
+    regs[8] = gs->reg_y;
+    regs[9] = gs->reg_out;
+    regs[10] = gs->prev_out;
+    regs[11] = gs->reg_xout;
+}
+
+// Reads the registers of the Verilated model
+static void model_regs(const Vtop* top, uint8_t* regs)
+{
+    regs[0] = top->o_pc & 0xFF;
+    regs[1] = top->o_pc >> 8;
+    regs[2] = top->o_prev_pc & 0xFF;
+    regs[3] = top->o_prev_pc >> 8;
+    regs[4] = top->o_ir;
+    regs[5] = top->o_d;
+    regs[6] = top->o_acc;
+    regs[7] = top->o_x;
+    regs[8] = top->o_y;
+    regs[9] = top->o_out;
+    regs[10] = top->o_prev_out;
+    regs[11] = top->o_xout;
+}
+
+// Returns TRUE if the registers of both sides are the same
+static int same_registers(const struct gigatron_state* gs, const Vtop* top)
+{
+    uint8_t emu[NUM_REGS], rtl[NUM_REGS];
+
+    emulator_regs(gs, emu);
+    model_regs(top, rtl);
+    return memcmp(emu, rtl, NUM_REGS) == 0;
+}
+
+// Prints the registers of both sides
+static void print_registers(struct gigatron_state* gs, const Vtop* top)
+{
+    char buffer[256];
+
+    gigatron_disasm(gs, buffer, sizeof(buffer));
+    printf("%s\n\n", buffer);
+    printf("            emu   verilog\n");
+    printf("%8s: $%04X $%04X\n",
+           "pc", gs->pc, top->o_pc);
+    printf("%8s: $%04X $%04X\n",
+           "prev_pc", gs->prev_pc, top->o_prev_pc);
+    printf("%8s:   $%02X   $%02X\n",
+           "ir", gs->reg_ir, top->o_ir);
+    printf("%8s:   $%02X   $%02X\n",
+           "d", gs->reg_d, top->o_d);
+    printf("%8s:   $%02X   $%02X\n",
+           "acc", gs->reg_acc, top->o_acc);
+    printf("%8s:   $%02X   $%02X\n",
+           "x", gs->reg_x, top->o_x);
+    printf("%8s:   $%02X   $%02X\n",
+           "y", gs->reg_y, top->o_y);
+    printf("%8s:   $%02X   $%02X\n",
+           "out", gs->reg_out, top->o_out);
+    printf("%8s:   $%02X   $%02X\n",
+           "xout", gs->reg_xout, top->o_xout);
+    printf("\n\n");
+}
+
+// Hashes the state (registers and RAM) of the emulator
+static uint64_t emulator_hash(const struct gigatron_state* gs)
+{
+    uint8_t regs[NUM_REGS];
+
+    emulator_regs(gs, regs);
+    return gigatron_hash64(gs->ram, RAM_SIZE,
+                           gigatron_hash64(regs, NUM_REGS, 0));
+}
+
+// Hashes the state (registers and RAM) of the Verilated model
+static uint64_t model_hash(const Vtop* top, uint8_t* ram)
+{
+    uint8_t regs[NUM_REGS];
+    int addr;
+
+    model_regs(top, regs);
+    for (addr = 0; addr < RAM_SIZE; addr++)
+        ram[addr] = (uint8_t) gigatron_ram_peek(addr);
+    return gigatron_hash64(ram, RAM_SIZE,
+                           gigatron_hash64(regs, NUM_REGS, 0));
+}
+
+// Restores the emulator to the checkpoint `saved` (and its RAM)
+static void restore_emulator(struct gigatron_state* gs,
+                             const struct gigatron_state* saved,
+                             const uint8_t* saved_ram)
+{
+    uint8_t* ram;
+
+    ram = gs->ram;
+    *gs = *saved;
+    gs->ram = ram;
+    memcpy(gs->ram, saved_ram, RAM_SIZE);
+}
+
+// Locates the divergence between the last matching checkpoint (at
+// `from` cycles) and the first mismatching one (at `to` cycles).
+// The emulator is restored to the checkpoint, the model is replayed
+// from reset, and both are compared on every cycle.
+static void locate_divergence(Vtop*& top, struct gigatron_state* gs,
+                              const struct gigatron_state* saved,
+                              const uint8_t* saved_ram,
+                              const struct input_gen* saved_input,
+                              vluint64_t from, vluint64_t to)
+{
+    uint8_t access[256];
+    vluint64_t cycle;
+    uint32_t addr;
+    int count;
+
+    gigatron_memprof_decode(access);
+    restore_emulator(gs, saved, saved_ram);
+    emu_input = *saved_input;
+
+    top->final();
+    delete top;
+    top = new Vtop();
+    reset_model(top);
+    for (cycle = 0; cycle < from; cycle++)
+        step_model(top);
+
+    for (cycle = from; cycle < to; cycle++) {
+        uint8_t a;
+
+        // The address written by the next instruction
+        a = access[gs->reg_ir];
+        addr = gigatron_memprof_address(a, gs);
+
+        step_model(top);
+        step_emulator(gs);
+
+        if (!same_registers(gs, top)) {
+            printf("registers diverge at cycle %llu\n",
+                   (unsigned long long) cycle + 1);
+            print_registers(gs, top);
+            return;
+        }
+
+        if ((a & MEMPROF_WRITE)
+            && gs->ram[addr] != (uint8_t) gigatron_ram_peek(addr)) {
+            printf("RAM diverges at cycle %llu: "
+                   "[$%04X] = $%02X (emu), $%02X (verilog)\n",
+                   (unsigned long long) cycle + 1, addr, gs->ram[addr],
+                   (uint8_t) gigatron_ram_peek(addr));
+            print_registers(gs, top);
+            return;
+        }
+    }
+
+    // A write to another address: report the differences.
+    printf("RAM diverges between cycles %llu and %llu:\n",
+           (unsigned long long) from, (unsigned long long) to);
+    count = 0;
+    for (addr = 0; addr < RAM_SIZE && count < 16; addr++) {
+        uint8_t v;
+
+        v = (uint8_t) gigatron_ram_peek(addr);
+        if (gs->ram[addr] != v) {
+            printf("  [$%04X] = $%02X (emu), $%02X (verilog)\n",
+                   addr, gs->ram[addr], v);
+            count++;
+        }
+    }
+}
+
+// Co-simulates with checkpoints every `interval` cycles.
+// Returns TRUE if both sides matched.
+static int run_checkpoints(Vtop*& top, struct gigatron_state* gs,
+                           vluint64_t max_cycles, vluint64_t interval,
+                           vluint64_t* num_cycles)
+{
+    struct gigatron_state saved;
+    struct input_gen saved_input;
+    uint8_t *saved_ram, *model_ram;
+    vluint64_t i, n, checkpoint;
+    int ret;
+
+    saved_ram = (uint8_t*) malloc(RAM_SIZE);
+    model_ram = (uint8_t*) malloc(RAM_SIZE);
+    if (!saved_ram || !model_ram) {
+        printf("memory exhausted\n");
+        free(saved_ram);
+        free(model_ram);
+        return FALSE;
+    }
+
+    saved = *gs;
+    saved_input = emu_input;
+    memcpy(saved_ram, gs->ram, RAM_SIZE);
+    checkpoint = 0;
+    ret = TRUE;
+
+    while (!Verilated::gotFinish()) {
+        n = interval;
+        if (max_cycles > 0 && *num_cycles + n > max_cycles)
+            n = max_cycles - *num_cycles;
+        if (n == 0) break;
+
+        // Each side runs the whole batch on its own
+        for (i = 0; i < n; i++)
+            step_model(top);
+        for (i = 0; i < n; i++)
+            step_emulator(gs);
+        *num_cycles += n;
+
+        if (emulator_hash(gs) != model_hash(top, model_ram)) {
+            locate_divergence(top, gs, &saved, saved_ram, &saved_input,
+                              checkpoint, *num_cycles);
+            ret = FALSE;
+            break;
+        }
+
+        saved = *gs;
+        saved_input = emu_input;
+        memcpy(saved_ram, gs->ram, RAM_SIZE);
+        checkpoint = *num_cycles;
+    }
+
+    free(saved_ram);
+    free(model_ram);
+    return ret;
+}
+
+// Co-simulates comparing the registers on every cycle.
+// Returns TRUE if both sides matched.
+static int run_lockstep(Vtop* top, struct gigatron_state* gs,
+                        vluint64_t max_cycles, vluint64_t* num_cycles)
+{
+    while (!Verilated::gotFinish()
+           && (max_cycles == 0 || *num_cycles < max_cycles)) {
+        step_model(top);
+        (*num_cycles)++;
+        step_emulator(gs);
+
+#if VM_TRACE
+        // Start a new segment of the window (with a full dump)
+        if (window && (*num_cycles % window_cycles) == 0)
+            tfp->openNext(false);
+#endif
+
+        if (!same_registers(gs, top)) {
+            print_registers(gs, top);
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
 int main(int argc, char** argv, char** env)
 {
     struct gigatron_state gs;
-    char buffer[256];
-    int running;
+    vluint64_t num_cycles, max_cycles, interval;
+    double start, elapsed;
+    int ok;
 
     // Set debug level, 0 is off, 9 is highest presently used
     // May be overridden by commandArgs
@@ -41,11 +431,47 @@ int main(int argc, char** argv, char** env)
     // This needs to be called before you create any model
     Verilated::commandArgs(argc, argv);
 
-    if (!gigatron_create(&gs, rom_filename, 65536)) {
+    // Cycle budget: +cycles=<n> (0 for no limit)
+    max_cycles = 1000000;
+    const char* cycles_arg = Verilated::commandArgsPlusMatch("cycles=");
+    if (cycles_arg && cycles_arg[0]) {
+        max_cycles = strtoull(cycles_arg + strlen("+cycles="), NULL, 0);
+    }
+
+    // Checkpoint interval: +checkpoint=<n> (0 to compare every cycle)
+    interval = 0;
+    const char* checkpoint_arg =
+        Verilated::commandArgsPlusMatch("checkpoint=");
+    if (checkpoint_arg && checkpoint_arg[0]) {
+        interval = strtoull(checkpoint_arg + strlen("+checkpoint="),
+                            NULL, 0);
+    }
+
+    // Random input: +seed=<n> (0 for none)
+    const char* seed_arg = Verilated::commandArgsPlusMatch("seed=");
+    if (seed_arg && seed_arg[0]) {
+        input_seed = strtoull(seed_arg + strlen("+seed="), NULL, 0);
+    }
+
+    // Coverage of the ROM: +coverage=<file>
+    const char* coverage_arg = Verilated::commandArgsPlusMatch("coverage=");
+    const char* coverage_filename = NULL;
+    if (coverage_arg && coverage_arg[0]) {
+        coverage_filename = coverage_arg + strlen("+coverage=");
+        coverage = (uint8_t*) calloc(65536, 1);
+        if (!coverage) {
+            printf("memory exhausted\n");
+            return 1;
+        }
+    }
+
+    if (!gigatron_create(&gs, rom_filename, RAM_SIZE)) {
         return 1;
     }
 
     gigatron_reset(&gs, TRUE);
+    gs.in = INPUT_IDLE;
+    input_init(&emu_input);
 
     // Construct the Verilated model, from Vtop.h
     // generated from Verilating "top.v"
@@ -54,96 +480,64 @@ int main(int argc, char** argv, char** env)
 #if VM_TRACE
     // If verilator was invoked with --trace argument,
     // and if at run time passed the +trace argument, turn on tracing
-    VerilatedVcdC* tfp = NULL;
     const char* flag = Verilated::commandArgsPlusMatch("trace");
 
-    if (flag && 0 == strcmp(flag, "+trace")) {
-        Verilated::traceEverOn(true);  // Verilator must compute traced signals
-        VL_PRINTF("Enabling waves into logs/vlt_dump.vcd...\n");
-        tfp = new VerilatedVcdC;
-        top->trace(tfp, 99);  // Trace 99 levels of hierarchy
-        Verilated::mkdir("logs");
-        tfp->open("logs/vlt_dump.vcd");  // Open the dump file
+    // With +trace_window=<n>, only the last n to 2n cycles are kept
+    // in memory, and written at the end of the run (or on a mismatch)
+    const char* window_arg =
+        Verilated::commandArgsPlusMatch("trace_window=");
+    if (window_arg && window_arg[0]) {
+        window_cycles = strtoull(window_arg + strlen("+trace_window="),
+                                 NULL, 0);
+    }
+
+    if ((flag && 0 == strcmp(flag, "+trace")) || window_cycles > 0) {
+        if (interval > 0) {
+            // The model is recreated to locate a divergence
+            VL_PRINTF("Tracing is not supported with +checkpoint\n");
+        } else if (window_cycles > 0) {
+            Verilated::traceEverOn(true);
+            VL_PRINTF("Keeping the last %llu-%llu cycles of waves...\n",
+                      (unsigned long long) window_cycles,
+                      (unsigned long long) 2 * window_cycles);
+            window = new VcdWindowFile;
+            tfp = new VerilatedVcdC(window);
+            top->trace(tfp, 99);
+            tfp->open("logs/vlt_window.vcd");
+        } else {
+            Verilated::traceEverOn(true);  // Verilator must compute traced signals
+            VL_PRINTF("Enabling waves into logs/vlt_dump.vcd...\n");
+            tfp = new VerilatedVcdC;
+            top->trace(tfp, 99);  // Trace 99 levels of hierarchy
+            Verilated::mkdir("logs");
+            tfp->open("logs/vlt_dump.vcd");  // Open the dump file
+        }
     }
 #endif
 
     main_time = 0;
-    running = TRUE;
+    num_cycles = 0;
 
     // Set some inputs
-    top->i_reset = 1;
-    top->i_ready = 1;
-
-    // Evaluate the model 2 times for reset
-    top->i_clock = 0;
-    top->eval();
-    top->i_clock = 1;
-    top->eval();
+    reset_model(top);
 
-    top->i_reset = 0;
+    start = now_seconds();
 
     // Simulate
-    while (running) {
-        main_time++;  // Time passes...
-
-        // Toggle clocks and such
-        top->i_clock = !top->i_clock;
-
-        // Evaluate model
-        top->eval();
-
-        if (top->i_clock) {
-            gigatron_step(&gs);
-            if ((gs.pc != top->o_pc)
-                || (gs.prev_pc != top->o_prev_pc)
-                || (gs.reg_ir != top->o_ir)
-                || (gs.reg_d != top->o_d)
-                || (gs.reg_acc != top->o_acc)
-                || (gs.reg_x != top->o_x)
-                || (gs.reg_y != top->o_y)
-                || (gs.reg_out != top->o_out)
-                || (gs.prev_out != top->o_prev_out)
-                || (gs.reg_xout != top->o_xout)) {
-                running = FALSE;
-            }
-
-            if (!running) {
-                gigatron_disasm(&gs, buffer, sizeof(buffer));
-                printf("%s\n\n", buffer);
-                printf("            emu   verilog\n");
-                printf("%8s: $%04X $%04X\n",
-                       "pc", gs.pc, top->o_pc);
-                printf("%8s: $%04X $%04X\n",
-                       "prev_pc", gs.prev_pc, top->o_prev_pc);
-                printf("%8s:   $%02X   $%02X\n",
-                       "ir", gs.reg_ir, top->o_ir);
-                printf("%8s:   $%02X   $%02X\n",
-                       "d", gs.reg_d, top->o_d);
-                printf("%8s:   $%02X   $%02X\n",
-                       "acc", gs.reg_acc, top->o_acc);
-                printf("%8s:   $%02X   $%02X\n",
-                       "x", gs.reg_x, top->o_x);
-                printf("%8s:   $%02X   $%02X\n",
-                       "y", gs.reg_y, top->o_y);
-                printf("%8s:   $%02X   $%02X\n",
-                       "out", gs.reg_out, top->o_out);
-                printf("%8s:   $%02X   $%02X\n",
-                       "xout", gs.reg_xout, top->o_xout);
-                printf("\n\n");
-
-            }
-        }
-
-        if (Verilated::gotFinish()
-            || (main_time > 2 * 1000000))
-            running = 0;
-
-#if VM_TRACE
-        // Dump trace data for this cycle
-        if (tfp) tfp->dump(main_time);
-#endif
+    if (interval > 0) {
+        ok = run_checkpoints(top, &gs, max_cycles, interval, &num_cycles);
+    } else {
+        ok = run_lockstep(top, &gs, max_cycles, &num_cycles);
     }
 
+    elapsed = now_seconds() - start;
+    printf("simulated %llu cycles in %.3f s (%.0f cycles/s, "
+           "%.2f%% of real time)\n",
+           (unsigned long long) num_cycles, elapsed,
+           (elapsed > 0) ? num_cycles / elapsed : 0.0,
+           (elapsed > 0) ? 100.0 * num_cycles / elapsed / gigatron_hz
+           : 0.0);
+
 #if VM_TRACE
     // Simulate one more clock switch
     main_time++;  // Time passes...
@@ -164,6 +558,15 @@ int main(int argc, char** argv, char** env)
 #if VM_TRACE
     // Close trace if opened
     if (tfp) { tfp->close(); tfp = NULL; }
+
+    // Write the window of the trace
+    if (window) {
+        VL_PRINTF("Writing waves into logs/vlt_window.vcd...\n");
+        Verilated::mkdir("logs");
+        if (!window->save("logs/vlt_window.vcd"))
+            VL_PRINTF("Could not write logs/vlt_window.vcd\n");
+        delete window; window = NULL;
+    }
 #endif
 
 #if VM_COVERAGE
@@ -172,10 +575,21 @@ int main(int argc, char** argv, char** env)
     VerilatedCov::write("logs/coverage.dat");
 #endif
 
+    // Write the coverage of the ROM (one byte per address)
+    if (coverage) {
+        FILE* fp = fopen(coverage_filename, "wb");
+        if (!fp || fwrite(coverage, 1, 65536, fp) != 65536) {
+            printf("could not write `%s`\n", coverage_filename);
+            ok = FALSE;
+        }
+        if (fp) fclose(fp);
+        free(coverage);
+    }
+
     // Destroy model
     delete top; top = NULL;
 
     gigatron_destroy(&gs);
 
-    return 0;
+    return (ok) ? 0 : 1;
 }
@@ -0,0 +1,67 @@
+// Rolling in-memory window of a VCD trace
+#ifndef _VCD_WINDOW_H
+#define _VCD_WINDOW_H
+
+#include <stdio.h>
+#include <string>
+
+#include <verilated_vcd_c.h>
+
+// Output of a VerilatedVcdC that keeps the trace in memory instead of
+// writing it. The trace is split into segments (with openNext()),
+// each of them starting with the header and a full dump of the
+// values. Only the current and the previous segments are kept, so
+// the window always covers between one and two segments.
+class VcdWindowFile : public VerilatedVcdFile {
+    std::string m_segments[2];
+    int m_current;
+
+public:
+    VcdWindowFile() : m_current(0) {}
+    virtual ~VcdWindowFile() {}
+
+    // Starts a new segment (the name is ignored)
+    virtual bool open(const std::string& name) {
+        (void) name;
+        m_current ^= 1;
+        m_segments[m_current].clear();
+        return true;
+    }
+
+    virtual void close() {}
+
+    virtual ssize_t write(const char* bufp, ssize_t len) {
+        m_segments[m_current].append(bufp, len);
+        return len;
+    }
+
+    // Writes the window as a single VCD file: the previous segment,
+    // followed by the values of the current one (its header is the
+    // same). Returns false if the file could not be written.
+    bool save(const char* filename) const {
+        const std::string& prev = m_segments[m_current ^ 1];
+        const std::string& cur = m_segments[m_current];
+        const char* marker = "$enddefinitions $end";
+        size_t body;
+        FILE* fp;
+        bool ok;
+
+        fp = fopen(filename, "w");
+        if (!fp) return false;
+
+        ok = true;
+        body = 0;
+        if (!prev.empty()) {
+            ok = fwrite(prev.data(), 1, prev.size(), fp) == prev.size();
+            body = cur.find(marker);
+            body = (body == std::string::npos) ? 0
+                : cur.find('\n', body) + 1;
+        }
+        ok = ok && fwrite(cur.data() + body, 1, cur.size() - body, fp)
+            == cur.size() - body;
+        ok = (fclose(fp) == 0) && ok;
+        return ok;
+    }
+};
+
+#endif // _VCD_WINDOW_H